@@ -1,12 +1,111 @@
 #include "stdafx.h"
 #include "AST.h"
+#include "ASTRewriter.h"
+
+// Expression base
+IExpressionAST::IExpressionAST(ExpressionKind kind)
+	: m_kind(kind)
+{
+}
+
+void IExpressionAST::ReleaseChildren()
+{
+	ASTNodeGarbage garbage;
+	DetachChildren(garbage);
+	garbage.Collect();
+}
+
+void IExpressionAST::DetachChildren(ASTNodeGarbage&)
+{
+}
+
+void IExpressionAST::CollectChildSlots(ASTChildSlots&)
+{
+}
+
+// Statement base
+IStatementAST::IStatementAST(StatementKind kind)
+	: m_kind(kind)
+{
+}
+
+void IStatementAST::ReleaseChildren()
+{
+	ASTNodeGarbage garbage;
+	DetachChildren(garbage);
+	garbage.Collect();
+}
+
+void IStatementAST::DetachChildren(ASTNodeGarbage&)
+{
+}
+
+void IStatementAST::CollectChildSlots(ASTChildSlots&)
+{
+}
+
+// Detached nodes storage
+void ASTNodeGarbage::Add(std::unique_ptr<IExpressionAST> && node)
+{
+	if (node)
+	{
+		m_expressions.push_back(std::move(node));
+	}
+}
+
+void ASTNodeGarbage::AddShared(std::shared_ptr<IExpressionAST> && node)
+{
+	if (node)
+	{
+		m_sharedExpressions.push_back(std::move(node));
+	}
+}
+
+void ASTNodeGarbage::Add(std::unique_ptr<IStatementAST> && node)
+{
+	if (node)
+	{
+		m_statements.push_back(std::move(node));
+	}
+}
+
+void ASTNodeGarbage::Collect()
+{
+	// Every node loses its children before destruction, so its destructor doesn't go deeper
+	while (!m_statements.empty() || !m_expressions.empty() || !m_sharedExpressions.empty())
+	{
+		if (!m_statements.empty())
+		{
+			std::unique_ptr<IStatementAST> node = std::move(m_statements.back());
+			m_statements.pop_back();
+			node->DetachChildren(*this);
+		}
+		else if (!m_expressions.empty())
+		{
+			std::unique_ptr<IExpressionAST> node = std::move(m_expressions.back());
+			m_expressions.pop_back();
+			node->DetachChildren(*this);
+		}
+		else
+		{
+			std::shared_ptr<IExpressionAST> node = std::move(m_sharedExpressions.back());
+			m_sharedExpressions.pop_back();
+			// Node is still referenced by another literal, it will be released by it
+			if (node.use_count() == 1)
+			{
+				node->DetachChildren(*this);
+			}
+		}
+	}
+}
 
 // Binary expression
 BinaryExpressionAST::BinaryExpressionAST(
 	std::unique_ptr<IExpressionAST> && left,
 	std::unique_ptr<IExpressionAST> && right,
 	BinaryExpressionAST::Operator op)
-	: m_left(std::move(left))
+	: IExpressionAST(ExpressionKind::Binary)
+	, m_left(std::move(left))
 	, m_right(std::move(right))
 	, m_op(op)
 {
@@ -32,9 +131,27 @@ void BinaryExpressionAST::Accept(IExpressionVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+BinaryExpressionAST::~BinaryExpressionAST()
+{
+	ReleaseChildren();
+}
+
+void BinaryExpressionAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_left));
+	garbage.Add(std::move(m_right));
+}
+
+void BinaryExpressionAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	slots.expressions.push_back(&m_left);
+	slots.expressions.push_back(&m_right);
+}
+
 // Literal constant
 LiteralConstantAST::LiteralConstantAST(const LiteralConstantAST::Value& value)
-	: m_value(value)
+	: IExpressionAST(ExpressionKind::Literal)
+	, m_value(value)
 {
 }
 
@@ -48,9 +165,28 @@ void LiteralConstantAST::Accept(IExpressionVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+LiteralConstantAST::~LiteralConstantAST()
+{
+	ReleaseChildren();
+}
+
+void LiteralConstantAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	using Elements = std::vector<std::shared_ptr<IExpressionAST>>;
+	if (Elements* elements = boost::get<Elements>(&m_value))
+	{
+		for (auto& element : *elements)
+		{
+			garbage.AddShared(std::move(element));
+		}
+		elements->clear();
+	}
+}
+
 // Array element access
 ArrayElementAccessAST::ArrayElementAccessAST(const std::string& name, std::unique_ptr<IExpressionAST> && index)
-	: m_name(name)
+	: IExpressionAST(ExpressionKind::ArrayElementAccess)
+	, m_name(name)
 	, m_indices()
 {
 	m_indices.push_back(std::move(index));
@@ -85,9 +221,32 @@ void ArrayElementAccessAST::Accept(IExpressionVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+ArrayElementAccessAST::~ArrayElementAccessAST()
+{
+	ReleaseChildren();
+}
+
+void ArrayElementAccessAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	for (auto& index : m_indices)
+	{
+		garbage.Add(std::move(index));
+	}
+	m_indices.clear();
+}
+
+void ArrayElementAccessAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	for (auto& index : m_indices)
+	{
+		slots.expressions.push_back(&index);
+	}
+}
+
 // Unary operator
 UnaryAST::UnaryAST(std::unique_ptr<IExpressionAST> && expr, UnaryAST::Operator op)
-	: m_expr(std::move(expr))
+	: IExpressionAST(ExpressionKind::Unary)
+	, m_expr(std::move(expr))
 	, m_op(op)
 {
 }
@@ -107,9 +266,25 @@ void UnaryAST::Accept(IExpressionVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+UnaryAST::~UnaryAST()
+{
+	ReleaseChildren();
+}
+
+void UnaryAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_expr));
+}
+
+void UnaryAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	slots.expressions.push_back(&m_expr);
+}
+
 // Identifier node
 IdentifierAST::IdentifierAST(const std::string &name)
-	: m_name(name)
+	: IExpressionAST(ExpressionKind::Identifier)
+	, m_name(name)
 {
 }
 
@@ -127,7 +302,8 @@ FunctionCallExpressionAST::FunctionCallExpressionAST(
 	const std::string& name,
 	std::vector<std::unique_ptr<IExpressionAST>>&& params
 )
-	: m_name(name)
+	: IExpressionAST(ExpressionKind::FunctionCall)
+	, m_name(name)
 	, m_params(std::move(params))
 {
 }
@@ -156,9 +332,32 @@ void FunctionCallExpressionAST::Accept(IExpressionVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+FunctionCallExpressionAST::~FunctionCallExpressionAST()
+{
+	ReleaseChildren();
+}
+
+void FunctionCallExpressionAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	for (auto& param : m_params)
+	{
+		garbage.Add(std::move(param));
+	}
+	m_params.clear();
+}
+
+void FunctionCallExpressionAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	for (auto& param : m_params)
+	{
+		slots.expressions.push_back(&param);
+	}
+}
+
 // Variable declaration node
 VariableDeclarationAST::VariableDeclarationAST(std::unique_ptr<IdentifierAST> && identifier, ExpressionType type)
-	: m_identifier(std::move(identifier))
+	: IStatementAST(StatementKind::VariableDeclaration)
+	, m_identifier(std::move(identifier))
 	, m_type(type)
 	, m_expr(nullptr)
 {
@@ -189,12 +388,31 @@ void VariableDeclarationAST::Accept(IStatementVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+VariableDeclarationAST::~VariableDeclarationAST()
+{
+	ReleaseChildren();
+}
+
+void VariableDeclarationAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_expr));
+}
+
+void VariableDeclarationAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	if (m_expr)
+	{
+		slots.expressions.push_back(&m_expr);
+	}
+}
+
 // Assign statement node
 AssignStatementAST::AssignStatementAST(
 	std::unique_ptr<IdentifierAST> && identifier,
 	std::unique_ptr<IExpressionAST> && expr
 )
-	: m_identifier(std::move(identifier))
+	: IStatementAST(StatementKind::Assign)
+	, m_identifier(std::move(identifier))
 	, m_expr(std::move(expr))
 {
 }
@@ -214,11 +432,27 @@ void AssignStatementAST::Accept(IStatementVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+AssignStatementAST::~AssignStatementAST()
+{
+	ReleaseChildren();
+}
+
+void AssignStatementAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_expr));
+}
+
+void AssignStatementAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	slots.expressions.push_back(&m_expr);
+}
+
 ArrayElementAssignAST::ArrayElementAssignAST(
 	std::unique_ptr<ArrayElementAccessAST> && access,
 	std::unique_ptr<IExpressionAST> && expression
 )
-	: m_access(std::move(access))
+	: IStatementAST(StatementKind::ArrayElementAssign)
+	, m_access(std::move(access))
 	, m_expression(std::move(expression))
 {
 }
@@ -248,9 +482,27 @@ void ArrayElementAssignAST::Accept(IStatementVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+ArrayElementAssignAST::~ArrayElementAssignAST()
+{
+	ReleaseChildren();
+}
+
+void ArrayElementAssignAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_access));
+	garbage.Add(std::move(m_expression));
+}
+
+void ArrayElementAssignAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	ASTRewriter::CollectChildSlots(*m_access, slots);
+	slots.expressions.push_back(&m_expression);
+}
+
 // Return statement node
 ReturnStatementAST::ReturnStatementAST(std::unique_ptr<IExpressionAST> && expression)
-	: m_expression(std::move(expression))
+	: IStatementAST(StatementKind::Return)
+	, m_expression(std::move(expression))
 {
 }
 
@@ -264,12 +516,31 @@ void ReturnStatementAST::Accept(IStatementVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+ReturnStatementAST::~ReturnStatementAST()
+{
+	ReleaseChildren();
+}
+
+void ReturnStatementAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_expression));
+}
+
+void ReturnStatementAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	if (m_expression)
+	{
+		slots.expressions.push_back(&m_expression);
+	}
+}
+
 // If statement node
 IfStatementAST::IfStatementAST(
 	std::unique_ptr<IExpressionAST> && expr,
 	std::unique_ptr<IStatementAST> && then,
 	std::unique_ptr<IStatementAST> && elif)
-	: m_expr(std::move(expr))
+	: IStatementAST(StatementKind::If)
+	, m_expr(std::move(expr))
 	, m_then(std::move(then))
 	, m_elif(std::move(elif))
 {
@@ -300,11 +571,34 @@ void IfStatementAST::Accept(IStatementVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+IfStatementAST::~IfStatementAST()
+{
+	ReleaseChildren();
+}
+
+void IfStatementAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_expr));
+	garbage.Add(std::move(m_then));
+	garbage.Add(std::move(m_elif));
+}
+
+void IfStatementAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	slots.expressions.push_back(&m_expr);
+	slots.statements.push_back(&m_then);
+	if (m_elif)
+	{
+		slots.statements.push_back(&m_elif);
+	}
+}
+
 // While statement node
 WhileStatementAST::WhileStatementAST(
 	std::unique_ptr<IExpressionAST> && expr,
 	std::unique_ptr<IStatementAST> && stmt)
-	: m_expr(std::move(expr))
+	: IStatementAST(StatementKind::While)
+	, m_expr(std::move(expr))
 	, m_stmt(std::move(stmt))
 {
 }
@@ -324,7 +618,29 @@ void WhileStatementAST::Accept(IStatementVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+WhileStatementAST::~WhileStatementAST()
+{
+	ReleaseChildren();
+}
+
+void WhileStatementAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_expr));
+	garbage.Add(std::move(m_stmt));
+}
+
+void WhileStatementAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	slots.expressions.push_back(&m_expr);
+	slots.statements.push_back(&m_stmt);
+}
+
 // Composite statement node
+CompositeStatementAST::CompositeStatementAST()
+	: IStatementAST(StatementKind::Composite)
+{
+}
+
 void CompositeStatementAST::AddStatement(std::unique_ptr<IStatementAST> && stmt)
 {
 	m_statements.push_back(std::move(stmt));
@@ -349,6 +665,28 @@ void CompositeStatementAST::Accept(IStatementVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+CompositeStatementAST::~CompositeStatementAST()
+{
+	ReleaseChildren();
+}
+
+void CompositeStatementAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	for (auto& statement : m_statements)
+	{
+		garbage.Add(std::move(statement));
+	}
+	m_statements.clear();
+}
+
+void CompositeStatementAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	for (auto& statement : m_statements)
+	{
+		slots.statements.push_back(&statement);
+	}
+}
+
 // Function node
 FunctionAST::FunctionAST(
 	boost::optional<ExpressionType> returnType,
@@ -404,7 +742,8 @@ const FunctionAST& ProgramAST::GetFunction(size_t index)const
 }
 
 BuiltinCallStatementAST::BuiltinCallStatementAST(Builtin builtin)
-	: m_builtin(builtin)
+	: IStatementAST(StatementKind::BuiltinCall)
+	, m_builtin(builtin)
 {
 }
 
@@ -437,8 +776,31 @@ void BuiltinCallStatementAST::Accept(IStatementVisitor& visitor)const
 	visitor.Visit(*this);
 }
 
+BuiltinCallStatementAST::~BuiltinCallStatementAST()
+{
+	ReleaseChildren();
+}
+
+void BuiltinCallStatementAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	for (auto& param : m_params)
+	{
+		garbage.Add(std::move(param));
+	}
+	m_params.clear();
+}
+
+void BuiltinCallStatementAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	for (auto& param : m_params)
+	{
+		slots.expressions.push_back(&param);
+	}
+}
+
 FunctionCallStatementAST::FunctionCallStatementAST(std::unique_ptr<FunctionCallExpressionAST> && call)
-	: m_call(std::move(call))
+	: IStatementAST(StatementKind::FunctionCall)
+	, m_call(std::move(call))
 {
 }
 
@@ -457,6 +819,22 @@ void FunctionCallStatementAST::Accept(IStatementVisitor& visitor) const
 	visitor.Visit(*this);
 }
 
+FunctionCallStatementAST::~FunctionCallStatementAST()
+{
+	ReleaseChildren();
+}
+
+void FunctionCallStatementAST::DetachChildren(ASTNodeGarbage& garbage)
+{
+	garbage.Add(std::move(m_call));
+}
+
+void FunctionCallStatementAST::CollectChildSlots(ASTChildSlots& slots)
+{
+	// Call itself can't be replaced, only its params
+	ASTRewriter::CollectChildSlots(*m_call, slots);
+}
+
 std::string ToString(BinaryExpressionAST::Operator operation)
 {
 	switch (operation)
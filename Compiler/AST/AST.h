@@ -2,17 +2,69 @@
 #include "Visitor.h"
 #include "ExpressionType.h"
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 #include <boost/variant.hpp>
 
+// Kind tags allow to dispatch on the concrete node type without virtual calls
+enum class ExpressionKind : uint8_t
+{
+	Binary,
+	Literal,
+	Unary,
+	Identifier,
+	FunctionCall,
+	ArrayElementAccess
+};
+
+enum class StatementKind : uint8_t
+{
+	VariableDeclaration,
+	Assign,
+	ArrayElementAssign,
+	Return,
+	If,
+	While,
+	Composite,
+	BuiltinCall,
+	FunctionCall
+};
+
+class ASTNodeGarbage;
+struct ASTChildSlots;
+
 class IExpressionAST
 {
 public:
 	using Ptr = std::unique_ptr<IExpressionAST>;
 	virtual ~IExpressionAST() = default;
 	virtual void Accept(IExpressionVisitor& visitor)const = 0;
+
+	// Defined here, so dispatch on the kind is inlined into visitors
+	ExpressionKind GetKind()const
+	{
+		return m_kind;
+	}
+
+protected:
+	explicit IExpressionAST(ExpressionKind kind);
+
+	// Destructors of nodes with children must call it, so the subtree
+	//  is destroyed iteratively instead of recursion through destructors
+	void ReleaseChildren();
+
+private:
+	friend class ASTNodeGarbage;
+	virtual void DetachChildren(ASTNodeGarbage& garbage);
+
+	// Appends owning pointers of children, so passes can replace them in place
+	friend class ASTRewriter;
+	virtual void CollectChildSlots(ASTChildSlots& slots);
+
+private:
+	ExpressionKind m_kind;
 };
 
 class BinaryExpressionAST : public IExpressionAST
@@ -44,8 +96,13 @@ public:
 	const IExpressionAST& GetRight()const;
 	Operator GetOperator()const;
 
+	~BinaryExpressionAST();
 	void Accept(IExpressionVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<IExpressionAST> m_left;
 	std::unique_ptr<IExpressionAST> m_right;
@@ -65,8 +122,12 @@ public:
 
 	explicit LiteralConstantAST(const Value& value);
 	const Value& GetValue()const;
+	~LiteralConstantAST();
 	void Accept(IExpressionVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+
 private:
 	Value m_value;
 };
@@ -86,8 +147,13 @@ public:
 	const IExpressionAST& GetExpr()const;
 	Operator GetOperator()const;
 
+	~UnaryAST();
 	void Accept(IExpressionVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<IExpressionAST> m_expr;
 	Operator m_op;
@@ -117,8 +183,13 @@ public:
 	size_t GetParamsCount()const;
 	const IExpressionAST& GetParam(size_t index)const;
 
+	~FunctionCallExpressionAST();
 	void Accept(IExpressionVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::string m_name;
 	std::vector<std::unique_ptr<IExpressionAST>> m_params;
@@ -135,8 +206,13 @@ public:
 	const IExpressionAST& GetIndex(size_t index = 0)const;
 	void AddIndex(std::unique_ptr<IExpressionAST> && index);
 
+	~ArrayElementAccessAST();
 	void Accept(IExpressionVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::string m_name;
 	std::vector<std::unique_ptr<IExpressionAST>> m_indices;
@@ -148,6 +224,47 @@ public:
 	using Ptr = std::unique_ptr<IStatementAST>;
 	virtual ~IStatementAST() = default;
 	virtual void Accept(IStatementVisitor& visitor)const = 0;
+
+	// See IExpressionAST::GetKind
+	StatementKind GetKind()const
+	{
+		return m_kind;
+	}
+
+protected:
+	explicit IStatementAST(StatementKind kind);
+
+	// See IExpressionAST::ReleaseChildren
+	void ReleaseChildren();
+
+private:
+	friend class ASTNodeGarbage;
+	virtual void DetachChildren(ASTNodeGarbage& garbage);
+
+	// Appends owning pointers of children, so passes can replace them in place
+	friend class ASTRewriter;
+	virtual void CollectChildSlots(ASTChildSlots& slots);
+
+private:
+	StatementKind m_kind;
+};
+
+// Storage of detached subtrees: nodes are destroyed one by one, and children
+//  of each node are moved here before its destruction, so the depth of the tree
+//  doesn't affect the depth of the call stack
+class ASTNodeGarbage
+{
+public:
+	void Add(std::unique_ptr<IExpressionAST> && node);
+	void AddShared(std::shared_ptr<IExpressionAST> && node);
+	void Add(std::unique_ptr<IStatementAST> && node);
+
+	void Collect();
+
+private:
+	std::vector<std::unique_ptr<IExpressionAST>> m_expressions;
+	std::vector<std::shared_ptr<IExpressionAST>> m_sharedExpressions;
+	std::vector<std::unique_ptr<IStatementAST>> m_statements;
 };
 
 class VariableDeclarationAST : public IStatementAST
@@ -161,8 +278,13 @@ public:
 	const IdentifierAST& GetIdentifier()const;
 	ExpressionType GetType()const;
 
+	~VariableDeclarationAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<IdentifierAST> m_identifier;
 	ExpressionType m_type;
@@ -179,8 +301,13 @@ public:
 	const IdentifierAST& GetIdentifier()const;
 	const IExpressionAST& GetExpr()const;
 
+	~AssignStatementAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<IdentifierAST> m_identifier;
 	std::unique_ptr<IExpressionAST> m_expr;
@@ -199,8 +326,13 @@ public:
 	const IExpressionAST& GetIndex(size_t index = 0)const;
 	const IExpressionAST& GetExpression()const;
 
+	~ArrayElementAssignAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<ArrayElementAccessAST> m_access;
 	std::unique_ptr<IExpressionAST> m_expression;
@@ -212,8 +344,13 @@ public:
 	explicit ReturnStatementAST(std::unique_ptr<IExpressionAST> && expression);
 
 	const IExpressionAST* GetExpression()const;
+	~ReturnStatementAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<IExpressionAST> m_expression;
 };
@@ -231,8 +368,13 @@ public:
 	const IStatementAST& GetThenStmt()const;
 	const IStatementAST* GetElseStmt()const;
 
+	~IfStatementAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<IExpressionAST> m_expr;
 	std::unique_ptr<IStatementAST> m_then;
@@ -249,8 +391,13 @@ public:
 	const IExpressionAST& GetExpr()const;
 	const IStatementAST& GetStatement()const;
 
+	~WhileStatementAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<IExpressionAST> m_expr;
 	std::unique_ptr<IStatementAST> m_stmt;
@@ -259,12 +406,19 @@ private:
 class CompositeStatementAST : public IStatementAST
 {
 public:
+	CompositeStatementAST();
+
 	void AddStatement(std::unique_ptr<IStatementAST> && stmt);
 	const IStatementAST& GetStatement(size_t index)const;
 	size_t GetCount()const;
 
+	~CompositeStatementAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::vector<std::unique_ptr<IStatementAST>> m_statements;
 };
@@ -285,8 +439,13 @@ public:
 	const IExpressionAST& GetExpression(size_t index)const;
 	void AddExpression(std::unique_ptr<IExpressionAST> && expression);
 
+	~BuiltinCallStatementAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	Builtin m_builtin;
 	std::vector<std::unique_ptr<IExpressionAST>> m_params;
@@ -300,14 +459,21 @@ public:
 	const IExpressionAST& GetCall()const;
 	const FunctionCallExpressionAST& GetCallAsDerived()const;
 
+	~FunctionCallStatementAST();
 	void Accept(IStatementVisitor& visitor)const override;
 
+private:
+	void DetachChildren(ASTNodeGarbage& garbage) override;
+	void CollectChildSlots(ASTChildSlots& slots) override;
+
 private:
 	std::unique_ptr<FunctionCallExpressionAST> m_call;
 };
 
 class FunctionAST
 {
+	friend class ASTRewriter;
+
 public:
 	using Param = std::pair<std::string, ExpressionType>;
 
@@ -332,6 +498,8 @@ private:
 
 class ProgramAST
 {
+	friend class ASTRewriter;
+
 public:
 	void AddFunction(std::unique_ptr<FunctionAST> && function);
 
@@ -0,0 +1,22 @@
+#include "stdafx.h"
+#include "ASTRewriter.h"
+
+void ASTRewriter::CollectChildSlots(IExpressionAST& node, ASTChildSlots& slots)
+{
+	node.CollectChildSlots(slots);
+}
+
+void ASTRewriter::CollectChildSlots(IStatementAST& node, ASTChildSlots& slots)
+{
+	node.CollectChildSlots(slots);
+}
+
+FunctionAST& ASTRewriter::GetFunction(ProgramAST& program, size_t index)
+{
+	return *program.m_functions[index];
+}
+
+std::unique_ptr<IStatementAST>& ASTRewriter::GetStatementSlot(FunctionAST& function)
+{
+	return function.m_statement;
+}
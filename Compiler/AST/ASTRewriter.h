@@ -0,0 +1,23 @@
+#pragma once
+#include "AST.h"
+#include <vector>
+
+// Owning pointers of direct children in order of their evaluation (same as AppendChildren).
+// Pointers stay valid until the parent node is changed or destroyed.
+struct ASTChildSlots
+{
+	std::vector<std::unique_ptr<IExpressionAST>*> expressions;
+	std::vector<std::unique_ptr<IStatementAST>*> statements;
+};
+
+// Mutable access to the tree for passes, that transform it in place.
+// Elements of array literals are shared between nodes, so they are not exposed.
+class ASTRewriter
+{
+public:
+	static void CollectChildSlots(IExpressionAST& node, ASTChildSlots& slots);
+	static void CollectChildSlots(IStatementAST& node, ASTChildSlots& slots);
+
+	static FunctionAST& GetFunction(ProgramAST& program, size_t index);
+	static std::unique_ptr<IStatementAST>& GetStatementSlot(FunctionAST& function);
+};
@@ -0,0 +1,726 @@
+#include "stdafx.h"
+#include "ASTSerialization.h"
+#include "ASTTraversal.h"
+#include "StaticVisitor.h"
+#include <cstring>
+
+const uint32_t gcASTSerializationVersion = 2;
+
+namespace
+{
+const char gcMagic[4] = { 'C', 'A', 'S', 'T' };
+
+enum LiteralTag : uint8_t
+{
+	IntLiteral,
+	FloatLiteral,
+	BoolLiteral,
+	StringLiteral,
+	ArrayLiteral
+};
+
+// Every node is written as its kind and fields, including count of children and
+//  flags of optional children, so children can simply follow their parent
+class ASTWriter
+	: public ExpressionVisitor<ASTWriter, void>
+	, public StatementVisitor<ASTWriter, void>
+{
+	friend class ExpressionVisitor<ASTWriter, void>;
+	friend class StatementVisitor<ASTWriter, void>;
+
+public:
+	using ExpressionVisitor::Visit;
+	using StatementVisitor::Visit;
+
+	explicit ASTWriter(std::string& out)
+		: m_out(out)
+	{
+	}
+
+	void WriteHeader()
+	{
+		m_out.append(gcMagic, sizeof(gcMagic));
+		WriteVarint(gcASTSerializationVersion);
+	}
+
+	void WriteFunction(const FunctionAST& func)
+	{
+		WriteString(func.GetIdentifier().GetName());
+		WriteFlag(bool(func.GetReturnType()));
+		if (func.GetReturnType())
+		{
+			WriteType(*func.GetReturnType());
+		}
+		WriteVarint(func.GetParams().size());
+		for (const FunctionAST::Param& param : func.GetParams())
+		{
+			WriteString(param.first);
+			WriteType(param.second);
+		}
+
+		TraversePreOrder(MakeNodeRef(func.GetStatement()), [this](const ASTNodeRef& node) {
+			if (node.expression)
+			{
+				Visit(*node.expression);
+			}
+			else
+			{
+				Visit(*node.statement);
+			}
+		});
+	}
+
+	void WriteVarint(uint64_t value)
+	{
+		do
+		{
+			uint8_t byte = uint8_t(value & 0x7f);
+			value >>= 7;
+			if (value != 0)
+			{
+				byte |= 0x80;
+			}
+			WriteByte(byte);
+		} while (value != 0);
+	}
+
+private:
+	void WriteByte(uint8_t byte)
+	{
+		m_out.push_back(char(byte));
+	}
+
+	void WriteFlag(bool flag)
+	{
+		WriteByte(flag ? 1 : 0);
+	}
+
+	void WriteSignedVarint(int64_t value)
+	{
+		// Zigzag encoding keeps small negative numbers short
+		WriteVarint((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+	}
+
+	void WriteString(const std::string& str)
+	{
+		WriteVarint(str.size());
+		m_out.append(str);
+	}
+
+	void WriteType(const ExpressionType& type)
+	{
+		WriteByte(uint8_t(type.value));
+		WriteVarint(type.nesting);
+	}
+
+	void Visit(const BinaryExpressionAST& node)
+	{
+		WriteByte(uint8_t(ExpressionKind::Binary));
+		WriteByte(uint8_t(node.GetOperator()));
+	}
+
+	void Visit(const LiteralConstantAST& node)
+	{
+		WriteByte(uint8_t(ExpressionKind::Literal));
+
+		const LiteralConstantAST::Value& value = node.GetValue();
+		if (value.type() == typeid(int))
+		{
+			WriteByte(IntLiteral);
+			WriteSignedVarint(boost::get<int>(value));
+		}
+		else if (value.type() == typeid(double))
+		{
+			const double number = boost::get<double>(value);
+			char bytes[sizeof(double)];
+			std::memcpy(bytes, &number, sizeof(double));
+			WriteByte(FloatLiteral);
+			m_out.append(bytes, sizeof(double));
+		}
+		else if (value.type() == typeid(bool))
+		{
+			WriteByte(BoolLiteral);
+			WriteFlag(boost::get<bool>(value));
+		}
+		else if (value.type() == typeid(std::string))
+		{
+			WriteByte(StringLiteral);
+			WriteString(boost::get<std::string>(value));
+		}
+		else if (value.type() == typeid(std::vector<std::shared_ptr<IExpressionAST>>))
+		{
+			WriteByte(ArrayLiteral);
+			WriteVarint(boost::get<std::vector<std::shared_ptr<IExpressionAST>>>(value).size());
+		}
+		else
+		{
+			assert(false);
+			throw std::logic_error("can't serialize literal constant of undefined type");
+		}
+	}
+
+	void Visit(const UnaryAST& node)
+	{
+		WriteByte(uint8_t(ExpressionKind::Unary));
+		WriteByte(uint8_t(node.GetOperator()));
+	}
+
+	void Visit(const IdentifierAST& node)
+	{
+		WriteByte(uint8_t(ExpressionKind::Identifier));
+		WriteString(node.GetName());
+	}
+
+	void Visit(const FunctionCallExpressionAST& node)
+	{
+		WriteByte(uint8_t(ExpressionKind::FunctionCall));
+		WriteString(node.GetName());
+		WriteVarint(node.GetParamsCount());
+	}
+
+	void Visit(const ArrayElementAccessAST& node)
+	{
+		WriteByte(uint8_t(ExpressionKind::ArrayElementAccess));
+		WriteString(node.GetName());
+		WriteVarint(node.GetIndexCount());
+	}
+
+	void Visit(const VariableDeclarationAST& node)
+	{
+		WriteByte(uint8_t(StatementKind::VariableDeclaration));
+		WriteString(node.GetIdentifier().GetName());
+		WriteType(node.GetType());
+		WriteFlag(node.GetExpression() != nullptr);
+	}
+
+	void Visit(const AssignStatementAST& node)
+	{
+		WriteByte(uint8_t(StatementKind::Assign));
+		WriteString(node.GetIdentifier().GetName());
+	}
+
+	void Visit(const ArrayElementAssignAST& node)
+	{
+		WriteByte(uint8_t(StatementKind::ArrayElementAssign));
+		WriteString(node.GetName());
+		WriteVarint(node.GetIndexCount());
+	}
+
+	void Visit(const ReturnStatementAST& node)
+	{
+		WriteByte(uint8_t(StatementKind::Return));
+		WriteFlag(node.GetExpression() != nullptr);
+	}
+
+	void Visit(const IfStatementAST& node)
+	{
+		WriteByte(uint8_t(StatementKind::If));
+		WriteFlag(node.GetElseStmt() != nullptr);
+	}
+
+	void Visit(const WhileStatementAST&)
+	{
+		WriteByte(uint8_t(StatementKind::While));
+	}
+
+	void Visit(const CompositeStatementAST& node)
+	{
+		WriteByte(uint8_t(StatementKind::Composite));
+		WriteVarint(node.GetCount());
+	}
+
+	void Visit(const BuiltinCallStatementAST& node)
+	{
+		WriteByte(uint8_t(StatementKind::BuiltinCall));
+		WriteByte(uint8_t(node.GetBuiltin()));
+		WriteVarint(node.GetParamsCount());
+	}
+
+	void Visit(const FunctionCallStatementAST&)
+	{
+		// Call expression follows as the only child
+		WriteByte(uint8_t(StatementKind::FunctionCall));
+	}
+
+private:
+	std::string& m_out;
+};
+
+// Node, whose fields are already read, but children are not
+struct PendingNode
+{
+	bool isStatement = false;
+	uint8_t kind = 0;
+	uint8_t op = 0;
+	bool flag = false;
+	std::string name;
+	ExpressionType type = { ExpressionType::Int, 0 };
+	LiteralConstantAST::Value value;
+
+	size_t expressionsLeft = 0;
+	size_t statementsLeft = 0;
+	std::vector<std::unique_ptr<IExpressionAST>> expressions;
+	std::vector<std::unique_ptr<IStatementAST>> statements;
+};
+
+// Reads nodes in the order they were written, using explicit stack of pending nodes:
+//  node is built when all of its children are read
+class ASTReader
+{
+public:
+	ASTReader(const char* data, size_t size)
+		: m_data(data)
+		, m_size(size)
+		, m_pos(0)
+	{
+	}
+
+	void ReadHeader()
+	{
+		if (m_size < sizeof(gcMagic) || std::memcmp(m_data, gcMagic, sizeof(gcMagic)) != 0)
+		{
+			throw std::runtime_error("serialized ast has invalid signature");
+		}
+		m_pos = sizeof(gcMagic);
+		if (ReadVarint() != gcASTSerializationVersion)
+		{
+			throw std::runtime_error("serialized ast has unsupported format version");
+		}
+	}
+
+	bool AtEnd()const
+	{
+		return m_pos == m_size;
+	}
+
+	uint64_t ReadVarint()
+	{
+		uint64_t value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7)
+		{
+			const uint8_t byte = ReadByte();
+			value |= uint64_t(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return value;
+			}
+		}
+		throw std::runtime_error("serialized ast contains too long varint");
+	}
+
+	std::unique_ptr<FunctionAST> ReadFunction()
+	{
+		auto identifier = std::make_unique<IdentifierAST>(ReadString());
+
+		boost::optional<ExpressionType> returnType;
+		if (ReadFlag())
+		{
+			returnType = ReadType();
+		}
+
+		std::vector<FunctionAST::Param> params(ReadCount());
+		for (FunctionAST::Param& param : params)
+		{
+			param.first = ReadString();
+			param.second = ReadType();
+		}
+
+		auto statement = ReadStatementTree();
+		return std::make_unique<FunctionAST>(returnType, std::move(identifier), std::move(params), std::move(statement));
+	}
+
+private:
+	uint8_t ReadByte()
+	{
+		if (m_pos >= m_size)
+		{
+			throw std::runtime_error("serialized ast is truncated");
+		}
+		return uint8_t(m_data[m_pos++]);
+	}
+
+	bool ReadFlag()
+	{
+		const uint8_t flag = ReadByte();
+		if (flag > 1)
+		{
+			throw std::runtime_error("serialized ast contains invalid flag");
+		}
+		return flag == 1;
+	}
+
+	// Count of following records, each of them takes at least one byte
+	size_t ReadCount()
+	{
+		const uint64_t count = ReadVarint();
+		if (count > m_size - m_pos)
+		{
+			throw std::runtime_error("serialized ast contains invalid count");
+		}
+		return size_t(count);
+	}
+
+	int64_t ReadSignedVarint()
+	{
+		const uint64_t value = ReadVarint();
+		return int64_t(value >> 1) ^ -int64_t(value & 1);
+	}
+
+	std::string ReadString()
+	{
+		const size_t length = ReadCount();
+		std::string str(m_data + m_pos, length);
+		m_pos += length;
+		return str;
+	}
+
+	ExpressionType ReadType()
+	{
+		const uint8_t value = ReadByte();
+		if (value > ExpressionType::String)
+		{
+			throw std::runtime_error("serialized ast contains invalid type");
+		}
+		return { ExpressionType::Value(value), unsigned(ReadVarint()) };
+	}
+
+	template <typename Enum>
+	Enum ReadEnum(Enum last)
+	{
+		const uint8_t value = ReadByte();
+		if (value > uint8_t(last))
+		{
+			throw std::runtime_error("serialized ast contains invalid enumeration value");
+		}
+		return Enum(value);
+	}
+
+	std::unique_ptr<IStatementAST> ReadStatementTree()
+	{
+		std::vector<PendingNode> stack;
+		std::unique_ptr<IExpressionAST> expression;
+		std::unique_ptr<IStatementAST> statement;
+
+		stack.push_back(ReadStatementFields());
+		while (!stack.empty())
+		{
+			PendingNode& node = stack.back();
+
+			// Attach child, that was completed on the previous iteration
+			if (expression)
+			{
+				node.expressions.push_back(std::move(expression));
+			}
+			if (statement)
+			{
+				node.statements.push_back(std::move(statement));
+			}
+
+			if (node.expressionsLeft != 0)
+			{
+				--node.expressionsLeft;
+				stack.push_back(ReadExpressionFields());
+			}
+			else if (node.statementsLeft != 0)
+			{
+				--node.statementsLeft;
+				stack.push_back(ReadStatementFields());
+			}
+			else
+			{
+				if (node.isStatement)
+				{
+					statement = BuildStatement(node);
+				}
+				else
+				{
+					expression = BuildExpression(node);
+				}
+				stack.pop_back();
+			}
+		}
+
+		assert(statement);
+		return statement;
+	}
+
+	PendingNode ReadExpressionFields()
+	{
+		PendingNode node;
+		const ExpressionKind kind = ReadEnum(ExpressionKind::ArrayElementAccess);
+		node.kind = uint8_t(kind);
+
+		switch (kind)
+		{
+		case ExpressionKind::Binary:
+			node.op = uint8_t(ReadEnum(BinaryExpressionAST::Mod));
+			node.expressionsLeft = 2;
+			break;
+		case ExpressionKind::Literal:
+			ReadLiteralFields(node);
+			break;
+		case ExpressionKind::Unary:
+			node.op = uint8_t(ReadEnum(UnaryAST::Negation));
+			node.expressionsLeft = 1;
+			break;
+		case ExpressionKind::Identifier:
+			node.name = ReadString();
+			break;
+		case ExpressionKind::FunctionCall:
+			node.name = ReadString();
+			node.expressionsLeft = ReadCount();
+			break;
+		case ExpressionKind::ArrayElementAccess:
+			node.name = ReadString();
+			node.expressionsLeft = ReadCount();
+			if (node.expressionsLeft == 0)
+			{
+				throw std::runtime_error("serialized ast contains array element access without indices");
+			}
+			break;
+		}
+		node.expressions.reserve(node.expressionsLeft);
+		return node;
+	}
+
+	void ReadLiteralFields(PendingNode& node)
+	{
+		node.op = uint8_t(ReadEnum(ArrayLiteral));
+		switch (LiteralTag(node.op))
+		{
+		case IntLiteral:
+			node.value = int(ReadSignedVarint());
+			break;
+		case FloatLiteral:
+		{
+			if (m_size - m_pos < sizeof(double))
+			{
+				throw std::runtime_error("serialized ast is truncated");
+			}
+			double number = 0;
+			std::memcpy(&number, m_data + m_pos, sizeof(double));
+			m_pos += sizeof(double);
+			node.value = number;
+			break;
+		}
+		case BoolLiteral:
+			node.value = ReadFlag();
+			break;
+		case StringLiteral:
+			node.value = ReadString();
+			break;
+		case ArrayLiteral:
+			node.expressionsLeft = ReadCount();
+			break;
+		}
+	}
+
+	PendingNode ReadStatementFields()
+	{
+		PendingNode node;
+		const StatementKind kind = ReadEnum(StatementKind::FunctionCall);
+		node.isStatement = true;
+		node.kind = uint8_t(kind);
+
+		switch (kind)
+		{
+		case StatementKind::VariableDeclaration:
+			node.name = ReadString();
+			node.type = ReadType();
+			node.flag = ReadFlag();
+			node.expressionsLeft = node.flag ? 1 : 0;
+			break;
+		case StatementKind::Assign:
+			node.name = ReadString();
+			node.expressionsLeft = 1;
+			break;
+		case StatementKind::ArrayElementAssign:
+			node.name = ReadString();
+			node.expressionsLeft = ReadCount();
+			if (node.expressionsLeft == 0)
+			{
+				throw std::runtime_error("serialized ast contains array element assignment without indices");
+			}
+			// Assigned expression follows the indices
+			++node.expressionsLeft;
+			break;
+		case StatementKind::Return:
+			node.flag = ReadFlag();
+			node.expressionsLeft = node.flag ? 1 : 0;
+			break;
+		case StatementKind::If:
+			node.flag = ReadFlag();
+			node.expressionsLeft = 1;
+			node.statementsLeft = node.flag ? 2 : 1;
+			break;
+		case StatementKind::While:
+			node.expressionsLeft = 1;
+			node.statementsLeft = 1;
+			break;
+		case StatementKind::Composite:
+			node.statementsLeft = ReadCount();
+			break;
+		case StatementKind::BuiltinCall:
+			node.op = uint8_t(ReadEnum(BuiltinCallStatementAST::Scan));
+			node.expressionsLeft = ReadCount();
+			break;
+		case StatementKind::FunctionCall:
+			node.expressionsLeft = 1;
+			break;
+		}
+		node.expressions.reserve(node.expressionsLeft);
+		node.statements.reserve(node.statementsLeft);
+		return node;
+	}
+
+	std::unique_ptr<IExpressionAST> BuildExpression(PendingNode& node)
+	{
+		auto& children = node.expressions;
+		switch (ExpressionKind(node.kind))
+		{
+		case ExpressionKind::Binary:
+			return std::make_unique<BinaryExpressionAST>(
+				std::move(children[0]), std::move(children[1]), BinaryExpressionAST::Operator(node.op));
+		case ExpressionKind::Literal:
+			if (node.op == ArrayLiteral)
+			{
+				std::vector<std::shared_ptr<IExpressionAST>> elements;
+				elements.reserve(children.size());
+				for (auto& child : children)
+				{
+					elements.push_back(std::move(child));
+				}
+				return std::make_unique<LiteralConstantAST>(std::move(elements));
+			}
+			return std::make_unique<LiteralConstantAST>(node.value);
+		case ExpressionKind::Unary:
+			return std::make_unique<UnaryAST>(std::move(children[0]), UnaryAST::Operator(node.op));
+		case ExpressionKind::Identifier:
+			return std::make_unique<IdentifierAST>(node.name);
+		case ExpressionKind::FunctionCall:
+			return std::make_unique<FunctionCallExpressionAST>(node.name, std::move(children));
+		case ExpressionKind::ArrayElementAccess:
+			return BuildArrayElementAccess(node.name, children, children.size());
+		}
+		throw std::logic_error("can't deserialize expression of undefined kind");
+	}
+
+	std::unique_ptr<ArrayElementAccessAST> BuildArrayElementAccess(
+		const std::string& name, std::vector<std::unique_ptr<IExpressionAST>>& indices, size_t count)
+	{
+		auto access = std::make_unique<ArrayElementAccessAST>(name, std::move(indices[0]));
+		for (size_t i = 1; i < count; ++i)
+		{
+			access->AddIndex(std::move(indices[i]));
+		}
+		return access;
+	}
+
+	std::unique_ptr<IStatementAST> BuildStatement(PendingNode& node)
+	{
+		auto& expressions = node.expressions;
+		auto& statements = node.statements;
+
+		switch (StatementKind(node.kind))
+		{
+		case StatementKind::VariableDeclaration:
+		{
+			auto declaration = std::make_unique<VariableDeclarationAST>(std::make_unique<IdentifierAST>(node.name), node.type);
+			if (node.flag)
+			{
+				declaration->SetExpression(std::move(expressions[0]));
+			}
+			return declaration;
+		}
+		case StatementKind::Assign:
+			return std::make_unique<AssignStatementAST>(std::make_unique<IdentifierAST>(node.name), std::move(expressions[0]));
+		case StatementKind::ArrayElementAssign:
+		{
+			auto access = BuildArrayElementAccess(node.name, expressions, expressions.size() - 1);
+			return std::make_unique<ArrayElementAssignAST>(std::move(access), std::move(expressions.back()));
+		}
+		case StatementKind::Return:
+			return std::make_unique<ReturnStatementAST>(node.flag ? std::move(expressions[0]) : nullptr);
+		case StatementKind::If:
+			return std::make_unique<IfStatementAST>(std::move(expressions[0]),
+				std::move(statements[0]), node.flag ? std::move(statements[1]) : nullptr);
+		case StatementKind::While:
+			return std::make_unique<WhileStatementAST>(std::move(expressions[0]), std::move(statements[0]));
+		case StatementKind::Composite:
+		{
+			auto composite = std::make_unique<CompositeStatementAST>();
+			for (auto& statement : statements)
+			{
+				composite->AddStatement(std::move(statement));
+			}
+			return composite;
+		}
+		case StatementKind::BuiltinCall:
+		{
+			auto builtin = std::make_unique<BuiltinCallStatementAST>(BuiltinCallStatementAST::Builtin(node.op));
+			for (auto& expression : expressions)
+			{
+				builtin->AddExpression(std::move(expression));
+			}
+			return builtin;
+		}
+		case StatementKind::FunctionCall:
+		{
+			if (expressions[0]->GetKind() != ExpressionKind::FunctionCall)
+			{
+				throw std::runtime_error("serialized ast contains function call statement without call expression");
+			}
+			std::unique_ptr<FunctionCallExpressionAST> call(
+				static_cast<FunctionCallExpressionAST*>(expressions[0].release()));
+			return std::make_unique<FunctionCallStatementAST>(std::move(call));
+		}
+		}
+		throw std::logic_error("can't deserialize statement of undefined kind");
+	}
+
+private:
+	const char* m_data;
+	size_t m_size;
+	size_t m_pos;
+};
+}
+
+std::string SerializeProgram(const ProgramAST& program)
+{
+	std::string out;
+	ASTWriter writer(out);
+	writer.WriteHeader();
+	writer.WriteVarint(program.GetFunctionsCount());
+	for (size_t i = 0; i < program.GetFunctionsCount(); ++i)
+	{
+		writer.WriteFunction(program.GetFunction(i));
+	}
+	return out;
+}
+
+std::string SerializeFunction(const FunctionAST& func)
+{
+	std::string out;
+	ASTWriter writer(out);
+	writer.WriteFunction(func);
+	return out;
+}
+
+std::unique_ptr<ProgramAST> DeserializeProgram(const char* data, size_t size)
+{
+	ASTReader reader(data, size);
+	reader.ReadHeader();
+
+	auto program = std::make_unique<ProgramAST>();
+	const uint64_t count = reader.ReadVarint();
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		program->AddFunction(reader.ReadFunction());
+	}
+
+	if (!reader.AtEnd())
+	{
+		throw std::runtime_error("serialized ast has trailing data");
+	}
+	return program;
+}
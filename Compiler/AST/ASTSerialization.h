@@ -0,0 +1,17 @@
+#pragma once
+#include "AST.h"
+#include <cstdint>
+#include <string>
+
+// Compact binary form of ProgramAST: nodes are written in pre-order as a kind byte
+//  followed by their fields, integers are encoded as LEB128 varints.
+// Format version must be increased on every change of the encoding.
+extern const uint32_t gcASTSerializationVersion;
+
+std::string SerializeProgram(const ProgramAST& program);
+// Structure of a single function without header, e.g. to compare or hash functions
+std::string SerializeFunction(const FunctionAST& func);
+
+// Reads program from memory (possibly memory-mapped file);
+//  throws std::runtime_error if data is truncated or malformed
+std::unique_ptr<ProgramAST> DeserializeProgram(const char* data, size_t size);
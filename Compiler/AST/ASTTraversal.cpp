@@ -0,0 +1,175 @@
+#include "stdafx.h"
+#include "ASTTraversal.h"
+#include "StaticVisitor.h"
+
+namespace
+{
+class ChildrenCollector
+	: public ExpressionVisitor<ChildrenCollector, void>
+	, public StatementVisitor<ChildrenCollector, void>
+{
+	friend class ExpressionVisitor<ChildrenCollector, void>;
+	friend class StatementVisitor<ChildrenCollector, void>;
+
+public:
+	using ExpressionVisitor::Visit;
+	using StatementVisitor::Visit;
+
+	explicit ChildrenCollector(std::vector<ASTNodeRef>& children)
+		: m_children(children)
+	{
+	}
+
+private:
+	void Add(const IExpressionAST& node)
+	{
+		m_children.push_back(MakeNodeRef(node));
+	}
+
+	void Add(const IStatementAST& node)
+	{
+		m_children.push_back(MakeNodeRef(node));
+	}
+
+	void Visit(const BinaryExpressionAST& node)
+	{
+		Add(node.GetLeft());
+		Add(node.GetRight());
+	}
+
+	void Visit(const LiteralConstantAST& node)
+	{
+		using Elements = std::vector<std::shared_ptr<IExpressionAST>>;
+		if (const Elements* elements = boost::get<Elements>(&node.GetValue()))
+		{
+			for (const auto& element : *elements)
+			{
+				Add(*element);
+			}
+		}
+	}
+
+	void Visit(const UnaryAST& node)
+	{
+		Add(node.GetExpr());
+	}
+
+	void Visit(const IdentifierAST&)
+	{
+	}
+
+	void Visit(const FunctionCallExpressionAST& node)
+	{
+		for (size_t i = 0; i < node.GetParamsCount(); ++i)
+		{
+			Add(node.GetParam(i));
+		}
+	}
+
+	void Visit(const ArrayElementAccessAST& node)
+	{
+		for (size_t i = 0; i < node.GetIndexCount(); ++i)
+		{
+			Add(node.GetIndex(i));
+		}
+	}
+
+	void Visit(const VariableDeclarationAST& node)
+	{
+		if (node.GetExpression())
+		{
+			Add(*node.GetExpression());
+		}
+	}
+
+	void Visit(const AssignStatementAST& node)
+	{
+		Add(node.GetExpr());
+	}
+
+	void Visit(const ArrayElementAssignAST& node)
+	{
+		for (size_t i = 0; i < node.GetIndexCount(); ++i)
+		{
+			Add(node.GetIndex(i));
+		}
+		Add(node.GetExpression());
+	}
+
+	void Visit(const ReturnStatementAST& node)
+	{
+		if (node.GetExpression())
+		{
+			Add(*node.GetExpression());
+		}
+	}
+
+	void Visit(const IfStatementAST& node)
+	{
+		Add(node.GetExpr());
+		Add(node.GetThenStmt());
+		if (node.GetElseStmt())
+		{
+			Add(*node.GetElseStmt());
+		}
+	}
+
+	void Visit(const WhileStatementAST& node)
+	{
+		Add(node.GetExpr());
+		Add(node.GetStatement());
+	}
+
+	void Visit(const CompositeStatementAST& node)
+	{
+		for (size_t i = 0; i < node.GetCount(); ++i)
+		{
+			Add(node.GetStatement(i));
+		}
+	}
+
+	void Visit(const BuiltinCallStatementAST& node)
+	{
+		for (size_t i = 0; i < node.GetParamsCount(); ++i)
+		{
+			Add(node.GetExpression(i));
+		}
+	}
+
+	void Visit(const FunctionCallStatementAST& node)
+	{
+		Add(node.GetCall());
+	}
+
+private:
+	std::vector<ASTNodeRef>& m_children;
+};
+}
+
+ASTNodeRef MakeNodeRef(const IExpressionAST& node)
+{
+	ASTNodeRef ref;
+	ref.expression = &node;
+	return ref;
+}
+
+ASTNodeRef MakeNodeRef(const IStatementAST& node)
+{
+	ASTNodeRef ref;
+	ref.statement = &node;
+	return ref;
+}
+
+void AppendChildren(const ASTNodeRef& node, std::vector<ASTNodeRef>& children)
+{
+	ChildrenCollector collector(children);
+	if (node.expression)
+	{
+		collector.Visit(*node.expression);
+	}
+	else
+	{
+		assert(node.statement);
+		collector.Visit(*node.statement);
+	}
+}
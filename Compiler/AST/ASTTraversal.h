@@ -0,0 +1,80 @@
+#pragma once
+#include "AST.h"
+#include <vector>
+
+// Reference to an expression or a statement node, exactly one of pointers is not null
+struct ASTNodeRef
+{
+	const IExpressionAST* expression = nullptr;
+	const IStatementAST* statement = nullptr;
+};
+
+ASTNodeRef MakeNodeRef(const IExpressionAST& node);
+ASTNodeRef MakeNodeRef(const IStatementAST& node);
+
+// Appends direct children of the node in order of their evaluation.
+// Names of variables and functions are not considered as children.
+void AppendChildren(const ASTNodeRef& node, std::vector<ASTNodeRef>& children);
+
+// All traversals keep pending nodes in an explicit stack on the heap,
+//  so very deep trees don't overflow the call stack.
+// Parent is passed to the callback before its children
+template <typename Callback>
+void TraversePreOrder(const ASTNodeRef& root, Callback&& callback)
+{
+	std::vector<ASTNodeRef> stack = { root };
+	std::vector<ASTNodeRef> children;
+
+	while (!stack.empty())
+	{
+		const ASTNodeRef node = stack.back();
+		stack.pop_back();
+		callback(node);
+
+		children.clear();
+		AppendChildren(node, children);
+		stack.insert(stack.end(), children.rbegin(), children.rend());
+	}
+}
+
+// Enter is called before children of the node and leave after all of them
+template <typename Enter, typename Leave>
+void TraverseDepthFirst(const ASTNodeRef& root, Enter&& enter, Leave&& leave)
+{
+	struct Item
+	{
+		ASTNodeRef node;
+		bool expanded;
+	};
+
+	std::vector<Item> stack = { { root, false } };
+	std::vector<ASTNodeRef> children;
+
+	while (!stack.empty())
+	{
+		if (stack.back().expanded)
+		{
+			const ASTNodeRef node = stack.back().node;
+			stack.pop_back();
+			leave(node);
+			continue;
+		}
+
+		stack.back().expanded = true;
+		enter(stack.back().node);
+
+		children.clear();
+		AppendChildren(stack.back().node, children);
+		for (auto it = children.rbegin(); it != children.rend(); ++it)
+		{
+			stack.push_back({ *it, false });
+		}
+	}
+}
+
+// Parent is passed to the callback after all of its children
+template <typename Callback>
+void TraversePostOrder(const ASTNodeRef& root, Callback&& callback)
+{
+	TraverseDepthFirst(root, [](const ASTNodeRef&) {}, callback);
+}
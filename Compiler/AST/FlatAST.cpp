@@ -0,0 +1,408 @@
+#include "stdafx.h"
+#include "FlatAST.h"
+#include "ASTTraversal.h"
+#include "StaticVisitor.h"
+
+constexpr FlatAST::Index FlatAST::npos;
+
+namespace
+{
+template <typename T>
+FlatAST::Index Append(std::vector<T>& container, const T& value)
+{
+	if (container.size() >= size_t(FlatAST::npos))
+	{
+		throw std::length_error("flat ast can't store more than 2^32 - 1 records of the same kind");
+	}
+	container.push_back(value);
+	return FlatAST::Index(container.size() - 1);
+}
+
+template <typename T>
+const T& At(const std::vector<T>& container, FlatAST::Index index)
+{
+	if (index >= container.size())
+	{
+		throw std::out_of_range("flat ast index is out of range");
+	}
+	return container[index];
+}
+
+FlatAST::Expression MakeExpression(
+	FlatAST::ExpressionKind kind,
+	uint8_t op,
+	FlatAST::Index first,
+	FlatAST::Index second = FlatAST::npos,
+	FlatAST::Index third = 0)
+{
+	return { kind, op, 0, first, second, third };
+}
+
+FlatAST::Statement MakeStatement(
+	FlatAST::StatementKind kind,
+	FlatAST::Index first,
+	FlatAST::Index second = FlatAST::npos,
+	FlatAST::Index third = 0)
+{
+	return { kind, 0, 0, first, second, third };
+}
+
+// Builds flat representation by walking the pointer-linked tree in post-order;
+//  children are always appended before their parent, their indices are kept
+//  in the stack until the parent is visited
+class FlatASTBuilder
+	: public ExpressionVisitor<FlatASTBuilder, void>
+	, public StatementVisitor<FlatASTBuilder, void>
+{
+	friend class ExpressionVisitor<FlatASTBuilder, void>;
+	friend class StatementVisitor<FlatASTBuilder, void>;
+
+public:
+	using ExpressionVisitor::Visit;
+	using StatementVisitor::Visit;
+
+	explicit FlatASTBuilder(FlatAST& ast)
+		: m_ast(ast)
+	{
+	}
+
+	void AddFunction(const FunctionAST& func)
+	{
+		FlatAST::Function function;
+		function.name = m_ast.AddName(func.GetIdentifier().GetName());
+		function.expressionsBegin = FlatAST::Index(m_ast.GetExpressionsCount());
+		function.body = Add(func.GetStatement());
+		function.expressionsCount = FlatAST::Index(m_ast.GetExpressionsCount()) - function.expressionsBegin;
+		function.paramsBegin = FlatAST::Index(0);
+		function.paramsCount = FlatAST::Index(func.GetParams().size());
+		function.returnType = func.GetReturnType();
+
+		for (size_t i = 0; i < func.GetParams().size(); ++i)
+		{
+			const FunctionAST::Param& param = func.GetParams()[i];
+			const FlatAST::Index index = m_ast.AddParam({ m_ast.AddName(param.first), param.second });
+			if (i == 0)
+			{
+				function.paramsBegin = index;
+			}
+		}
+		m_ast.AddFunction(function);
+	}
+
+private:
+	FlatAST::Index Add(const IStatementAST& root)
+	{
+		TraversePostOrder(MakeNodeRef(root), [this](const ASTNodeRef& node) {
+			if (node.expression)
+			{
+				Visit(*node.expression);
+			}
+			else
+			{
+				Visit(*node.statement);
+			}
+		});
+		assert(m_results.size() == 1);
+		return Pop();
+	}
+
+	FlatAST::Index Pop()
+	{
+		assert(!m_results.empty());
+		const FlatAST::Index index = m_results.back();
+		m_results.pop_back();
+		return index;
+	}
+
+	// Pops indices of the last 'count' visited children preserving their order
+	std::vector<FlatAST::Index> PopList(size_t count)
+	{
+		assert(m_results.size() >= count);
+		std::vector<FlatAST::Index> list(m_results.end() - count, m_results.end());
+		m_results.resize(m_results.size() - count);
+		return list;
+	}
+
+	void Visit(const BinaryExpressionAST& node)
+	{
+		const FlatAST::Index right = Pop();
+		const FlatAST::Index left = Pop();
+		m_results.push_back(m_ast.AddExpression(MakeExpression(
+			FlatAST::ExpressionKind::Binary, uint8_t(node.GetOperator()), left, right)));
+	}
+
+	void Visit(const LiteralConstantAST& node)
+	{
+		const LiteralConstantAST::Value& value = node.GetValue();
+		if (value.type() == typeid(int))
+		{
+			m_results.push_back(m_ast.AddExpression(MakeExpression(FlatAST::ExpressionKind::Literal,
+				uint8_t(FlatAST::LiteralKind::Int), m_ast.AddInt(boost::get<int>(value)))));
+		}
+		else if (value.type() == typeid(double))
+		{
+			m_results.push_back(m_ast.AddExpression(MakeExpression(FlatAST::ExpressionKind::Literal,
+				uint8_t(FlatAST::LiteralKind::Float), m_ast.AddFloat(boost::get<double>(value)))));
+		}
+		else if (value.type() == typeid(bool))
+		{
+			m_results.push_back(m_ast.AddExpression(MakeExpression(FlatAST::ExpressionKind::Literal,
+				uint8_t(FlatAST::LiteralKind::Bool), FlatAST::Index(boost::get<bool>(value)))));
+		}
+		else if (value.type() == typeid(std::string))
+		{
+			m_results.push_back(m_ast.AddExpression(MakeExpression(FlatAST::ExpressionKind::Literal,
+				uint8_t(FlatAST::LiteralKind::String), m_ast.AddString(boost::get<std::string>(value)))));
+		}
+		else if (value.type() == typeid(std::vector<std::shared_ptr<IExpressionAST>>))
+		{
+			const auto& elements = boost::get<std::vector<std::shared_ptr<IExpressionAST>>>(value);
+			const std::vector<FlatAST::Index> indices = PopList(elements.size());
+			m_results.push_back(m_ast.AddExpression(MakeExpression(FlatAST::ExpressionKind::Literal,
+				uint8_t(FlatAST::LiteralKind::Array), FlatAST::npos, m_ast.AddList(indices), FlatAST::Index(indices.size()))));
+		}
+		else
+		{
+			assert(false);
+			throw std::logic_error("can't flatten literal constant of undefined type");
+		}
+	}
+
+	void Visit(const UnaryAST& node)
+	{
+		const FlatAST::Index operand = Pop();
+		m_results.push_back(m_ast.AddExpression(MakeExpression(
+			FlatAST::ExpressionKind::Unary, uint8_t(node.GetOperator()), operand)));
+	}
+
+	void Visit(const IdentifierAST& node)
+	{
+		m_results.push_back(m_ast.AddExpression(MakeExpression(
+			FlatAST::ExpressionKind::Identifier, 0, m_ast.AddName(node.GetName()))));
+	}
+
+	void Visit(const FunctionCallExpressionAST& node)
+	{
+		const std::vector<FlatAST::Index> params = PopList(node.GetParamsCount());
+		m_results.push_back(m_ast.AddExpression(MakeExpression(FlatAST::ExpressionKind::FunctionCall, 0,
+			m_ast.AddName(node.GetName()), m_ast.AddList(params), FlatAST::Index(params.size()))));
+	}
+
+	void Visit(const ArrayElementAccessAST& node)
+	{
+		const std::vector<FlatAST::Index> indices = PopList(node.GetIndexCount());
+		m_results.push_back(m_ast.AddExpression(MakeExpression(FlatAST::ExpressionKind::ArrayElementAccess, 0,
+			m_ast.AddName(node.GetName()), m_ast.AddList(indices), FlatAST::Index(indices.size()))));
+	}
+
+	void Visit(const VariableDeclarationAST& node)
+	{
+		const FlatAST::Index expression = node.GetExpression() ? Pop() : FlatAST::npos;
+		FlatAST::Statement statement = MakeStatement(FlatAST::StatementKind::VariableDeclaration,
+			m_ast.AddName(node.GetIdentifier().GetName()), expression);
+		statement.op = uint8_t(node.GetType().value);
+		statement.nesting = uint16_t(node.GetType().nesting);
+		m_results.push_back(m_ast.AddStatement(statement));
+	}
+
+	void Visit(const AssignStatementAST& node)
+	{
+		const FlatAST::Index expression = Pop();
+		m_results.push_back(m_ast.AddStatement(MakeStatement(FlatAST::StatementKind::Assign,
+			m_ast.AddName(node.GetIdentifier().GetName()), expression)));
+	}
+
+	void Visit(const ArrayElementAssignAST& node)
+	{
+		// Indices followed by the assigned expression
+		const std::vector<FlatAST::Index> children = PopList(node.GetIndexCount() + 1);
+		m_results.push_back(m_ast.AddStatement(MakeStatement(FlatAST::StatementKind::ArrayElementAssign,
+			m_ast.AddName(node.GetName()), m_ast.AddList(children), FlatAST::Index(children.size()))));
+	}
+
+	void Visit(const ReturnStatementAST& node)
+	{
+		const FlatAST::Index expression = node.GetExpression() ? Pop() : FlatAST::npos;
+		m_results.push_back(m_ast.AddStatement(MakeStatement(FlatAST::StatementKind::Return, expression)));
+	}
+
+	void Visit(const IfStatementAST& node)
+	{
+		const FlatAST::Index elif = node.GetElseStmt() ? Pop() : FlatAST::npos;
+		const FlatAST::Index then = Pop();
+		const FlatAST::Index condition = Pop();
+		m_results.push_back(m_ast.AddStatement(MakeStatement(FlatAST::StatementKind::If, condition, then, elif)));
+	}
+
+	void Visit(const WhileStatementAST&)
+	{
+		const FlatAST::Index body = Pop();
+		const FlatAST::Index condition = Pop();
+		m_results.push_back(m_ast.AddStatement(MakeStatement(FlatAST::StatementKind::While, condition, body)));
+	}
+
+	void Visit(const CompositeStatementAST& node)
+	{
+		const std::vector<FlatAST::Index> statements = PopList(node.GetCount());
+		m_results.push_back(m_ast.AddStatement(MakeStatement(FlatAST::StatementKind::Composite,
+			FlatAST::npos, m_ast.AddList(statements), FlatAST::Index(statements.size()))));
+	}
+
+	void Visit(const BuiltinCallStatementAST& node)
+	{
+		const std::vector<FlatAST::Index> params = PopList(node.GetParamsCount());
+		FlatAST::Statement statement = MakeStatement(FlatAST::StatementKind::BuiltinCall,
+			FlatAST::npos, m_ast.AddList(params), FlatAST::Index(params.size()));
+		statement.op = uint8_t(node.GetBuiltin());
+		m_results.push_back(m_ast.AddStatement(statement));
+	}
+
+	void Visit(const FunctionCallStatementAST&)
+	{
+		const FlatAST::Index call = Pop();
+		m_results.push_back(m_ast.AddStatement(MakeStatement(FlatAST::StatementKind::FunctionCall, call)));
+	}
+
+private:
+	FlatAST& m_ast;
+	// Indices of visited nodes, that are not yet attached to their parents
+	std::vector<FlatAST::Index> m_results;
+};
+}
+
+FlatAST::Index FlatAST::AddExpression(const Expression& expression)
+{
+	return Append(m_expressions, expression);
+}
+
+FlatAST::Index FlatAST::AddStatement(const Statement& statement)
+{
+	return Append(m_statements, statement);
+}
+
+FlatAST::Index FlatAST::AddFunction(const Function& function)
+{
+	return Append(m_functions, function);
+}
+
+FlatAST::Index FlatAST::AddParam(const Param& param)
+{
+	return Append(m_params, param);
+}
+
+FlatAST::Index FlatAST::AddList(const std::vector<Index>& list)
+{
+	const Index offset = Index(m_lists.size());
+	for (Index index : list)
+	{
+		Append(m_lists, index);
+	}
+	return offset;
+}
+
+FlatAST::Index FlatAST::AddName(const std::string& name)
+{
+	auto found = m_nameIndices.find(name);
+	if (found != m_nameIndices.end())
+	{
+		return found->second;
+	}
+	const Index index = Append(m_names, name);
+	m_nameIndices.emplace(name, index);
+	return index;
+}
+
+FlatAST::Index FlatAST::AddInt(int value)
+{
+	return Append(m_ints, value);
+}
+
+FlatAST::Index FlatAST::AddFloat(double value)
+{
+	return Append(m_floats, value);
+}
+
+FlatAST::Index FlatAST::AddString(const std::string& value)
+{
+	return Append(m_strings, value);
+}
+
+size_t FlatAST::GetExpressionsCount()const
+{
+	return m_expressions.size();
+}
+
+const FlatAST::Expression& FlatAST::GetExpression(Index index)const
+{
+	return At(m_expressions, index);
+}
+
+size_t FlatAST::GetStatementsCount()const
+{
+	return m_statements.size();
+}
+
+const FlatAST::Statement& FlatAST::GetStatement(Index index)const
+{
+	return At(m_statements, index);
+}
+
+size_t FlatAST::GetFunctionsCount()const
+{
+	return m_functions.size();
+}
+
+const FlatAST::Function& FlatAST::GetFunction(Index index)const
+{
+	return At(m_functions, index);
+}
+
+const FlatAST::Param& FlatAST::GetParam(Index index)const
+{
+	return At(m_params, index);
+}
+
+const FlatAST::Index* FlatAST::GetList(Index offset, Index count)const
+{
+	if (size_t(offset) + count > m_lists.size())
+	{
+		throw std::out_of_range("flat ast list offset is out of range");
+	}
+	return m_lists.data() + offset;
+}
+
+size_t FlatAST::GetNamesCount()const
+{
+	return m_names.size();
+}
+
+const std::string& FlatAST::GetName(Index index)const
+{
+	return At(m_names, index);
+}
+
+int FlatAST::GetInt(Index index)const
+{
+	return At(m_ints, index);
+}
+
+double FlatAST::GetFloat(Index index)const
+{
+	return At(m_floats, index);
+}
+
+const std::string& FlatAST::GetString(Index index)const
+{
+	return At(m_strings, index);
+}
+
+std::unique_ptr<FlatAST> CreateFlatAST(const ProgramAST& program)
+{
+	auto ast = std::make_unique<FlatAST>();
+	FlatASTBuilder builder(*ast);
+	for (size_t i = 0; i < program.GetFunctionsCount(); ++i)
+	{
+		builder.AddFunction(program.GetFunction(i));
+	}
+	return ast;
+}
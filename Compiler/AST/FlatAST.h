@@ -0,0 +1,130 @@
+#pragma once
+#include "AST.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Index-based representation of ProgramAST: every node is a fixed-size record
+//  in a contiguous array, children are referenced by 32-bit indices and
+//  literals and names live in side tables.
+// Nodes are stored in post-order (children always precede their parent),
+//  so bottom-up passes can stream through the arrays linearly.
+class FlatAST
+{
+public:
+	using Index = uint32_t;
+	static constexpr Index npos = ~Index(0);
+
+	using ExpressionKind = ::ExpressionKind;
+	using StatementKind = ::StatementKind;
+
+	enum class LiteralKind : uint8_t
+	{
+		Int,
+		Float,
+		Bool,
+		String,
+		Array
+	};
+
+	// Meaning of the fields depends on the kind of the node:
+	//  Binary             - op: BinaryExpressionAST::Operator, first: left, second: right
+	//  Unary              - op: UnaryAST::Operator, first: operand
+	//  Literal            - op: LiteralKind, first: slot in the literal table (Int, Float, String),
+	//                       value itself (Bool) or list of elements (Array, second/third)
+	//  Identifier         - first: name
+	//  FunctionCall       - first: name, second/third: list of params
+	//  ArrayElementAccess - first: name, second/third: list of indices
+	struct Expression
+	{
+		ExpressionKind kind;
+		uint8_t op;
+		uint16_t reserved;
+		Index first;
+		Index second;
+		Index third;
+	};
+
+	//  VariableDeclaration - op/nesting: declared type, first: name, second: expression or npos
+	//  Assign              - first: name, second: expression
+	//  ArrayElementAssign  - first: name, second/third: list of indices followed by assigned expression
+	//  Return              - first: expression or npos
+	//  If                  - first: condition, second: then statement, third: else statement or npos
+	//  While               - first: condition, second: body statement
+	//  Composite           - second/third: list of statements
+	//  BuiltinCall         - op: BuiltinCallStatementAST::Builtin, second/third: list of params
+	//  FunctionCall        - first: function call expression
+	struct Statement
+	{
+		StatementKind kind;
+		uint8_t op;
+		uint16_t nesting;
+		Index first;
+		Index second;
+		Index third;
+	};
+
+	struct Param
+	{
+		Index name;
+		ExpressionType type;
+	};
+
+	// Expressions of the function body are contiguous, because the body is flattened at once
+	struct Function
+	{
+		Index name;
+		Index body;
+		Index paramsBegin;
+		Index paramsCount;
+		Index expressionsBegin;
+		Index expressionsCount;
+		boost::optional<ExpressionType> returnType;
+	};
+
+	Index AddExpression(const Expression& expression);
+	Index AddStatement(const Statement& statement);
+	Index AddFunction(const Function& function);
+	Index AddParam(const Param& param);
+	Index AddList(const std::vector<Index>& list);
+
+	Index AddName(const std::string& name);
+	Index AddInt(int value);
+	Index AddFloat(double value);
+	Index AddString(const std::string& value);
+
+	size_t GetExpressionsCount()const;
+	const Expression& GetExpression(Index index)const;
+
+	size_t GetStatementsCount()const;
+	const Statement& GetStatement(Index index)const;
+
+	size_t GetFunctionsCount()const;
+	const Function& GetFunction(Index index)const;
+	const Param& GetParam(Index index)const;
+
+	// Returns pointer to the first element of the list of the given size, that was added with AddList
+	const Index* GetList(Index offset, Index count)const;
+
+	size_t GetNamesCount()const;
+	const std::string& GetName(Index index)const;
+	int GetInt(Index index)const;
+	double GetFloat(Index index)const;
+	const std::string& GetString(Index index)const;
+
+private:
+	std::vector<Expression> m_expressions;
+	std::vector<Statement> m_statements;
+	std::vector<Function> m_functions;
+	std::vector<Param> m_params;
+	std::vector<Index> m_lists;
+
+	std::vector<std::string> m_names;
+	std::unordered_map<std::string, Index> m_nameIndices;
+	std::vector<int> m_ints;
+	std::vector<double> m_floats;
+	std::vector<std::string> m_strings;
+};
+
+std::unique_ptr<FlatAST> CreateFlatAST(const ProgramAST& program);
@@ -0,0 +1,74 @@
+#pragma once
+#include "AST.h"
+#include <stdexcept>
+
+// Compile-time dispatched visitors (CRTP).
+// Derived class implements Visit overloads for concrete node types, each of them returns Result.
+// Dispatch is a switch over the node kind tag, so calls to the overloads can be inlined
+//  and there is no need to pass results back through a side stack.
+// Extra arguments (Args) are passed to the overloads as is, e.g. state of the traversal.
+// Derived class must bring base Visit into scope ('using ExpressionVisitor::Visit;')
+//  and befriend base class, if its overloads are not public.
+template <typename Derived, typename Result, typename... Args>
+class ExpressionVisitor
+{
+public:
+	Result Visit(const IExpressionAST& node, Args... args)
+	{
+		Derived& derived = static_cast<Derived&>(*this);
+		switch (node.GetKind())
+		{
+		case ExpressionKind::Binary:
+			return derived.Visit(static_cast<const BinaryExpressionAST&>(node), args...);
+		case ExpressionKind::Literal:
+			return derived.Visit(static_cast<const LiteralConstantAST&>(node), args...);
+		case ExpressionKind::Unary:
+			return derived.Visit(static_cast<const UnaryAST&>(node), args...);
+		case ExpressionKind::Identifier:
+			return derived.Visit(static_cast<const IdentifierAST&>(node), args...);
+		case ExpressionKind::FunctionCall:
+			return derived.Visit(static_cast<const FunctionCallExpressionAST&>(node), args...);
+		case ExpressionKind::ArrayElementAccess:
+			return derived.Visit(static_cast<const ArrayElementAccessAST&>(node), args...);
+		}
+		throw std::logic_error("can't dispatch expression node of undefined kind");
+	}
+
+protected:
+	~ExpressionVisitor() = default;
+};
+
+template <typename Derived, typename Result, typename... Args>
+class StatementVisitor
+{
+public:
+	Result Visit(const IStatementAST& node, Args... args)
+	{
+		Derived& derived = static_cast<Derived&>(*this);
+		switch (node.GetKind())
+		{
+		case StatementKind::VariableDeclaration:
+			return derived.Visit(static_cast<const VariableDeclarationAST&>(node), args...);
+		case StatementKind::Assign:
+			return derived.Visit(static_cast<const AssignStatementAST&>(node), args...);
+		case StatementKind::ArrayElementAssign:
+			return derived.Visit(static_cast<const ArrayElementAssignAST&>(node), args...);
+		case StatementKind::Return:
+			return derived.Visit(static_cast<const ReturnStatementAST&>(node), args...);
+		case StatementKind::If:
+			return derived.Visit(static_cast<const IfStatementAST&>(node), args...);
+		case StatementKind::While:
+			return derived.Visit(static_cast<const WhileStatementAST&>(node), args...);
+		case StatementKind::Composite:
+			return derived.Visit(static_cast<const CompositeStatementAST&>(node), args...);
+		case StatementKind::BuiltinCall:
+			return derived.Visit(static_cast<const BuiltinCallStatementAST&>(node), args...);
+		case StatementKind::FunctionCall:
+			return derived.Visit(static_cast<const FunctionCallStatementAST&>(node), args...);
+		}
+		throw std::logic_error("can't dispatch statement node of undefined kind");
+	}
+
+protected:
+	~StatementVisitor() = default;
+};
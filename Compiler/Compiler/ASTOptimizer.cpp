@@ -0,0 +1,465 @@
+#include "stdafx.h"
+#include "ASTOptimizer.h"
+#include "../AST/ASTRewriter.h"
+#include <climits>
+#include <cmath>
+
+namespace
+{
+using ExpressionSlot = std::unique_ptr<IExpressionAST>;
+using StatementSlot = std::unique_ptr<IStatementAST>;
+using Value = LiteralConstantAST::Value;
+
+// Folding must give exactly the same values as generated code,
+//  so conversions repeat the instructions, that are used by codegen
+const Value* GetScalarLiteral(const IExpressionAST& node)
+{
+	if (node.GetKind() != ExpressionKind::Literal)
+	{
+		return nullptr;
+	}
+
+	const Value& value = static_cast<const LiteralConstantAST&>(node).GetValue();
+	if (value.type() == typeid(int) || value.type() == typeid(double) || value.type() == typeid(bool))
+	{
+		return &value;
+	}
+	return nullptr;
+}
+
+// Booleans are extended with zeros
+int ToInt(const Value& value)
+{
+	if (const bool* boolean = boost::get<bool>(&value))
+	{
+		return *boolean ? 1 : 0;
+	}
+	return boost::get<int>(value);
+}
+
+// Integers are converted as unsigned (uitofp)
+double ToFloat(const Value& value)
+{
+	if (const int* number = boost::get<int>(&value))
+	{
+		return double(uint32_t(*number));
+	}
+	if (const bool* boolean = boost::get<bool>(&value))
+	{
+		return *boolean ? 1.0 : 0.0;
+	}
+	return boost::get<double>(value);
+}
+
+bool ToBool(const Value& value)
+{
+	if (const int* number = boost::get<int>(&value))
+	{
+		return *number != 0;
+	}
+	if (const double* number = boost::get<double>(&value))
+	{
+		return !(*number == 0.0);
+	}
+	return boost::get<bool>(value);
+}
+
+// Arithmetic of 32 bit integers wraps around
+int WrapInt(uint32_t value)
+{
+	return int(value);
+}
+
+boost::optional<Value> FoldIntegerOperator(BinaryExpressionAST::Operator operation, int left, int right)
+{
+	switch (operation)
+	{
+	case BinaryExpressionAST::Or:
+		return Value(left != 0 || right != 0);
+	case BinaryExpressionAST::And:
+		return Value(left != 0 && right != 0);
+	case BinaryExpressionAST::Equals:
+		return Value(left == right);
+	case BinaryExpressionAST::NotEquals:
+		return Value(left != right);
+	case BinaryExpressionAST::Less:
+		return Value(left < right);
+	case BinaryExpressionAST::LessOrEquals:
+		return Value(left <= right);
+	case BinaryExpressionAST::More:
+		return Value(left > right);
+	case BinaryExpressionAST::MoreOrEquals:
+		return Value(left >= right);
+	case BinaryExpressionAST::Plus:
+		return Value(WrapInt(uint32_t(left) + uint32_t(right)));
+	case BinaryExpressionAST::Minus:
+		return Value(WrapInt(uint32_t(left) - uint32_t(right)));
+	case BinaryExpressionAST::Mul:
+		return Value(WrapInt(uint32_t(left) * uint32_t(right)));
+	case BinaryExpressionAST::Div:
+	case BinaryExpressionAST::Mod:
+		// Undefined behaviour is left to the runtime
+		if (right == 0 || (left == INT_MIN && right == -1))
+		{
+			return boost::none;
+		}
+		return Value(operation == BinaryExpressionAST::Div ? left / right : left % right);
+	}
+	return boost::none;
+}
+
+boost::optional<Value> FoldFloatOperator(BinaryExpressionAST::Operator operation, double left, double right)
+{
+	// Comparisons are ordered, so they are false for NaN
+	switch (operation)
+	{
+	case BinaryExpressionAST::Or:
+		return Value(!(left == 0.0) || !(right == 0.0));
+	case BinaryExpressionAST::And:
+		return Value(!(left == 0.0) && !(right == 0.0));
+	case BinaryExpressionAST::Equals:
+		return Value(left == right);
+	case BinaryExpressionAST::NotEquals:
+		return Value(!(left == right));
+	case BinaryExpressionAST::Less:
+		return Value(left < right);
+	case BinaryExpressionAST::LessOrEquals:
+		return Value(left <= right);
+	case BinaryExpressionAST::More:
+		return Value(left > right);
+	case BinaryExpressionAST::MoreOrEquals:
+		return Value(left >= right);
+	case BinaryExpressionAST::Plus:
+		return Value(left + right);
+	case BinaryExpressionAST::Minus:
+		return Value(left - right);
+	case BinaryExpressionAST::Mul:
+		return Value(left * right);
+	case BinaryExpressionAST::Div:
+		return Value(left / right);
+	case BinaryExpressionAST::Mod:
+		return Value(std::fmod(left, right));
+	}
+	return boost::none;
+}
+
+boost::optional<Value> FoldBooleanOperator(BinaryExpressionAST::Operator operation, bool left, bool right)
+{
+	// Booleans are compared as signed 1 bit integers, so true is less than false
+	const int signedLeft = left ? -1 : 0;
+	const int signedRight = right ? -1 : 0;
+
+	switch (operation)
+	{
+	case BinaryExpressionAST::Or:
+		return Value(left || right);
+	case BinaryExpressionAST::And:
+		return Value(left && right);
+	case BinaryExpressionAST::Equals:
+		return Value(left == right);
+	case BinaryExpressionAST::NotEquals:
+		return Value(left != right);
+	case BinaryExpressionAST::Less:
+		return Value(signedLeft < signedRight);
+	case BinaryExpressionAST::LessOrEquals:
+		return Value(signedLeft <= signedRight);
+	case BinaryExpressionAST::More:
+		return Value(signedLeft > signedRight);
+	case BinaryExpressionAST::MoreOrEquals:
+		return Value(signedLeft >= signedRight);
+	default:
+		// Arithmetic on booleans is rejected by semantic analysis
+		return boost::none;
+	}
+}
+
+boost::optional<Value> FoldBinary(BinaryExpressionAST::Operator operation, ExpressionType type, const Value& left, const Value& right)
+{
+	switch (type.value)
+	{
+	case ExpressionType::Int:
+		return FoldIntegerOperator(operation, ToInt(left), ToInt(right));
+	case ExpressionType::Float:
+		return FoldFloatOperator(operation, ToFloat(left), ToFloat(right));
+	case ExpressionType::Bool:
+		return FoldBooleanOperator(operation, boost::get<bool>(left), boost::get<bool>(right));
+	default:
+		return boost::none;
+	}
+}
+
+Value FoldUnary(UnaryAST::Operator operation, const Value& value)
+{
+	switch (operation)
+	{
+	case UnaryAST::Minus:
+		if (const int* number = boost::get<int>(&value))
+		{
+			return Value(WrapInt(0u - uint32_t(*number)));
+		}
+		if (const double* number = boost::get<double>(&value))
+		{
+			return Value(-*number);
+		}
+		// Negation of 1 bit integer doesn't change it
+		return value;
+	case UnaryAST::Negation:
+		return Value(!ToBool(value));
+	default:
+		return value;
+	}
+}
+
+bool IsIntLiteral(const IExpressionAST& node, int number)
+{
+	const Value* value = GetScalarLiteral(node);
+	return value && value->type() == typeid(int) && boost::get<int>(*value) == number;
+}
+
+class ExpressionSimplifier
+{
+public:
+	explicit ExpressionSimplifier(SemanticInfo& info)
+		: m_info(info)
+	{
+	}
+
+	// Children are simplified before their parents, without recursion
+	void Simplify(ExpressionSlot& root)
+	{
+		struct Item
+		{
+			ExpressionSlot* slot;
+			bool expanded;
+		};
+
+		std::vector<Item> stack = { { &root, false } };
+		while (!stack.empty())
+		{
+			if (stack.back().expanded)
+			{
+				ExpressionSlot& slot = *stack.back().slot;
+				stack.pop_back();
+				SimplifyNode(slot);
+				continue;
+			}
+
+			stack.back().expanded = true;
+			m_children.expressions.clear();
+			ASTRewriter::CollectChildSlots(**stack.back().slot, m_children);
+			for (auto it = m_children.expressions.rbegin(); it != m_children.expressions.rend(); ++it)
+			{
+				stack.push_back({ *it, false });
+			}
+		}
+	}
+
+private:
+	void SimplifyNode(ExpressionSlot& slot)
+	{
+		switch (slot->GetKind())
+		{
+		case ExpressionKind::Binary:
+			SimplifyBinary(slot);
+			break;
+		case ExpressionKind::Unary:
+			SimplifyUnary(slot);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void SimplifyBinary(ExpressionSlot& slot)
+	{
+		const auto& node = static_cast<const BinaryExpressionAST&>(*slot);
+		const IExpressionAST& left = node.GetLeft();
+		const IExpressionAST& right = node.GetRight();
+
+		const Value* leftValue = GetScalarLiteral(left);
+		const Value* rightValue = GetScalarLiteral(right);
+		if (leftValue && rightValue)
+		{
+			const auto type = GetPreferredType(m_info.GetType(left), m_info.GetType(right));
+			assert(type);
+			if (auto folded = FoldBinary(node.GetOperator(), *type, *leftValue, *rightValue))
+			{
+				Replace(slot, *folded);
+			}
+			return;
+		}
+
+		const ExpressionType intType = { ExpressionType::Int, 0 };
+		if (m_info.GetType(left) != intType || m_info.GetType(right) != intType)
+		{
+			return;
+		}
+
+		switch (node.GetOperator())
+		{
+		case BinaryExpressionAST::Mul:
+			if (IsIntLiteral(right, 1))
+			{
+				ReplaceWithChild(slot, 0);
+			}
+			else if (IsIntLiteral(left, 1))
+			{
+				ReplaceWithChild(slot, 1);
+			}
+			break;
+		case BinaryExpressionAST::Plus:
+			if (IsIntLiteral(right, 0))
+			{
+				ReplaceWithChild(slot, 0);
+			}
+			else if (IsIntLiteral(left, 0))
+			{
+				ReplaceWithChild(slot, 1);
+			}
+			break;
+		case BinaryExpressionAST::Minus:
+			if (IsIntLiteral(right, 0))
+			{
+				ReplaceWithChild(slot, 0);
+			}
+			else if (left.GetKind() == ExpressionKind::Identifier && right.GetKind() == ExpressionKind::Identifier &&
+				m_info.GetSymbol(left) == m_info.GetSymbol(right))
+			{
+				Replace(slot, Value(0));
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	void SimplifyUnary(ExpressionSlot& slot)
+	{
+		const auto& node = static_cast<const UnaryAST&>(*slot);
+		if (const Value* value = GetScalarLiteral(node.GetExpr()))
+		{
+			Replace(slot, FoldUnary(node.GetOperator(), *value));
+		}
+		else if (node.GetOperator() == UnaryAST::Plus)
+		{
+			ReplaceWithChild(slot, 0);
+		}
+	}
+
+	// Literal gets the type of the replaced node, so casts in parent nodes stay the same
+	void Replace(ExpressionSlot& slot, const Value& value)
+	{
+		const ExpressionType type = m_info.GetType(*slot);
+		auto literal = std::make_unique<LiteralConstantAST>(value);
+		m_info.SetExpressionInfo(*literal, type);
+		slot = std::move(literal);
+	}
+
+	// Type of the child is the same as type of the node
+	void ReplaceWithChild(ExpressionSlot& slot, size_t index)
+	{
+		m_children.expressions.clear();
+		ASTRewriter::CollectChildSlots(*slot, m_children);
+		ExpressionSlot child = std::move(*m_children.expressions[index]);
+		slot = std::move(child);
+	}
+
+private:
+	SemanticInfo& m_info;
+	ASTChildSlots m_children;
+};
+
+class StatementSimplifier
+{
+public:
+	explicit StatementSimplifier(SemanticInfo& info)
+		: m_expressionSimplifier(info)
+	{
+	}
+
+	void Simplify(StatementSlot& root)
+	{
+		struct Item
+		{
+			StatementSlot* slot;
+			bool expanded;
+		};
+
+		std::vector<Item> stack = { { &root, false } };
+		ASTChildSlots children;
+
+		while (!stack.empty())
+		{
+			if (stack.back().expanded)
+			{
+				StatementSlot& slot = *stack.back().slot;
+				stack.pop_back();
+				SimplifyNode(slot);
+				continue;
+			}
+
+			stack.back().expanded = true;
+			children.expressions.clear();
+			children.statements.clear();
+			ASTRewriter::CollectChildSlots(**stack.back().slot, children);
+
+			for (ExpressionSlot* expression : children.expressions)
+			{
+				m_expressionSimplifier.Simplify(*expression);
+			}
+			for (auto it = children.statements.rbegin(); it != children.statements.rend(); ++it)
+			{
+				stack.push_back({ *it, false });
+			}
+		}
+	}
+
+private:
+	// Conditions are already simplified, so constant condition is a literal
+	void SimplifyNode(StatementSlot& slot)
+	{
+		if (slot->GetKind() == StatementKind::If)
+		{
+			const auto& node = static_cast<const IfStatementAST&>(*slot);
+			if (const Value* condition = GetScalarLiteral(node.GetExpr()))
+			{
+				ASTChildSlots children;
+				ASTRewriter::CollectChildSlots(*slot, children);
+
+				StatementSlot branch;
+				if (ToBool(*condition))
+				{
+					branch = std::move(*children.statements[0]);
+				}
+				else if (children.statements.size() > 1)
+				{
+					branch = std::move(*children.statements[1]);
+				}
+				slot = branch ? std::move(branch) : std::make_unique<CompositeStatementAST>();
+			}
+		}
+		else if (slot->GetKind() == StatementKind::While)
+		{
+			const auto& node = static_cast<const WhileStatementAST&>(*slot);
+			const Value* condition = GetScalarLiteral(node.GetExpr());
+			if (condition && !ToBool(*condition))
+			{
+				slot = std::make_unique<CompositeStatementAST>();
+			}
+		}
+	}
+
+private:
+	ExpressionSimplifier m_expressionSimplifier;
+};
+}
+
+void OptimizeProgram(ProgramAST& program, SemanticInfo& info, const std::vector<size_t>& functions)
+{
+	StatementSimplifier simplifier(info);
+	for (size_t index : functions)
+	{
+		FunctionAST& func = ASTRewriter::GetFunction(program, index);
+		simplifier.Simplify(ASTRewriter::GetStatementSlot(func));
+	}
+}
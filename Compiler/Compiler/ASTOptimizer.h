@@ -0,0 +1,10 @@
+#pragma once
+#include "../AST/AST.h"
+#include "SemanticAnalyzer.h"
+
+// Folds operators on literal constants, simplifies integer identities (x * 1, x + 0, x - x)
+//  and removes branches of if and while statements with constant conditions.
+// Program must be analyzed before: types are taken from the semantic info,
+//  and new literal nodes are annotated there, so it stays valid for code generation.
+// Only functions with the given indices are optimized.
+void OptimizeProgram(ProgramAST& program, SemanticInfo& info, const std::vector<size_t>& functions);
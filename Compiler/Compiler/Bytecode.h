@@ -0,0 +1,115 @@
+#pragma once
+#include "../AST/ExpressionType.h"
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Register-based bytecode, that is executed by the interpreter without LLVM.
+// Each call gets its own window of registers: parameters go first, then local variables
+//  and temporaries. Register holds unboxed Int (and Bool as 0 or 1), Float or pointer,
+//  value of multidimensional array occupies several consecutive registers: pointer to the buffer
+//  and sizes of all dimensions except the first one.
+// Operands a, b, c are registers, unless noted otherwise; 32-bit operand (imm) is made of b and c.
+#define BYTECODE_OPCODES(X) \
+	X(Move)             /* a = b */ \
+	X(MoveN)            /* c registers from b to a */ \
+	X(LoadInt)          /* a = imm */ \
+	X(LoadFloat)        /* a = floats[imm] */ \
+	X(LoadData)         /* a = address of data[imm] */ \
+	X(FrameAddress)     /* a = address of frame memory + imm */ \
+	X(NewMemory)        /* a = address of new imm bytes, that are released on return of the call */ \
+	X(RegisterAddress)  /* a = address of register b */ \
+	X(AddInt)           /* a = b + c */ \
+	X(SubInt) \
+	X(MulInt) \
+	X(DivInt) \
+	X(ModInt) \
+	X(NegInt)           /* a = -b */ \
+	X(AddFloat) \
+	X(SubFloat) \
+	X(MulFloat) \
+	X(DivFloat) \
+	X(ModFloat) \
+	X(NegFloat) \
+	X(EqualInt)         /* a = b == c */ \
+	X(NotEqualInt) \
+	X(LessInt) \
+	X(LessEqualInt) \
+	X(GreaterInt) \
+	X(GreaterEqualInt) \
+	X(EqualFloat) \
+	X(NotEqualFloat) \
+	X(LessFloat) \
+	X(LessEqualFloat) \
+	X(GreaterFloat) \
+	X(GreaterEqualFloat) \
+	X(Not)              /* a = !b, b is boolean */ \
+	X(IntToBool) \
+	X(FloatToBool) \
+	X(IntToFloat) \
+	X(FloatToInt) \
+	X(LoadByte)         /* a = b[c], elements of arrays and characters of strings */ \
+	X(LoadInt32) \
+	X(LoadDouble) \
+	X(LoadPointer) \
+	X(StoreByte)        /* a[b] = c */ \
+	X(StoreInt32) \
+	X(StoreDouble) \
+	X(StorePointer) \
+	X(AddressByte)      /* a = &b[c] */ \
+	X(AddressInt32) \
+	X(AddressDouble) \
+	X(AddressPointer) \
+	X(MemMove)          /* copies c bytes from b to a */ \
+	X(CheckExtent)      /* stops the program, if a != imm; size of row assigned to multidimensional array */ \
+	X(Jump)             /* to imm */ \
+	X(JumpIfTrue)       /* to imm, if a */ \
+	X(JumpIfFalse) \
+	X(Loop)             /* to imm, if a; back-edge of while loop, it's counted by tiered execution */ \
+	X(Call)             /* functions[imm], arguments start at a, result replaces them */ \
+	X(Return)           /* b registers from a, b is 0 for void function */ \
+	X(Print)            /* printf with format a and b - 1 arguments after it, signatures[c] */ \
+	X(Scan)             /* scanf with format a and b - 1 addresses after it */
+
+enum class Opcode : uint16_t
+{
+#define BYTECODE_OPCODE_ENUM(name) name,
+	BYTECODE_OPCODES(BYTECODE_OPCODE_ENUM)
+#undef BYTECODE_OPCODE_ENUM
+};
+
+struct Instruction
+{
+	Opcode op;
+	uint16_t a;
+	uint16_t b;
+	uint16_t c;
+};
+
+inline uint32_t GetImmediate(const Instruction& instruction)
+{
+	return uint32_t(instruction.b) | (uint32_t(instruction.c) << 16);
+}
+
+struct BytecodeFunction
+{
+	std::string name;
+	boost::optional<ExpressionType> returnType;
+	std::vector<ExpressionType> params;
+	std::vector<Instruction> code;
+	// Size of the register window and of the memory for array and string literals
+	size_t registerCount = 0;
+	size_t memorySize = 0;
+};
+
+struct BytecodeProgram
+{
+	// Indexed as functions of the program, functions that are not compiled have no code
+	std::vector<BytecodeFunction> functions;
+	std::vector<double> floats;
+	// Strings and arrays of constants, words keep doubles aligned
+	std::vector<std::vector<uint64_t>> data;
+	// Types of print arguments after the format: 'i' for Int and Bool, 'f' for Float, 'p' for pointers
+	std::vector<std::string> signatures;
+};
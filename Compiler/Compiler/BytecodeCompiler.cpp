@@ -0,0 +1,1374 @@
+#include "stdafx.h"
+#include "BytecodeCompiler.h"
+#include "../AST/StaticVisitor.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+
+namespace
+{
+using Register = uint16_t;
+
+// Result of call of void function
+const Register gcNoRegister = std::numeric_limits<Register>::max();
+// Jump, that is not emitted, since the previous statement doesn't fall through
+const size_t gcNoJump = ~size_t(0);
+
+// Multidimensional array is stored in one buffer in row-major order, like in generated code
+bool IsDenseArray(const ExpressionType& type)
+{
+	return type.nesting >= 2;
+}
+
+unsigned GetRegisterCount(const ExpressionType& type)
+{
+	return IsDenseArray(type) ? type.nesting : 1;
+}
+
+// Layout of elements in memory is the same as in generated code: Bool takes one byte
+enum class ElementKind
+{
+	Byte,
+	Int32,
+	Double,
+	Pointer
+};
+
+ElementKind GetElementKind(const ExpressionType& elementType)
+{
+	if (elementType.nesting != 0)
+	{
+		return ElementKind::Pointer;
+	}
+
+	switch (elementType.value)
+	{
+	case ExpressionType::Int:
+		return ElementKind::Int32;
+	case ExpressionType::Float:
+		return ElementKind::Double;
+	case ExpressionType::Bool:
+		return ElementKind::Byte;
+	case ExpressionType::String:
+		return ElementKind::Pointer;
+	}
+	throw std::logic_error("can't get element kind of undefined ExpressionType");
+}
+
+size_t GetElementSize(ElementKind kind)
+{
+	switch (kind)
+	{
+	case ElementKind::Byte:
+		return 1;
+	case ElementKind::Int32:
+		return sizeof(int32_t);
+	case ElementKind::Double:
+		return sizeof(double);
+	case ElementKind::Pointer:
+		return sizeof(char*);
+	}
+	throw std::logic_error("can't get size of undefined element kind");
+}
+
+Opcode GetLoadOpcode(ElementKind kind)
+{
+	const Opcode opcodes[] = { Opcode::LoadByte, Opcode::LoadInt32, Opcode::LoadDouble, Opcode::LoadPointer };
+	return opcodes[size_t(kind)];
+}
+
+Opcode GetStoreOpcode(ElementKind kind)
+{
+	const Opcode opcodes[] = { Opcode::StoreByte, Opcode::StoreInt32, Opcode::StoreDouble, Opcode::StorePointer };
+	return opcodes[size_t(kind)];
+}
+
+Opcode GetAddressOpcode(ElementKind kind)
+{
+	const Opcode opcodes[] = { Opcode::AddressByte, Opcode::AddressInt32, Opcode::AddressDouble, Opcode::AddressPointer };
+	return opcodes[size_t(kind)];
+}
+
+// Elements of multidimensional array literal are enumerated in row-major order
+const IExpressionAST& GetArrayLiteralElement(const LiteralConstantAST& node, const std::vector<unsigned>& extents, size_t index)
+{
+	size_t stride = std::accumulate(extents.begin() + 1, extents.end(), size_t(1), std::multiplies<size_t>());
+	const LiteralConstantAST* literal = &node;
+	for (size_t dimension = 0; ; ++dimension)
+	{
+		const auto& elements = boost::get<std::vector<std::shared_ptr<IExpressionAST>>>(literal->GetValue());
+		const IExpressionAST& element = *elements[index / stride];
+		if (dimension + 1 == extents.size())
+		{
+			return element;
+		}
+		index %= stride;
+		stride /= extents[dimension + 1];
+		literal = static_cast<const LiteralConstantAST*>(&element);
+	}
+}
+
+// Code, registers and frame memory of the function being compiled.
+// Variables have fixed registers, temporaries are allocated above them like on a stack:
+//  result of expression is put to the first free register, when its compilation has started
+class FunctionBuilder
+{
+public:
+	// Indices of strings in data of the program are shared by all functions
+	FunctionBuilder(BytecodeProgram& program, std::map<std::string, uint32_t>& strings, BytecodeFunction& function, const SemanticInfo::Function& info)
+		: m_program(program)
+		, m_function(function)
+		, m_label(0)
+		, m_strings(strings)
+		, m_loopDepth(0)
+	{
+		size_t count = 0;
+		for (const SemanticInfo::Variable& variable : info.variables)
+		{
+			m_variables.push_back(Register(count));
+			count += GetRegisterCount(variable.type);
+			CheckRegisterCount(count);
+		}
+		m_temporaries = Register(count);
+		m_top = m_temporaries;
+		m_function.registerCount = count;
+	}
+
+	Register GetVariable(size_t index)const
+	{
+		return m_variables[index];
+	}
+
+	bool IsTemporary(Register reg)const
+	{
+		return reg >= m_temporaries;
+	}
+
+	Register GetTop()const
+	{
+		return m_top;
+	}
+
+	void SetTop(size_t top)
+	{
+		CheckRegisterCount(top);
+		m_top = Register(top);
+		m_function.registerCount = std::max(m_function.registerCount, top);
+	}
+
+	// Temporaries live only until the end of statement
+	void FreeTemporaries()
+	{
+		m_top = m_temporaries;
+	}
+
+	Register Allocate(unsigned count)
+	{
+		const Register reg = m_top;
+		SetTop(size_t(m_top) + count);
+		return reg;
+	}
+
+	size_t Emit(Opcode op, Register a, uint16_t b = 0, uint16_t c = 0)
+	{
+		m_function.code.push_back({ op, a, b, c });
+		return m_function.code.size() - 1;
+	}
+
+	size_t EmitWithImmediate(Opcode op, Register a, uint32_t immediate)
+	{
+		return Emit(op, a, uint16_t(immediate & 0xFFFF), uint16_t(immediate >> 16));
+	}
+
+	// Temporary is usually moved right after the instruction, that has computed it,
+	//  then the instruction writes to the destination itself
+	void Move(Register to, Register from, unsigned count)
+	{
+		if (to == from)
+		{
+			return;
+		}
+		if (count == 1 && IsTemporary(from) && WritesLastResultTo(from))
+		{
+			m_function.code.back().a = to;
+			return;
+		}
+		if (count == 1)
+		{
+			Emit(Opcode::Move, to, from);
+		}
+		else
+		{
+			Emit(Opcode::MoveN, to, from, uint16_t(count));
+		}
+	}
+
+	// Position of the next instruction, that is the target of jumps
+	size_t GetLabel()
+	{
+		m_label = m_function.code.size();
+		return m_label;
+	}
+
+	// Jump goes to the next instruction
+	void PatchJump(size_t jump)
+	{
+		const uint32_t target = uint32_t(GetLabel());
+		m_function.code[jump].b = uint16_t(target & 0xFFFF);
+		m_function.code[jump].c = uint16_t(target >> 16);
+	}
+
+	// False after return or unconditional jump, if there is no jumps to the next instruction
+	bool IsReachable()const
+	{
+		const std::vector<Instruction>& code = m_function.code;
+		return code.empty() || m_label == code.size() ||
+			(code.back().op != Opcode::Return && code.back().op != Opcode::Jump);
+	}
+
+	// Buffers of array and string literals are stored to other arrays and outlive the iteration,
+	//  so in loops every evaluation gets new memory like from alloca, unless the buffer is shared
+	//  by all evaluations (see SemanticInfo::IsLiteralBufferShared)
+	void EnterLoop()
+	{
+		++m_loopDepth;
+	}
+
+	void LeaveLoop()
+	{
+		--m_loopDepth;
+	}
+
+	void EmitBufferAddress(Register to, size_t size, bool isShared)
+	{
+		if (m_loopDepth == 0 || isShared)
+		{
+			EmitWithImmediate(Opcode::FrameAddress, to, AllocateMemory(size));
+		}
+		else
+		{
+			EmitWithImmediate(Opcode::NewMemory, to, uint32_t((size + 7) & ~size_t(7)));
+		}
+	}
+
+	// Returns offset of the block of frame memory, blocks are aligned for any element
+	uint32_t AllocateMemory(size_t size)
+	{
+		const size_t offset = m_function.memorySize;
+		m_function.memorySize += (size + 7) & ~size_t(7);
+		return uint32_t(offset);
+	}
+
+	uint32_t AddFloat(double value)
+	{
+		std::vector<double>& floats = m_program.floats;
+		auto it = std::find_if(floats.begin(), floats.end(), [&](double existing) {
+			return std::memcmp(&existing, &value, sizeof(double)) == 0;
+		});
+		if (it != floats.end())
+		{
+			return uint32_t(it - floats.begin());
+		}
+		floats.push_back(value);
+		return uint32_t(floats.size() - 1);
+	}
+
+	uint32_t AddData(const void* bytes, size_t size)
+	{
+		std::vector<uint64_t> words((size + 7) / 8);
+		std::memcpy(words.data(), bytes, size);
+		m_program.data.push_back(std::move(words));
+		return uint32_t(m_program.data.size() - 1);
+	}
+
+	uint32_t AddString(const std::string& str)
+	{
+		auto it = m_strings.find(str);
+		if (it == m_strings.end())
+		{
+			it = m_strings.emplace(str, AddData(str.c_str(), str.length() + 1)).first;
+		}
+		return it->second;
+	}
+
+	uint16_t AddSignature(const std::string& signature)
+	{
+		std::vector<std::string>& signatures = m_program.signatures;
+		auto it = std::find(signatures.begin(), signatures.end(), signature);
+		if (it == signatures.end())
+		{
+			it = signatures.insert(signatures.end(), signature);
+		}
+		return uint16_t(it - signatures.begin());
+	}
+
+private:
+	void CheckRegisterCount(size_t count)const
+	{
+		if (count >= gcNoRegister)
+		{
+			throw std::runtime_error("function '" + m_function.name + "' is too large for the interpreter");
+		}
+	}
+
+	bool WritesLastResultTo(Register reg)const
+	{
+		const std::vector<Instruction>& code = m_function.code;
+		if (code.empty() || m_label == code.size() || code.back().a != reg)
+		{
+			return false;
+		}
+
+		const Opcode op = code.back().op;
+		return (op >= Opcode::Move && op <= Opcode::FloatToInt && op != Opcode::MoveN) ||
+			(op >= Opcode::LoadByte && op <= Opcode::LoadPointer) ||
+			(op >= Opcode::AddressByte && op <= Opcode::AddressPointer);
+	}
+
+private:
+	BytecodeProgram& m_program;
+	BytecodeFunction& m_function;
+	std::vector<Register> m_variables;
+	Register m_temporaries;
+	Register m_top;
+	// Position of the last target of jumps
+	size_t m_label;
+	std::map<std::string, uint32_t>& m_strings;
+	unsigned m_loopDepth;
+};
+
+// Type of the value is known from semantic analysis, strings and arrays are never casted.
+// Bool has the same representation as Int, so it is converted to Int without instructions
+void EmitCast(FunctionBuilder& builder, Register to, Register value, const ExpressionType& from, const ExpressionType& type)
+{
+	if (from == type || (type.value == ExpressionType::Int && from.value == ExpressionType::Bool))
+	{
+		builder.Move(to, value, GetRegisterCount(from));
+		return;
+	}
+
+	switch (type.value)
+	{
+	case ExpressionType::Int:
+		builder.Emit(Opcode::FloatToInt, to, value);
+		break;
+	case ExpressionType::Float:
+		builder.Emit(Opcode::IntToFloat, to, value);
+		break;
+	case ExpressionType::Bool:
+		builder.Emit(from.value == ExpressionType::Int ? Opcode::IntToBool : Opcode::FloatToBool, to, value);
+		break;
+	default:
+		assert(false);
+		throw std::logic_error("can't cast " + ToString(from) + " to " + ToString(type));
+	}
+}
+
+// Temporary is converted in place, variable - to the new temporary
+Register Cast(FunctionBuilder& builder, Register value, const ExpressionType& from, const ExpressionType& type)
+{
+	if (from == type || (type.value == ExpressionType::Int && from.value == ExpressionType::Bool))
+	{
+		return value;
+	}
+
+	const Register result = builder.IsTemporary(value) ? value : builder.Allocate(1);
+	EmitCast(builder, result, value, from, type);
+	return result;
+}
+
+// String literals are shared by all evaluations unless the program modifies strings,
+//  then each evaluation gets its own copy in the memory of the call, like in codegen
+void EmitString(FunctionBuilder& builder, Register to, const std::string& str, bool writable, bool isShared)
+{
+	const uint32_t data = builder.AddString(str);
+	if (!writable)
+	{
+		builder.EmitWithImmediate(Opcode::LoadData, to, data);
+		return;
+	}
+
+	const Register top = builder.GetTop();
+	const Register source = builder.Allocate(1);
+	const Register size = builder.Allocate(1);
+	builder.EmitBufferAddress(to, str.length() + 1, isShared);
+	builder.EmitWithImmediate(Opcode::LoadData, source, data);
+	builder.EmitWithImmediate(Opcode::LoadInt, size, uint32_t(str.length() + 1));
+	builder.Emit(Opcode::MemMove, to, source, size);
+	builder.SetTop(top);
+}
+
+void EmitDefaultValue(FunctionBuilder& builder, Register to, const ExpressionType& type, bool writableStrings)
+{
+	if (type.nesting != 0)
+	{
+		for (unsigned i = 0; i < GetRegisterCount(type); ++i)
+		{
+			builder.EmitWithImmediate(Opcode::LoadInt, Register(to + i), 0);
+		}
+		return;
+	}
+
+	switch (type.value)
+	{
+	case ExpressionType::Int:
+	case ExpressionType::Bool:
+		builder.EmitWithImmediate(Opcode::LoadInt, to, 0);
+		break;
+	case ExpressionType::Float:
+		builder.EmitWithImmediate(Opcode::LoadFloat, to, builder.AddFloat(0.0));
+		break;
+	case ExpressionType::String:
+		// Empty string has no elements to write, so its copy is never changed and can be shared
+		EmitString(builder, to, "", writableStrings, true);
+		break;
+	default:
+		assert(false);
+		throw std::logic_error("can't compile default value for undefined ExpressionType");
+	}
+}
+
+Opcode GetIntegerOpcode(BinaryExpressionAST::Operator operation)
+{
+	switch (operation)
+	{
+	case BinaryExpressionAST::Equals:
+		return Opcode::EqualInt;
+	case BinaryExpressionAST::NotEquals:
+		return Opcode::NotEqualInt;
+	case BinaryExpressionAST::Less:
+		return Opcode::LessInt;
+	case BinaryExpressionAST::LessOrEquals:
+		return Opcode::LessEqualInt;
+	case BinaryExpressionAST::More:
+		return Opcode::GreaterInt;
+	case BinaryExpressionAST::MoreOrEquals:
+		return Opcode::GreaterEqualInt;
+	case BinaryExpressionAST::Plus:
+		return Opcode::AddInt;
+	case BinaryExpressionAST::Minus:
+		return Opcode::SubInt;
+	case BinaryExpressionAST::Mul:
+		return Opcode::MulInt;
+	case BinaryExpressionAST::Div:
+		return Opcode::DivInt;
+	case BinaryExpressionAST::Mod:
+		return Opcode::ModInt;
+	default:
+		assert(false);
+		throw std::logic_error("can't compile binary operator '" + ToString(operation) + "' for Int");
+	}
+}
+
+Opcode GetFloatOpcode(BinaryExpressionAST::Operator operation)
+{
+	switch (operation)
+	{
+	case BinaryExpressionAST::Equals:
+		return Opcode::EqualFloat;
+	case BinaryExpressionAST::NotEquals:
+		return Opcode::NotEqualFloat;
+	case BinaryExpressionAST::Less:
+		return Opcode::LessFloat;
+	case BinaryExpressionAST::LessOrEquals:
+		return Opcode::LessEqualFloat;
+	case BinaryExpressionAST::More:
+		return Opcode::GreaterFloat;
+	case BinaryExpressionAST::MoreOrEquals:
+		return Opcode::GreaterEqualFloat;
+	case BinaryExpressionAST::Plus:
+		return Opcode::AddFloat;
+	case BinaryExpressionAST::Minus:
+		return Opcode::SubFloat;
+	case BinaryExpressionAST::Mul:
+		return Opcode::MulFloat;
+	case BinaryExpressionAST::Div:
+		return Opcode::DivFloat;
+	case BinaryExpressionAST::Mod:
+		return Opcode::ModFloat;
+	default:
+		assert(false);
+		throw std::logic_error("can't compile binary operator '" + ToString(operation) + "' for Float");
+	}
+}
+
+// Operands are already casted to the type; && and || are compiled with jumps
+void EmitBinaryOperation(
+	FunctionBuilder& builder,
+	BinaryExpressionAST::Operator operation,
+	const ExpressionType& type,
+	Register to,
+	Register left,
+	Register right)
+{
+	switch (type.value)
+	{
+	case ExpressionType::Int:
+		builder.Emit(GetIntegerOpcode(operation), to, left, right);
+		return;
+	case ExpressionType::Float:
+		builder.Emit(GetFloatOpcode(operation), to, left, right);
+		return;
+	case ExpressionType::Bool:
+		break;
+	default:
+		assert(false);
+		throw std::logic_error("can't compile binary operator '" + ToString(operation) + "' for " + ToString(type));
+	}
+
+	switch (operation)
+	{
+	case BinaryExpressionAST::Equals:
+	case BinaryExpressionAST::NotEquals:
+		builder.Emit(GetIntegerOpcode(operation), to, left, right);
+		return;
+	case BinaryExpressionAST::Less:
+	case BinaryExpressionAST::LessOrEquals:
+	case BinaryExpressionAST::More:
+	case BinaryExpressionAST::MoreOrEquals:
+	{
+		// Generated code compares booleans as signed one-bit integers, where true is -1
+		const Register negativeLeft = builder.Allocate(1);
+		const Register negativeRight = builder.Allocate(1);
+		builder.Emit(Opcode::NegInt, negativeLeft, left);
+		builder.Emit(Opcode::NegInt, negativeRight, right);
+		builder.Emit(GetIntegerOpcode(operation), to, negativeLeft, negativeRight);
+		return;
+	}
+	default:
+		assert(false);
+		throw std::logic_error("can't compile binary operator '" + ToString(operation) + "' for Bool");
+	}
+}
+
+// Offset of the first element of sub-array of dense array, that is selected by the given count of indices
+Register EmitDenseOffset(FunctionBuilder& builder, Register array, unsigned nesting, const std::vector<Register>& indices, size_t count)
+{
+	assert(count != 0 && count <= nesting && nesting >= 2);
+	const Register offset = builder.Allocate(1);
+	Register value = indices[0];
+	for (unsigned dimension = 1; dimension < nesting; ++dimension)
+	{
+		builder.Emit(Opcode::MulInt, offset, value, Register(array + dimension));
+		value = offset;
+		if (dimension < count)
+		{
+			builder.Emit(Opcode::AddInt, offset, offset, indices[dimension]);
+		}
+	}
+	return offset;
+}
+
+// Array literal is stored as data of the program, if all its elements are constants
+bool IsConstantArrayLiteral(const LiteralConstantAST& node, const std::vector<unsigned>& extents, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const IExpressionAST& element = GetArrayLiteralElement(node, extents, i);
+		if (element.GetKind() != ExpressionKind::Literal)
+		{
+			return false;
+		}
+		const LiteralConstantAST::Value& value = static_cast<const LiteralConstantAST&>(element).GetValue();
+		if (value.type() != typeid(int) && value.type() != typeid(double) && value.type() != typeid(bool))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<char> GetConstantArrayBytes(const LiteralConstantAST& node, const std::vector<unsigned>& extents, size_t count, ElementKind kind)
+{
+	const size_t size = GetElementSize(kind);
+	std::vector<char> bytes(count * size);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const auto& element = static_cast<const LiteralConstantAST&>(GetArrayLiteralElement(node, extents, i));
+		char* destination = bytes.data() + i * size;
+		switch (kind)
+		{
+		case ElementKind::Byte:
+			*destination = char(boost::get<bool>(element.GetValue()));
+			break;
+		case ElementKind::Int32:
+		{
+			const int32_t value = boost::get<int>(element.GetValue());
+			std::memcpy(destination, &value, size);
+			break;
+		}
+		case ElementKind::Double:
+			std::memcpy(destination, &boost::get<double>(element.GetValue()), size);
+			break;
+		default:
+			assert(false);
+			throw std::logic_error("array literal of pointers is not constant");
+		}
+	}
+	return bytes;
+}
+
+// Compilation of a node, that is suspended until its child is compiled
+struct ExpressionCompileFrame
+{
+	const IExpressionAST* node;
+	size_t step;
+	// First free register, when compilation of the node has started; result of the node is put there
+	Register mark;
+	Register result;
+	std::vector<Register> values;
+	// Register of the next argument of call or short-circuit jump of && and ||
+	size_t position;
+};
+
+// Expressions are compiled without recursion, like in ExpressionCodegen
+class ExpressionCompiler
+	: private ExpressionVisitor<ExpressionCompiler, const IExpressionAST*, ExpressionCompileFrame&, Register>
+{
+	friend class ExpressionVisitor<ExpressionCompiler, const IExpressionAST*, ExpressionCompileFrame&, Register>;
+	using Frame = ExpressionCompileFrame;
+
+public:
+	ExpressionCompiler(FunctionBuilder& builder, const SemanticInfo& info, const SemanticInfo::Function& func)
+		: m_builder(builder)
+		, m_info(info)
+		, m_func(func)
+	{
+	}
+
+	// Returns register of the variable or the first free register on entry, where the result is put;
+	//  gcNoRegister for call of void function
+	Register Compile(const IExpressionAST& node);
+
+private:
+	// Same protocol as in ExpressionCodegen: each overload is resumed with the register
+	//  of the previously requested child and returns the next child or nullptr
+	const IExpressionAST* Visit(const BinaryExpressionAST& node, Frame& frame, Register child);
+	const IExpressionAST* Visit(const LiteralConstantAST& node, Frame& frame, Register child);
+	const IExpressionAST* Visit(const UnaryAST& node, Frame& frame, Register child);
+	const IExpressionAST* Visit(const IdentifierAST& node, Frame& frame, Register child);
+	const IExpressionAST* Visit(const FunctionCallExpressionAST& node, Frame& frame, Register child);
+	const IExpressionAST* Visit(const ArrayElementAccessAST& node, Frame& frame, Register child);
+
+	void BeginShortCircuit(const BinaryExpressionAST& node, Frame& frame, Register left);
+	void EndShortCircuit(const BinaryExpressionAST& node, Frame& frame, Register right);
+	const IExpressionAST* VisitArrayLiteral(const LiteralConstantAST& node, Frame& frame, Register child);
+
+private:
+	FunctionBuilder& m_builder;
+	const SemanticInfo& m_info;
+	const SemanticInfo::Function& m_func;
+	std::vector<Frame> m_frames;
+};
+
+Register ExpressionCompiler::Compile(const IExpressionAST& node)
+{
+	const size_t base = m_frames.size();
+	m_frames.push_back({ &node, 0, m_builder.GetTop(), gcNoRegister, {}, 0 });
+
+	// Result of the last completed node, it is passed to its parent
+	Register result = gcNoRegister;
+
+	try
+	{
+		while (m_frames.size() > base)
+		{
+			Frame& frame = m_frames.back();
+			if (const IExpressionAST* child = ExpressionVisitor::Visit(*frame.node, frame, result))
+			{
+				m_frames.push_back({ child, 0, m_builder.GetTop(), gcNoRegister, {}, 0 });
+				result = gcNoRegister;
+			}
+			else
+			{
+				result = frame.result;
+				m_frames.pop_back();
+			}
+		}
+	}
+	catch (...)
+	{
+		m_frames.erase(m_frames.begin() + base, m_frames.end());
+		throw;
+	}
+
+	return result;
+}
+
+const IExpressionAST* ExpressionCompiler::Visit(const BinaryExpressionAST& node, Frame& frame, Register child)
+{
+	const BinaryExpressionAST::Operator operation = node.GetOperator();
+	const bool isLogical = operation == BinaryExpressionAST::And || operation == BinaryExpressionAST::Or;
+
+	switch (frame.step++)
+	{
+	case 0:
+		return &node.GetLeft();
+	case 1:
+		if (isLogical)
+		{
+			BeginShortCircuit(node, frame, child);
+		}
+		else
+		{
+			frame.values.push_back(child);
+		}
+		return &node.GetRight();
+	default:
+		break;
+	}
+
+	if (isLogical)
+	{
+		EndShortCircuit(node, frame, child);
+		return nullptr;
+	}
+
+	const ExpressionType leftType = m_info.GetType(node.GetLeft());
+	const ExpressionType rightType = m_info.GetType(node.GetRight());
+	const ExpressionType castType = *GetPreferredType(leftType, rightType);
+
+	const Register left = Cast(m_builder, frame.values[0], leftType, castType);
+	const Register right = Cast(m_builder, child, rightType, castType);
+	EmitBinaryOperation(m_builder, operation, castType, frame.mark, left, right);
+
+	frame.result = frame.mark;
+	m_builder.SetTop(frame.mark + 1);
+	return nullptr;
+}
+
+// Result of left operand is put to the result of operator, right operand is skipped,
+//  when it decides the result
+void ExpressionCompiler::BeginShortCircuit(const BinaryExpressionAST& node, Frame& frame, Register left)
+{
+	const ExpressionType leftType = m_info.GetType(node.GetLeft());
+	const ExpressionType castType = *GetPreferredType(leftType, m_info.GetType(node.GetRight()));
+
+	EmitCast(m_builder, frame.mark, Cast(m_builder, left, leftType, castType), castType, { ExpressionType::Bool, 0 });
+	m_builder.SetTop(frame.mark + 1);
+
+	const bool isAnd = node.GetOperator() == BinaryExpressionAST::And;
+	frame.position = m_builder.EmitWithImmediate(isAnd ? Opcode::JumpIfFalse : Opcode::JumpIfTrue, frame.mark, 0);
+}
+
+void ExpressionCompiler::EndShortCircuit(const BinaryExpressionAST& node, Frame& frame, Register right)
+{
+	const ExpressionType rightType = m_info.GetType(node.GetRight());
+	const ExpressionType castType = *GetPreferredType(m_info.GetType(node.GetLeft()), rightType);
+
+	EmitCast(m_builder, frame.mark, Cast(m_builder, right, rightType, castType), castType, { ExpressionType::Bool, 0 });
+	m_builder.PatchJump(frame.position);
+
+	frame.result = frame.mark;
+	m_builder.SetTop(frame.mark + 1);
+}
+
+const IExpressionAST* ExpressionCompiler::Visit(const LiteralConstantAST& node, Frame& frame, Register child)
+{
+	const LiteralConstantAST::Value& constant = node.GetValue();
+
+	if (constant.type() == typeid(std::vector<std::shared_ptr<IExpressionAST>>))
+	{
+		return VisitArrayLiteral(node, frame, child);
+	}
+
+	frame.result = m_builder.Allocate(1);
+	if (constant.type() == typeid(int))
+	{
+		m_builder.EmitWithImmediate(Opcode::LoadInt, frame.result, uint32_t(boost::get<int>(constant)));
+	}
+	else if (constant.type() == typeid(double))
+	{
+		m_builder.EmitWithImmediate(Opcode::LoadFloat, frame.result, m_builder.AddFloat(boost::get<double>(constant)));
+	}
+	else if (constant.type() == typeid(bool))
+	{
+		m_builder.EmitWithImmediate(Opcode::LoadInt, frame.result, uint32_t(boost::get<bool>(constant)));
+	}
+	else if (constant.type() == typeid(std::string))
+	{
+		const std::string& str = boost::get<std::string>(constant);
+		EmitString(m_builder, frame.result, str, m_info.AreElementsWritten({ ExpressionType::String, 0 }),
+			m_info.IsLiteralBufferShared(node));
+	}
+	else
+	{
+		assert(false);
+		throw std::logic_error("Visiting LiteralConstantAST - can't compile undefined literal constant type");
+	}
+	return nullptr;
+}
+
+// Elements (of all dimensions) are compiled one by one and stored to the buffer in the frame memory
+const IExpressionAST* ExpressionCompiler::VisitArrayLiteral(const LiteralConstantAST& node, Frame& frame, Register child)
+{
+	const ExpressionType type = m_info.GetType(node);
+	const std::vector<unsigned>& extents = m_info.GetArrayExtents(node);
+	const size_t count = std::accumulate(extents.begin(), extents.end(), size_t(1), std::multiplies<size_t>());
+	const ElementKind kind = GetElementKind({ type.value, 0 });
+	const unsigned registerCount = GetRegisterCount(type);
+
+	if (frame.step == 0)
+	{
+		frame.result = m_builder.Allocate(registerCount);
+		// Sizes of all dimensions except the first one are kept with pointer to the buffer
+		for (unsigned i = 1; i < extents.size(); ++i)
+		{
+			m_builder.EmitWithImmediate(Opcode::LoadInt, Register(frame.result + i), extents[i]);
+		}
+
+		// Sub-arrays of multidimensional array share its buffer, so it's modified by writes to any of them
+		bool writable = false;
+		for (unsigned nesting = 1; nesting <= type.nesting; ++nesting)
+		{
+			writable = writable || m_info.AreElementsWritten({ type.value, nesting });
+		}
+
+		// Literal of constants is data of the program, that is copied only if arrays of its type are modified
+		if (IsConstantArrayLiteral(node, extents, count))
+		{
+			const std::vector<char> bytes = GetConstantArrayBytes(node, extents, count, kind);
+			const uint32_t data = m_builder.AddData(bytes.data(), bytes.size());
+			if (!writable)
+			{
+				m_builder.EmitWithImmediate(Opcode::LoadData, frame.result, data);
+				return nullptr;
+			}
+
+			const Register source = m_builder.Allocate(1);
+			const Register size = m_builder.Allocate(1);
+			m_builder.EmitBufferAddress(frame.result, bytes.size(), m_info.IsLiteralBufferShared(node));
+			m_builder.EmitWithImmediate(Opcode::LoadData, source, data);
+			m_builder.EmitWithImmediate(Opcode::LoadInt, size, uint32_t(bytes.size()));
+			m_builder.Emit(Opcode::MemMove, frame.result, source, size);
+			m_builder.SetTop(frame.result + registerCount);
+			return nullptr;
+		}
+
+		m_builder.EmitBufferAddress(frame.result, count * GetElementSize(kind), m_info.IsLiteralBufferShared(node));
+	}
+	else
+	{
+		const Register index = m_builder.Allocate(1);
+		m_builder.EmitWithImmediate(Opcode::LoadInt, index, uint32_t(frame.step - 1));
+		m_builder.Emit(GetStoreOpcode(kind), frame.result, index, child);
+		m_builder.SetTop(frame.result + registerCount);
+	}
+
+	if (frame.step < count)
+	{
+		return &GetArrayLiteralElement(node, extents, frame.step++);
+	}
+	return nullptr;
+}
+
+const IExpressionAST* ExpressionCompiler::Visit(const UnaryAST& node, Frame& frame, Register child)
+{
+	if (frame.step++ == 0)
+	{
+		return &node.GetExpr();
+	}
+
+	const ExpressionType type = m_info.GetType(node.GetExpr());
+	switch (node.GetOperator())
+	{
+	case UnaryAST::Plus:
+		frame.result = child;
+		return nullptr;
+	case UnaryAST::Minus:
+		// Negation of one-bit boolean doesn't change it
+		if (type.value == ExpressionType::Bool)
+		{
+			frame.result = child;
+			return nullptr;
+		}
+		m_builder.Emit(type.value == ExpressionType::Int ? Opcode::NegInt : Opcode::NegFloat, frame.mark, child);
+		break;
+	case UnaryAST::Negation:
+		EmitCast(m_builder, frame.mark, child, type, { ExpressionType::Bool, 0 });
+		m_builder.Emit(Opcode::Not, frame.mark, frame.mark);
+		break;
+	default:
+		assert(false);
+		throw std::logic_error("Visit(UnaryAST): undefined unary operator");
+	}
+
+	frame.result = frame.mark;
+	m_builder.SetTop(frame.mark + 1);
+	return nullptr;
+}
+
+const IExpressionAST* ExpressionCompiler::Visit(const IdentifierAST& node, Frame& frame, Register)
+{
+	frame.result = m_builder.GetVariable(m_info.GetSymbol(node));
+	return nullptr;
+}
+
+// Arguments are put to consecutive registers, that become the first registers of the callee,
+//  result replaces them
+const IExpressionAST* ExpressionCompiler::Visit(const FunctionCallExpressionAST& node, Frame& frame, Register child)
+{
+	const size_t index = m_info.GetSymbol(node);
+	const SemanticInfo::Function& callee = m_info.GetFunction(index);
+
+	if (frame.step == 0)
+	{
+		frame.position = frame.mark;
+	}
+	else
+	{
+		const size_t param = frame.step - 1;
+		const unsigned count = GetRegisterCount(callee.params[param]);
+		const Register value = Cast(m_builder, child, m_info.GetType(node.GetParam(param)), callee.params[param]);
+		m_builder.Move(Register(frame.position), value, count);
+		frame.position += count;
+		m_builder.SetTop(frame.position);
+	}
+
+	if (frame.step < node.GetParamsCount())
+	{
+		return &node.GetParam(frame.step++);
+	}
+
+	m_builder.EmitWithImmediate(Opcode::Call, frame.mark, uint32_t(index));
+	frame.result = callee.returnType ? frame.mark : gcNoRegister;
+	m_builder.SetTop(frame.mark + (callee.returnType ? GetRegisterCount(*callee.returnType) : 0));
+	return nullptr;
+}
+
+const IExpressionAST* ExpressionCompiler::Visit(const ArrayElementAccessAST& node, Frame& frame, Register child)
+{
+	if (frame.step != 0)
+	{
+		const IExpressionAST& indexNode = node.GetIndex(frame.step - 1);
+		frame.values.push_back(Cast(m_builder, child, m_info.GetType(indexNode), { ExpressionType::Int, 0 }));
+	}
+
+	if (frame.step < node.GetIndexCount())
+	{
+		return &node.GetIndex(frame.step++);
+	}
+
+	// Dimensions of dense array are indexed at once, indices of pointers (or characters of string) - one by one
+	const size_t variable = m_info.GetSymbol(node);
+	const ExpressionType& arrayType = m_func.variables[variable].type;
+	const Register array = m_builder.GetVariable(variable);
+	const std::vector<Register>& indices = frame.values;
+
+	Register value = array;
+	ExpressionType type = arrayType;
+	size_t next = 0;
+	if (IsDenseArray(arrayType))
+	{
+		next = std::min<size_t>(indices.size(), arrayType.nesting);
+		const Register offset = EmitDenseOffset(m_builder, array, arrayType.nesting, indices, next);
+		const ElementKind kind = GetElementKind({ arrayType.value, 0 });
+		if (next < arrayType.nesting)
+		{
+			m_builder.Emit(GetAddressOpcode(kind), frame.mark, array, offset);
+			if (arrayType.nesting - next > 1)
+			{
+				m_builder.Emit(Opcode::MoveN, Register(frame.mark + 1), Register(array + 1 + next), uint16_t(arrayType.nesting - next - 1));
+			}
+		}
+		else
+		{
+			m_builder.Emit(GetLoadOpcode(kind), frame.mark, array, offset);
+		}
+		value = frame.mark;
+		type = { arrayType.value, unsigned(arrayType.nesting - next) };
+	}
+	for (; next < indices.size(); ++next)
+	{
+		// Character of string is loaded as unsigned byte
+		const bool isCharacter = type.nesting == 0;
+		const ExpressionType element = isCharacter ? ExpressionType{ ExpressionType::Int, 0 } : ExpressionType{ type.value, type.nesting - 1 };
+		m_builder.Emit(GetLoadOpcode(isCharacter ? ElementKind::Byte : GetElementKind(element)), frame.mark, value, indices[next]);
+		value = frame.mark;
+		type = element;
+	}
+
+	frame.result = frame.mark;
+	m_builder.SetTop(frame.mark + GetRegisterCount(type));
+	return nullptr;
+}
+
+struct StatementCompileFrame
+{
+	const IStatementAST* node;
+	size_t step;
+	// Jumps of if statement (to else and to continue), while statement (to afterloop and to the body)
+	size_t jumps[2];
+};
+
+class StatementCompiler
+	: private StatementVisitor<StatementCompiler, const IStatementAST*, StatementCompileFrame&>
+{
+	friend class StatementVisitor<StatementCompiler, const IStatementAST*, StatementCompileFrame&>;
+	using Frame = StatementCompileFrame;
+
+public:
+	StatementCompiler(FunctionBuilder& builder, const SemanticInfo& info, const SemanticInfo::Function& func)
+		: m_builder(builder)
+		, m_info(info)
+		, m_func(func)
+		, m_expressionCompiler(builder, info, func)
+	{
+	}
+
+	void Compile(const IStatementAST& node);
+
+private:
+	// Same protocol as in StatementCodegen: returns the next nested statement or nullptr
+	const IStatementAST* Visit(const VariableDeclarationAST& node, Frame& frame);
+	const IStatementAST* Visit(const ReturnStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const AssignStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const ArrayElementAssignAST& node, Frame& frame);
+	const IStatementAST* Visit(const IfStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const WhileStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const CompositeStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const BuiltinCallStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const FunctionCallStatementAST& node, Frame& frame);
+
+	void CompileAsPrint(const BuiltinCallStatementAST& node);
+	void CompileAsScan(const BuiltinCallStatementAST& node);
+	void CompileBuiltinArgument(const IExpressionAST& expression, Register to);
+	// Integer is tested by jumps as is, so only Float is converted
+	Register CompileCondition(const IExpressionAST& expression);
+	void CompileAssignment(Register variable, const ExpressionType& type, const IExpressionAST& expression);
+
+private:
+	FunctionBuilder& m_builder;
+	const SemanticInfo& m_info;
+	const SemanticInfo::Function& m_func;
+	ExpressionCompiler m_expressionCompiler;
+	std::vector<Frame> m_frames;
+};
+
+void StatementCompiler::Compile(const IStatementAST& node)
+{
+	const size_t base = m_frames.size();
+	m_frames.push_back({ &node, 0, {} });
+
+	try
+	{
+		while (m_frames.size() > base)
+		{
+			Frame& frame = m_frames.back();
+			const IStatementAST* child = StatementVisitor::Visit(*frame.node, frame);
+			m_builder.FreeTemporaries();
+			if (child)
+			{
+				m_frames.push_back({ child, 0, {} });
+			}
+			else
+			{
+				m_frames.pop_back();
+			}
+		}
+	}
+	catch (...)
+	{
+		m_frames.erase(m_frames.begin() + base, m_frames.end());
+		throw;
+	}
+}
+
+const IStatementAST* StatementCompiler::Visit(const VariableDeclarationAST& node, Frame&)
+{
+	const Register variable = m_builder.GetVariable(m_info.GetVariable(node));
+	EmitDefaultValue(m_builder, variable, node.GetType(), m_info.AreElementsWritten({ ExpressionType::String, 0 }));
+
+	if (const IExpressionAST* expression = node.GetExpression())
+	{
+		CompileAssignment(variable, node.GetType(), *expression);
+	}
+	return nullptr;
+}
+
+const IStatementAST* StatementCompiler::Visit(const AssignStatementAST& node, Frame&)
+{
+	const size_t index = m_info.GetVariable(node);
+	CompileAssignment(m_builder.GetVariable(index), m_func.variables[index].type, node.GetExpr());
+	return nullptr;
+}
+
+void StatementCompiler::CompileAssignment(Register variable, const ExpressionType& type, const IExpressionAST& expression)
+{
+	const Register value = m_expressionCompiler.Compile(expression);
+	m_builder.Move(variable, Cast(m_builder, value, m_info.GetType(expression), type), GetRegisterCount(type));
+}
+
+const IStatementAST* StatementCompiler::Visit(const ArrayElementAssignAST& node, Frame&)
+{
+	const size_t variable = m_info.GetVariable(node);
+	const ExpressionType& arrayType = m_func.variables[variable].type;
+	const Register array = m_builder.GetVariable(variable);
+
+	std::vector<Register> indices(node.GetIndexCount());
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		const IExpressionAST& indexNode = node.GetIndex(i);
+		indices[i] = Cast(m_builder, m_expressionCompiler.Compile(indexNode), m_info.GetType(indexNode), { ExpressionType::Int, 0 });
+	}
+
+	const Register expression = m_expressionCompiler.Compile(node.GetExpression());
+
+	// Pointer, index and type of the assigned element
+	Register pointer = array;
+	Register index = indices[0];
+	bool isCharacter = arrayType.nesting == 0;
+	ExpressionType element = isCharacter ? ExpressionType{ ExpressionType::Int, 0 } : ExpressionType{ arrayType.value, arrayType.nesting - 1 };
+	size_t next = 1;
+	if (IsDenseArray(arrayType))
+	{
+		next = std::min<size_t>(indices.size(), arrayType.nesting);
+		const Register offset = EmitDenseOffset(m_builder, array, arrayType.nesting, indices, next);
+		const ElementKind kind = GetElementKind({ arrayType.value, 0 });
+
+		// Sub-array of dense array is assigned by copying, since it is a part of the buffer;
+		//  it's assigned from literal of known size, that must be equal to the size of the row.
+		// First register of the value is the pointer to its buffer
+		if (next < arrayType.nesting)
+		{
+			const std::vector<unsigned>& extents = m_info.GetArrayExtents(node.GetExpression());
+			for (size_t i = 0; i < extents.size(); ++i)
+			{
+				m_builder.EmitWithImmediate(Opcode::CheckExtent, Register(array + next + i), extents[i]);
+			}
+			const size_t count = std::accumulate(extents.begin(), extents.end(), size_t(1), std::multiplies<size_t>());
+			const Register size = m_builder.Allocate(1);
+			m_builder.EmitWithImmediate(Opcode::LoadInt, size, uint32_t(count * GetElementSize(kind)));
+
+			const Register destination = m_builder.Allocate(1);
+			m_builder.Emit(GetAddressOpcode(kind), destination, array, offset);
+			m_builder.Emit(Opcode::MemMove, destination, expression, size);
+			return nullptr;
+		}
+
+		index = offset;
+		element = { arrayType.value, 0 };
+	}
+
+	// Element, that is indexed further, is loaded; the only such scalar is string, its character is assigned
+	for (; next < indices.size(); ++next)
+	{
+		const Register loaded = m_builder.Allocate(1);
+		m_builder.Emit(GetLoadOpcode(GetElementKind(element)), loaded, pointer, index);
+		pointer = loaded;
+		index = indices[next];
+		isCharacter = element.nesting == 0;
+		element = isCharacter ? ExpressionType{ ExpressionType::Int, 0 } : ExpressionType{ element.value, element.nesting - 1 };
+	}
+
+	// Character of string is truncated to byte
+	const ElementKind kind = isCharacter ? ElementKind::Byte : GetElementKind(element);
+	m_builder.Emit(GetStoreOpcode(kind), pointer, index, expression);
+	return nullptr;
+}
+
+const IStatementAST* StatementCompiler::Visit(const ReturnStatementAST& node, Frame&)
+{
+	if (!m_func.returnType)
+	{
+		m_builder.Emit(Opcode::Return, 0, 0);
+		return nullptr;
+	}
+
+	const IExpressionAST& expression = *node.GetExpression();
+	const Register value = Cast(m_builder, m_expressionCompiler.Compile(expression), m_info.GetType(expression), *m_func.returnType);
+	m_builder.Emit(Opcode::Return, value, uint16_t(GetRegisterCount(*m_func.returnType)));
+	return nullptr;
+}
+
+Register StatementCompiler::CompileCondition(const IExpressionAST& expression)
+{
+	const ExpressionType type = m_info.GetType(expression);
+	const Register value = m_expressionCompiler.Compile(expression);
+	return type.value == ExpressionType::Float ? Cast(m_builder, value, type, { ExpressionType::Bool, 0 }) : value;
+}
+
+const IStatementAST* StatementCompiler::Visit(const IfStatementAST& node, Frame& frame)
+{
+	size_t& elseJump = frame.jumps[0];
+	size_t& continueJump = frame.jumps[1];
+
+	switch (frame.step++)
+	{
+	case 0:
+		elseJump = m_builder.EmitWithImmediate(Opcode::JumpIfFalse, CompileCondition(node.GetExpr()), 0);
+		return &node.GetThenStmt();
+	case 1:
+		if (!node.GetElseStmt())
+		{
+			m_builder.PatchJump(elseJump);
+			return nullptr;
+		}
+		continueJump = m_builder.IsReachable() ? m_builder.EmitWithImmediate(Opcode::Jump, 0, 0) : gcNoJump;
+		m_builder.PatchJump(elseJump);
+		return node.GetElseStmt();
+	default:
+		if (continueJump != gcNoJump)
+		{
+			m_builder.PatchJump(continueJump);
+		}
+		return nullptr;
+	}
+}
+
+// Loop is compiled in rotated form like in StatementCodegen: condition is checked before
+//  the first iteration and at the end of body, so each iteration executes one jump
+const IStatementAST* StatementCompiler::Visit(const WhileStatementAST& node, Frame& frame)
+{
+	size_t& afterLoopJump = frame.jumps[0];
+	size_t& body = frame.jumps[1];
+
+	if (frame.step++ == 0)
+	{
+		afterLoopJump = m_builder.EmitWithImmediate(Opcode::JumpIfFalse, CompileCondition(node.GetExpr()), 0);
+		body = m_builder.GetLabel();
+		m_builder.EnterLoop();
+		return &node.GetStatement();
+	}
+
+	if (m_builder.IsReachable())
+	{
+		m_builder.EmitWithImmediate(Opcode::Loop, CompileCondition(node.GetExpr()), uint32_t(body));
+	}
+	m_builder.LeaveLoop();
+	m_builder.PatchJump(afterLoopJump);
+	return nullptr;
+}
+
+const IStatementAST* StatementCompiler::Visit(const CompositeStatementAST& node, Frame& frame)
+{
+	if (frame.step != 0 && !m_builder.IsReachable())
+	{
+		frame.step = node.GetCount();
+	}
+
+	if (frame.step < node.GetCount())
+	{
+		return &node.GetStatement(frame.step++);
+	}
+	return nullptr;
+}
+
+const IStatementAST* StatementCompiler::Visit(const BuiltinCallStatementAST& node, Frame&)
+{
+	switch (node.GetBuiltin())
+	{
+	case BuiltinCallStatementAST::Print:
+		CompileAsPrint(node);
+		break;
+	case BuiltinCallStatementAST::Scan:
+		CompileAsScan(node);
+		break;
+	default:
+		assert(false);
+		throw std::logic_error("can't compile undefined builtin call");
+	}
+	return nullptr;
+}
+
+// Arguments are put to consecutive registers after the format, Bool is passed as Int
+void StatementCompiler::CompileAsPrint(const BuiltinCallStatementAST& node)
+{
+	const Register base = m_builder.GetTop();
+	std::string signature;
+	for (size_t i = 0; i < node.GetParamsCount(); ++i)
+	{
+		const IExpressionAST& expression = node.GetExpression(i);
+		CompileBuiltinArgument(expression, Register(base + i));
+
+		const ExpressionType type = m_info.GetType(expression);
+		if (i != 0)
+		{
+			signature += (type.nesting != 0 || type.value == ExpressionType::String) ? 'p' :
+				(type.value == ExpressionType::Float) ? 'f' : 'i';
+		}
+	}
+
+	m_builder.Emit(Opcode::Print, base, uint16_t(node.GetParamsCount()), m_builder.AddSignature(signature));
+}
+
+// Addresses of registers of variables are passed instead of their values
+void StatementCompiler::CompileAsScan(const BuiltinCallStatementAST& node)
+{
+	const Register base = m_builder.GetTop();
+	CompileBuiltinArgument(node.GetExpression(0), base);
+	for (size_t i = 1; i < node.GetParamsCount(); ++i)
+	{
+		const Register address = m_builder.Allocate(1);
+		m_builder.Emit(Opcode::RegisterAddress, address, m_builder.GetVariable(m_info.GetSymbol(node.GetExpression(i))));
+	}
+
+	m_builder.Emit(Opcode::Scan, base, uint16_t(node.GetParamsCount()));
+}
+
+// Builtins never modify their arguments, so string literals are passed without copying;
+//  only the first register of array value (pointer to its buffer) is passed
+void StatementCompiler::CompileBuiltinArgument(const IExpressionAST& expression, Register to)
+{
+	assert(m_builder.GetTop() == to);
+	if (expression.GetKind() == ExpressionKind::Literal)
+	{
+		const LiteralConstantAST::Value& constant = static_cast<const LiteralConstantAST&>(expression).GetValue();
+		if (const std::string* str = boost::get<std::string>(&constant))
+		{
+			m_builder.EmitWithImmediate(Opcode::LoadData, m_builder.Allocate(1), m_builder.AddString(*str));
+			return;
+		}
+	}
+
+	m_builder.Move(to, m_expressionCompiler.Compile(expression), 1);
+	m_builder.SetTop(to + 1);
+}
+
+const IStatementAST* StatementCompiler::Visit(const FunctionCallStatementAST& node, Frame&)
+{
+	m_expressionCompiler.Compile(node.GetCall());
+	return nullptr;
+}
+
+}
+
+std::unique_ptr<BytecodeProgram> CompileToBytecode(const ProgramAST& program, const SemanticInfo& info, const std::vector<size_t>& functions)
+{
+	auto bytecode = std::make_unique<BytecodeProgram>();
+	bytecode->functions.resize(info.GetFunctionsCount());
+	std::map<std::string, uint32_t> strings;
+
+	for (size_t index : functions)
+	{
+		const SemanticInfo::Function& func = info.GetFunction(index);
+		BytecodeFunction& function = bytecode->functions[index];
+		function.name = func.name;
+		function.returnType = func.returnType;
+		function.params = func.params;
+
+		FunctionBuilder builder(*bytecode, strings, function, func);
+		StatementCompiler compiler(builder, info, func);
+		compiler.Compile(program.GetFunction(index).GetStatement());
+
+		// Function without return statement at the end returns default value
+		if (builder.IsReachable())
+		{
+			if (func.returnType)
+			{
+				const unsigned count = GetRegisterCount(*func.returnType);
+				const Register value = builder.Allocate(count);
+				EmitDefaultValue(builder, value, *func.returnType, info.AreElementsWritten({ ExpressionType::String, 0 }));
+				builder.Emit(Opcode::Return, value, uint16_t(count));
+			}
+			else
+			{
+				builder.Emit(Opcode::Return, 0, 0);
+			}
+		}
+	}
+	return bytecode;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "Bytecode.h"
+#include "SemanticAnalyzer.h"
+#include <memory>
+
+// Compiles only functions with the given indices to bytecode; callees of them must be listed too.
+// Program must be checked by semantic analysis, it is not checked again
+std::unique_ptr<BytecodeProgram> CompileToBytecode(const ProgramAST& program, const SemanticInfo& info, const std::vector<size_t>& functions);
@@ -0,0 +1,848 @@
+#include "stdafx.h"
+#include "BytecodeInterpreter.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+// Registers are not tagged: type of the value is known from the instruction
+union Value
+{
+	int32_t i;
+	double f;
+	char* p;
+	uint64_t bits;
+};
+
+// Memory of array and string literals of active calls, it is released in reverse order.
+// Blocks are never moved, so pointers to the memory stay valid until the call returns
+class FrameMemory
+{
+public:
+	struct Mark
+	{
+		size_t block;
+		size_t offset;
+	};
+
+	FrameMemory()
+		: m_block(0)
+		, m_offset(0)
+	{
+		AddBlock(gcBlockSize);
+	}
+
+	Mark GetMark()const
+	{
+		return { m_block, m_offset };
+	}
+
+	void Release(const Mark& mark)
+	{
+		m_block = mark.block;
+		m_offset = mark.offset;
+	}
+
+	// Size is a multiple of 8, so every block is aligned for any element
+	char* Allocate(size_t size)
+	{
+		if (size == 0)
+		{
+			return nullptr;
+		}
+
+		if (m_offset + size > m_blocks[m_block].size)
+		{
+			// Blocks after the current one are free, the next one is replaced if it's too small
+			++m_block;
+			if (m_block == m_blocks.size())
+			{
+				AddBlock(std::max(size, gcBlockSize));
+			}
+			else if (m_blocks[m_block].size < size)
+			{
+				m_blocks[m_block] = { std::make_unique<uint64_t[]>(size / 8), size };
+			}
+			m_offset = 0;
+		}
+
+		char* memory = reinterpret_cast<char*>(m_blocks[m_block].words.get()) + m_offset;
+		m_offset += size;
+		return memory;
+	}
+
+private:
+	struct Block
+	{
+		std::unique_ptr<uint64_t[]> words;
+		size_t size;
+	};
+
+	void AddBlock(size_t size)
+	{
+		m_blocks.push_back({ std::make_unique<uint64_t[]>(size / 8), size });
+	}
+
+private:
+	static const size_t gcBlockSize = 64 * 1024;
+
+	std::vector<Block> m_blocks;
+	size_t m_block;
+	size_t m_offset;
+};
+
+// State of the caller, that is restored on return
+struct CallFrame
+{
+	const BytecodeFunction* function;
+	const Instruction* returnAddress;
+	size_t base;
+	char* memory;
+	FrameMemory::Mark memoryMark;
+};
+
+template <typename T>
+T LoadElement(const char* array, int32_t index)
+{
+	T value;
+	std::memcpy(&value, array + ptrdiff_t(index) * ptrdiff_t(sizeof(T)), sizeof(T));
+	return value;
+}
+
+template <typename T>
+void StoreElement(char* array, int32_t index, T value)
+{
+	std::memcpy(array + ptrdiff_t(index) * ptrdiff_t(sizeof(T)), &value, sizeof(T));
+}
+
+template <typename T>
+char* GetElementAddress(char* array, int32_t index)
+{
+	return array + ptrdiff_t(index) * ptrdiff_t(sizeof(T));
+}
+
+// Conversion specification of printf or scanf format, that starts at '%'
+struct Conversion
+{
+	const char* end;
+	// Count of '*' in width and precision of printf, that take Int arguments
+	unsigned stars;
+	bool takesArgument;
+};
+
+Conversion ParseConversion(const char* spec, bool isScan)
+{
+	const char* p = spec + 1;
+	if (*p == '%')
+	{
+		return { p + 1, 0, false };
+	}
+
+	Conversion conversion = { nullptr, 0, true };
+	// Assignment suppression of scanf
+	if (isScan && *p == '*')
+	{
+		conversion.takesArgument = false;
+		++p;
+	}
+	while (*p != '\0' && std::strchr("-+ #0'", *p))
+	{
+		++p;
+	}
+	if (!isScan && *p == '*')
+	{
+		++conversion.stars;
+		++p;
+	}
+	while (std::isdigit(static_cast<unsigned char>(*p)))
+	{
+		++p;
+	}
+	if (*p == '.')
+	{
+		++p;
+		if (!isScan && *p == '*')
+		{
+			++conversion.stars;
+			++p;
+		}
+		while (std::isdigit(static_cast<unsigned char>(*p)))
+		{
+			++p;
+		}
+	}
+	while (*p != '\0' && std::strchr("hlLqjzt", *p))
+	{
+		++p;
+	}
+	// Set of characters of scanf may contain ']' as the first character
+	if (isScan && *p == '[')
+	{
+		p += (p[1] == '^') ? 2 : 1;
+		p += (*p == ']') ? 1 : 0;
+		while (*p != '\0' && *p != ']')
+		{
+			++p;
+		}
+	}
+
+	// Incomplete specification is left to printf and scanf as is
+	if (*p == '\0')
+	{
+		return { p, 0, false };
+	}
+	conversion.end = p + 1;
+	return conversion;
+}
+
+template <typename T>
+void PrintPart(const std::string& part, const int* stars, unsigned starCount, T value)
+{
+	switch (starCount)
+	{
+	case 0:
+		std::printf(part.c_str(), value);
+		break;
+	case 1:
+		std::printf(part.c_str(), stars[0], value);
+		break;
+	default:
+		std::printf(part.c_str(), stars[0], stars[1], value);
+		break;
+	}
+}
+
+// Format is printed by parts, each of them has one conversion, that takes an argument:
+//  so arguments of different types are passed to printf without building of va_list.
+// Missing arguments are replaced with zeros
+void Print(const char* format, const Value* args, const std::string& signature)
+{
+	size_t next = 0;
+	const char* begin = format;
+	const char* p = format;
+	while ((p = std::strchr(p, '%')) != nullptr)
+	{
+		const Conversion conversion = ParseConversion(p, false);
+		p = conversion.end;
+		if (!conversion.takesArgument)
+		{
+			continue;
+		}
+
+		int stars[2] = { 0, 0 };
+		for (unsigned i = 0; i < conversion.stars; ++i)
+		{
+			stars[i] = next < signature.size() ? args[next++].i : 0;
+		}
+
+		const std::string part(begin, p);
+		begin = p;
+
+		const char type = next < signature.size() ? signature[next] : 'i';
+		Value value;
+		value.bits = 0;
+		if (next < signature.size())
+		{
+			value = args[next++];
+		}
+
+		switch (type)
+		{
+		case 'f':
+			PrintPart(part, stars, conversion.stars, value.f);
+			break;
+		case 'p':
+			PrintPart(part, stars, conversion.stars, value.p);
+			break;
+		default:
+			PrintPart(part, stars, conversion.stars, value.i);
+			break;
+		}
+	}
+
+	// Rest of the format has no conversions except "%%", it is printed as a plain string
+	if (*begin != '\0')
+	{
+		std::string rest;
+		for (const char* c = begin; *c != '\0'; ++c)
+		{
+			rest += *c;
+			c += (c[0] == '%' && c[1] == '%') ? 1 : 0;
+		}
+		std::fputs(rest.c_str(), stdout);
+	}
+}
+
+// Like scanf, stops on the first conversion, that has failed
+void Scan(const char* format, const Value* addresses, size_t count)
+{
+	size_t next = 0;
+	const char* begin = format;
+	const char* p = format;
+	while ((p = std::strchr(p, '%')) != nullptr)
+	{
+		const Conversion conversion = ParseConversion(p, true);
+		p = conversion.end;
+		if (!conversion.takesArgument)
+		{
+			continue;
+		}
+
+		const std::string part(begin, p);
+		begin = p;
+		if (next == count || std::scanf(part.c_str(), addresses[next++].p) != 1)
+		{
+			return;
+		}
+	}
+
+	// Rest of the format only matches input; "%n" gives scanf an argument, so the format isn't used alone
+	if (*begin != '\0')
+	{
+		int consumed = 0;
+		std::scanf((std::string(begin) + "%n").c_str(), &consumed);
+	}
+}
+
+const BytecodeFunction& FindMain(const BytecodeProgram& program)
+{
+	auto main = std::find_if(program.functions.begin(), program.functions.end(), [&](const BytecodeFunction& function) {
+		return function.name == "main" && !function.code.empty();
+	});
+	if (main == program.functions.end())
+	{
+		throw std::runtime_error("program doesn't have main function");
+	}
+
+	const ExpressionType argc = { ExpressionType::Int, 0 };
+	const ExpressionType argv = { ExpressionType::String, 1 };
+	const bool takesArguments = main->params.size() == 2 && main->params[0] == argc && main->params[1] == argv;
+	if ((!main->params.empty() && !takesArguments) ||
+		(main->returnType && *main->returnType != ExpressionType{ ExpressionType::Int, 0 }))
+	{
+		throw std::runtime_error("main can't be run: it must take no parameters or (argc: Int, argv: Array<String>) and return Int or nothing");
+	}
+	return *main;
+}
+
+int Execute(const BytecodeProgram& program, const BytecodeFunction& main, int argc, char** argv, TieringProfile* profile)
+{
+	std::vector<Value> registers(std::max<size_t>(main.registerCount, 1024));
+	std::vector<CallFrame> frames;
+	FrameMemory memory;
+
+	std::vector<char*> data;
+	for (const std::vector<uint64_t>& words : program.data)
+	{
+		data.push_back(reinterpret_cast<char*>(const_cast<uint64_t*>(words.data())));
+	}
+	const double* floats = program.floats.data();
+
+	// State of the current call
+	const BytecodeFunction* function = &main;
+	const Instruction* code = main.code.data();
+	const Instruction* pc = code;
+	size_t base = 0;
+	Value* r = registers.data();
+	char* frameMemory = memory.Allocate(main.memorySize);
+
+	r[0].i = argc;
+	r[1].p = reinterpret_cast<char*>(argv);
+
+#if defined(__GNUC__)
+	// Computed goto: every handler has its own indirect jump to the next one,
+	//  so the branch predictor learns sequences of instructions instead of a single switch
+#define VM_HANDLER_ADDRESS(name) &&name##Handler,
+	static const void* const handlers[] = { BYTECODE_OPCODES(VM_HANDLER_ADDRESS) };
+#undef VM_HANDLER_ADDRESS
+#define VM_HANDLER(name) name##Handler:
+#define VM_DISPATCH() goto *handlers[size_t(pc->op)]
+	VM_DISPATCH();
+#else
+#define VM_HANDLER(name) case Opcode::name:
+#define VM_DISPATCH() continue
+	for (;;)
+	{
+		switch (pc->op)
+		{
+#endif
+
+	VM_HANDLER(Move)
+	{
+		const Instruction in = *pc++;
+		r[in.a] = r[in.b];
+		VM_DISPATCH();
+	}
+	VM_HANDLER(MoveN)
+	{
+		const Instruction in = *pc++;
+		std::memmove(r + in.a, r + in.b, in.c * sizeof(Value));
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LoadInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].bits = GetImmediate(in);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LoadFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = floats[GetImmediate(in)];
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LoadData)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = data[GetImmediate(in)];
+		VM_DISPATCH();
+	}
+	VM_HANDLER(FrameAddress)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = frameMemory + GetImmediate(in);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(NewMemory)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = memory.Allocate(GetImmediate(in));
+		VM_DISPATCH();
+	}
+	VM_HANDLER(RegisterAddress)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = reinterpret_cast<char*>(&r[in.b]);
+		VM_DISPATCH();
+	}
+
+	// Integer arithmetic wraps around like in generated code
+	VM_HANDLER(AddInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = int32_t(uint32_t(r[in.b].i) + uint32_t(r[in.c].i));
+		VM_DISPATCH();
+	}
+	VM_HANDLER(SubInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = int32_t(uint32_t(r[in.b].i) - uint32_t(r[in.c].i));
+		VM_DISPATCH();
+	}
+	VM_HANDLER(MulInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = int32_t(uint32_t(r[in.b].i) * uint32_t(r[in.c].i));
+		VM_DISPATCH();
+	}
+	VM_HANDLER(DivInt)
+	{
+		const Instruction in = *pc++;
+		const int32_t divisor = r[in.c].i;
+		if (divisor == 0)
+		{
+			throw std::runtime_error("integer division by zero in function '" + function->name + "'");
+		}
+		r[in.a].i = (divisor == -1) ? int32_t(0u - uint32_t(r[in.b].i)) : r[in.b].i / divisor;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(ModInt)
+	{
+		const Instruction in = *pc++;
+		const int32_t divisor = r[in.c].i;
+		if (divisor == 0)
+		{
+			throw std::runtime_error("integer division by zero in function '" + function->name + "'");
+		}
+		r[in.a].i = (divisor == -1) ? 0 : r[in.b].i % divisor;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(NegInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = int32_t(0u - uint32_t(r[in.b].i));
+		VM_DISPATCH();
+	}
+
+	VM_HANDLER(AddFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = r[in.b].f + r[in.c].f;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(SubFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = r[in.b].f - r[in.c].f;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(MulFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = r[in.b].f * r[in.c].f;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(DivFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = r[in.b].f / r[in.c].f;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(ModFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = std::fmod(r[in.b].f, r[in.c].f);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(NegFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = -r[in.b].f;
+		VM_DISPATCH();
+	}
+
+	VM_HANDLER(EqualInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].i == r[in.c].i;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(NotEqualInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].i != r[in.c].i;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LessInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].i < r[in.c].i;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LessEqualInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].i <= r[in.c].i;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(GreaterInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].i > r[in.c].i;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(GreaterEqualInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].i >= r[in.c].i;
+		VM_DISPATCH();
+	}
+
+	// Comparisons are ordered, except inequality, that is negated equality
+	VM_HANDLER(EqualFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].f == r[in.c].f;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(NotEqualFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = !(r[in.b].f == r[in.c].f);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LessFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].f < r[in.c].f;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LessEqualFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].f <= r[in.c].f;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(GreaterFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].f > r[in.c].f;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(GreaterEqualFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].f >= r[in.c].f;
+		VM_DISPATCH();
+	}
+
+	VM_HANDLER(Not)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = !r[in.b].i;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(IntToBool)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = r[in.b].i != 0;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(FloatToBool)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = !(r[in.b].f == 0.0);
+		VM_DISPATCH();
+	}
+	// Int is converted as unsigned, like in generated code
+	VM_HANDLER(IntToFloat)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = double(uint32_t(r[in.b].i));
+		VM_DISPATCH();
+	}
+	VM_HANDLER(FloatToInt)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = int32_t(uint32_t(int64_t(r[in.b].f)));
+		VM_DISPATCH();
+	}
+
+	VM_HANDLER(LoadByte)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = LoadElement<uint8_t>(r[in.b].p, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LoadInt32)
+	{
+		const Instruction in = *pc++;
+		r[in.a].i = LoadElement<int32_t>(r[in.b].p, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LoadDouble)
+	{
+		const Instruction in = *pc++;
+		r[in.a].f = LoadElement<double>(r[in.b].p, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(LoadPointer)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = LoadElement<char*>(r[in.b].p, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(StoreByte)
+	{
+		const Instruction in = *pc++;
+		StoreElement<uint8_t>(r[in.a].p, r[in.b].i, uint8_t(r[in.c].i));
+		VM_DISPATCH();
+	}
+	VM_HANDLER(StoreInt32)
+	{
+		const Instruction in = *pc++;
+		StoreElement<int32_t>(r[in.a].p, r[in.b].i, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(StoreDouble)
+	{
+		const Instruction in = *pc++;
+		StoreElement<double>(r[in.a].p, r[in.b].i, r[in.c].f);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(StorePointer)
+	{
+		const Instruction in = *pc++;
+		StoreElement<char*>(r[in.a].p, r[in.b].i, r[in.c].p);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(AddressByte)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = GetElementAddress<uint8_t>(r[in.b].p, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(AddressInt32)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = GetElementAddress<int32_t>(r[in.b].p, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(AddressDouble)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = GetElementAddress<double>(r[in.b].p, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(AddressPointer)
+	{
+		const Instruction in = *pc++;
+		r[in.a].p = GetElementAddress<char*>(r[in.b].p, r[in.c].i);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(MemMove)
+	{
+		const Instruction in = *pc++;
+		std::memmove(r[in.a].p, r[in.b].p, size_t(uint32_t(r[in.c].i)));
+		VM_DISPATCH();
+	}
+	VM_HANDLER(CheckExtent)
+	{
+		const Instruction in = *pc++;
+		if (uint32_t(r[in.a].i) != GetImmediate(in))
+		{
+			throw std::runtime_error("size of array literal differs from the size of assigned row in function '" + function->name + "'");
+		}
+		VM_DISPATCH();
+	}
+
+	VM_HANDLER(Jump)
+	{
+		pc = code + GetImmediate(*pc);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(JumpIfTrue)
+	{
+		pc = r[pc->a].i ? code + GetImmediate(*pc) : pc + 1;
+		VM_DISPATCH();
+	}
+	VM_HANDLER(JumpIfFalse)
+	{
+		pc = r[pc->a].i ? pc + 1 : code + GetImmediate(*pc);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(Loop)
+	{
+		if (!r[pc->a].i)
+		{
+			++pc;
+			VM_DISPATCH();
+		}
+		if (profile)
+		{
+			profile->CountBackEdge(size_t(function - program.functions.data()));
+		}
+		pc = code + GetImmediate(*pc);
+		VM_DISPATCH();
+	}
+
+	// Window of the callee starts at its arguments, native entry takes them from there too
+	VM_HANDLER(Call)
+	{
+		const Instruction in = *pc++;
+		const uint32_t index = GetImmediate(in);
+		if (profile)
+		{
+			if (TieringProfile::NativeEntry entry = profile->GetNativeEntry(index))
+			{
+				entry(r + in.a);
+				VM_DISPATCH();
+			}
+			profile->CountCall(index);
+		}
+
+		const BytecodeFunction& callee = program.functions[index];
+		frames.push_back({ function, pc, base, frameMemory, memory.GetMark() });
+
+		base += in.a;
+		if (base + callee.registerCount > registers.size())
+		{
+			registers.resize(std::max(registers.size() * 2, base + callee.registerCount));
+		}
+		r = registers.data() + base;
+
+		function = &callee;
+		code = callee.code.data();
+		pc = code;
+		frameMemory = memory.Allocate(callee.memorySize);
+		VM_DISPATCH();
+	}
+	// Result is moved to the first registers of the window, where the caller expects it
+	VM_HANDLER(Return)
+	{
+		const Instruction in = *pc;
+		std::memmove(r, r + in.a, in.b * sizeof(Value));
+		if (frames.empty())
+		{
+			return in.b != 0 ? r[0].i : 0;
+		}
+
+		const CallFrame& caller = frames.back();
+		memory.Release(caller.memoryMark);
+		function = caller.function;
+		code = function->code.data();
+		pc = caller.returnAddress;
+		base = caller.base;
+		frameMemory = caller.memory;
+		r = registers.data() + base;
+		frames.pop_back();
+		VM_DISPATCH();
+	}
+
+	VM_HANDLER(Print)
+	{
+		const Instruction in = *pc++;
+		Print(r[in.a].p, r + in.a + 1, program.signatures[in.c]);
+		VM_DISPATCH();
+	}
+	VM_HANDLER(Scan)
+	{
+		const Instruction in = *pc++;
+		Scan(r[in.a].p, r + in.a + 1, size_t(in.b - 1));
+		VM_DISPATCH();
+	}
+
+#if !defined(__GNUC__)
+		default:
+			throw std::logic_error("undefined bytecode instruction");
+		}
+	}
+#endif
+#undef VM_HANDLER
+#undef VM_DISPATCH
+}
+}
+
+TieringProfile::TieringProfile(size_t functionCount, uint64_t threshold, HotFunctionHandler onHotFunction)
+	: m_functions(std::make_unique<FunctionProfile[]>(functionCount))
+	, m_threshold(threshold)
+	, m_onHotFunction(std::move(onHotFunction))
+{
+}
+
+void TieringProfile::InstallNativeEntry(size_t function, NativeEntry entry)
+{
+	m_functions[function].entry.store(entry, std::memory_order_release);
+}
+
+uint64_t TieringProfile::GetCallCount(size_t function)const
+{
+	return m_functions[function].calls;
+}
+
+uint64_t TieringProfile::GetBackEdgeCount(size_t function)const
+{
+	return m_functions[function].backEdges;
+}
+
+uint64_t TieringProfile::GetThreshold()const
+{
+	return m_threshold;
+}
+
+int RunBytecode(const BytecodeProgram& program, const std::vector<std::string>& arguments, TieringProfile* profile)
+{
+	const BytecodeFunction& main = FindMain(program);
+
+	std::vector<char*> argv;
+	for (const std::string& argument : arguments)
+	{
+		argv.push_back(const_cast<char*>(argument.c_str()));
+	}
+	argv.push_back(nullptr);
+
+	return Execute(program, main, int(arguments.size()), argv.data(), profile);
+}
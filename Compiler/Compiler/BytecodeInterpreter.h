@@ -0,0 +1,72 @@
+#pragma once
+#include "Bytecode.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Profile of tiered execution, that is shared by the interpreter and the thread compiling hot functions.
+// Interpreter counts calls and loop back-edges of each function and reports the function as hot
+//  once, when their sum reaches the threshold. When native entry of the function is installed,
+//  the interpreter calls it instead of bytecode.
+class TieringProfile
+{
+public:
+	// Native entry reads arguments from the registers of the callee window and writes result over them
+	using NativeEntry = void(*)(void* registers);
+	using HotFunctionHandler = std::function<void(size_t function)>;
+
+	TieringProfile(size_t functionCount, uint64_t threshold, HotFunctionHandler onHotFunction);
+
+	// Can be called from any thread
+	void InstallNativeEntry(size_t function, NativeEntry entry);
+
+	// Counters are updated without synchronization, they must be read after the run
+	uint64_t GetCallCount(size_t function)const;
+	uint64_t GetBackEdgeCount(size_t function)const;
+	uint64_t GetThreshold()const;
+
+	// Used by the interpreter
+	NativeEntry GetNativeEntry(size_t function)const
+	{
+		return m_functions[function].entry.load(std::memory_order_acquire);
+	}
+
+	void CountCall(size_t function)
+	{
+		FunctionProfile& profile = m_functions[function];
+		if (++profile.calls + profile.backEdges == m_threshold)
+		{
+			m_onHotFunction(function);
+		}
+	}
+
+	void CountBackEdge(size_t function)
+	{
+		FunctionProfile& profile = m_functions[function];
+		if (profile.calls + ++profile.backEdges == m_threshold)
+		{
+			m_onHotFunction(function);
+		}
+	}
+
+private:
+	struct FunctionProfile
+	{
+		uint64_t calls = 0;
+		uint64_t backEdges = 0;
+		std::atomic<NativeEntry> entry{ nullptr };
+	};
+
+private:
+	std::unique_ptr<FunctionProfile[]> m_functions;
+	uint64_t m_threshold;
+	HotFunctionHandler m_onHotFunction;
+};
+
+// Executes main of the bytecode program, like JitEngine::RunMain: main may be declared without
+//  parameters or with (argc: Int, argv: Array<String>), arguments are passed as argv.
+// Returns result of main or 0 if it returns nothing; integer division by zero throws std::runtime_error.
+// With the profile, calls and back-edges are counted and installed native entries are used
+int RunBytecode(const BytecodeProgram& program, const std::vector<std::string>& arguments, TieringProfile* profile = nullptr);
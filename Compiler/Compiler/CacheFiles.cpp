@@ -0,0 +1,77 @@
+#include "stdafx.h"
+#include "CacheFiles.h"
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace
+{
+// pruneCache only considers files with this prefix
+const char gcEntryPrefix[] = "llvmcache-";
+}
+
+std::string GetCacheEntryPath(const std::string& directory, llvm::MD5& hash, llvm::StringRef extension)
+{
+	llvm::MD5::MD5Result result;
+	hash.final(result);
+
+	llvm::SmallString<128> path(directory);
+	llvm::sys::path::append(path, llvm::Twine(gcEntryPrefix) + result.digest() + extension);
+	return path.str().str();
+}
+
+std::unique_ptr<llvm::MemoryBuffer> ReadCacheEntry(const std::string& path)
+{
+	int fd = -1;
+	if (llvm::sys::fs::openFileForRead(path, fd, llvm::sys::fs::OF_UpdateAtime))
+	{
+		return nullptr;
+	}
+
+	// Access time is the age of entry for pruning, it's updated explicitly
+	//  because file systems usually don't update it on every read
+	llvm::sys::fs::setLastModificationAndAccessTime(fd, std::chrono::system_clock::now());
+	auto buffer = llvm::MemoryBuffer::getOpenFile(fd, path, -1, false);
+	llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+
+	if (!buffer)
+	{
+		return nullptr;
+	}
+	return std::move(*buffer);
+}
+
+bool WriteCacheEntry(const std::string& directory, const std::string& path, llvm::StringRef data)
+{
+	if (llvm::sys::fs::create_directories(directory))
+	{
+		return false;
+	}
+
+	int fd = -1;
+	llvm::SmallString<128> tmpPath;
+	if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, tmpPath))
+	{
+		return false;
+	}
+
+	{
+		llvm::raw_fd_ostream out(fd, true);
+		out.write(data.data(), data.size());
+		out.close();
+		if (out.has_error())
+		{
+			out.clear_error();
+			llvm::sys::fs::remove(tmpPath);
+			return false;
+		}
+	}
+
+	if (llvm::sys::fs::rename(tmpPath, path))
+	{
+		llvm::sys::fs::remove(tmpPath);
+		return false;
+	}
+	return true;
+}
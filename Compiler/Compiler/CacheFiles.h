@@ -0,0 +1,23 @@
+#pragma once
+#include <memory>
+#include <string>
+
+#pragma warning(push, 0)
+#pragma warning(disable: 4146)
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#pragma warning(pop)
+
+// Files of on-disk caches, pruned by llvm::pruneCache.
+// Failures are reported by the result, caches ignore them.
+
+// Path of the entry named by hash of its key, that is finalized here
+std::string GetCacheEntryPath(const std::string& directory, llvm::MD5& hash, llvm::StringRef extension);
+
+// Returns nullptr if there is no entry, otherwise makes it the most recently used one
+std::unique_ptr<llvm::MemoryBuffer> ReadCacheEntry(const std::string& path);
+
+// Entry is written to a unique temporary file and then renamed,
+//  so concurrent runs never see partially written entry
+bool WriteCacheEntry(const std::string& directory, const std::string& path, llvm::StringRef data);
@@ -0,0 +1,99 @@
+#include "stdafx.h"
+#include "CallGraph.h"
+
+CallGraph::CallGraph(const FlatAST& ast)
+	: m_callees(ast.GetFunctionsCount())
+{
+	// Names are interned, so the callee is found by index of its name
+	const size_t npos = ast.GetFunctionsCount();
+	std::vector<size_t> functionsByName(ast.GetNamesCount(), npos);
+	for (size_t i = 0; i < ast.GetFunctionsCount(); ++i)
+	{
+		const FlatAST::Index name = ast.GetFunction(FlatAST::Index(i)).name;
+		m_indices.emplace(ast.GetName(name), i);
+		if (functionsByName[name] == npos)
+		{
+			functionsByName[name] = i;
+		}
+	}
+
+	for (size_t i = 0; i < ast.GetFunctionsCount(); ++i)
+	{
+		const FlatAST::Function& function = ast.GetFunction(FlatAST::Index(i));
+		std::vector<size_t>& callees = m_callees[i];
+
+		// Call statement has its call expression as a child, so only expressions are checked
+		const FlatAST::Index end = function.expressionsBegin + function.expressionsCount;
+		for (FlatAST::Index index = function.expressionsBegin; index < end; ++index)
+		{
+			const FlatAST::Expression& node = ast.GetExpression(index);
+			if (node.kind == FlatAST::ExpressionKind::FunctionCall && functionsByName[node.first] != npos)
+			{
+				callees.push_back(functionsByName[node.first]);
+			}
+		}
+
+		std::sort(callees.begin(), callees.end());
+		callees.erase(std::unique(callees.begin(), callees.end()), callees.end());
+	}
+}
+
+size_t CallGraph::GetFunctionsCount()const
+{
+	return m_callees.size();
+}
+
+boost::optional<size_t> CallGraph::FindFunction(const std::string& name)const
+{
+	auto found = m_indices.find(name);
+	if (found == m_indices.end())
+	{
+		return boost::none;
+	}
+	return found->second;
+}
+
+const std::vector<size_t>& CallGraph::GetCallees(size_t function)const
+{
+	return m_callees.at(function);
+}
+
+std::vector<size_t> CallGraph::GetReachableFunctions(const std::vector<size_t>& roots)const
+{
+	std::vector<bool> reached(m_callees.size(), false);
+	std::vector<size_t> pending;
+
+	for (size_t root : roots)
+	{
+		if (!reached.at(root))
+		{
+			reached[root] = true;
+			pending.push_back(root);
+		}
+	}
+
+	while (!pending.empty())
+	{
+		const size_t function = pending.back();
+		pending.pop_back();
+
+		for (size_t callee : m_callees[function])
+		{
+			if (!reached[callee])
+			{
+				reached[callee] = true;
+				pending.push_back(callee);
+			}
+		}
+	}
+
+	std::vector<size_t> functions;
+	for (size_t i = 0; i < reached.size(); ++i)
+	{
+		if (reached[i])
+		{
+			functions.push_back(i);
+		}
+	}
+	return functions;
+}
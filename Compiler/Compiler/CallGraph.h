@@ -0,0 +1,25 @@
+#pragma once
+#include "../AST/FlatAST.h"
+#include <unordered_map>
+#include <vector>
+
+// Direct calls between functions of the program (both call expressions and call statements).
+// Functions are identified by their index in the program, calls are found by a linear scan of FlatAST.
+class CallGraph
+{
+public:
+	explicit CallGraph(const FlatAST& ast);
+
+	size_t GetFunctionsCount()const;
+	boost::optional<size_t> FindFunction(const std::string& name)const;
+
+	// Callees are unique and sorted, calls of undefined functions are not included
+	const std::vector<size_t>& GetCallees(size_t function)const;
+
+	// Roots and all functions, that are transitively called from them, in order of the program
+	std::vector<size_t> GetReachableFunctions(const std::vector<size_t>& roots)const;
+
+private:
+	std::unordered_map<std::string, size_t> m_indices;
+	std::vector<std::vector<size_t>> m_callees;
+};
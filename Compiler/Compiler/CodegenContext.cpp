@@ -37,15 +37,15 @@ llvm::Function* CreateScanfBuiltinFunction(CodegenUtils& utils)
 }
 
 CodegenUtils::CodegenUtils()
-	: m_context()
-	, m_builder(m_context)
-	, m_module("Module", m_context)
+	: m_context(std::make_unique<llvm::LLVMContext>())
+	, m_builder(*m_context)
+	, m_module(std::make_unique<llvm::Module>("Module", *m_context))
 {
 }
 
 llvm::LLVMContext& CodegenUtils::GetLLVMContext()
 {
-	return m_context;
+	return *m_context;
 }
 
 llvm::IRBuilder<>& CodegenUtils::GetBuilder()
@@ -55,41 +55,95 @@ llvm::IRBuilder<>& CodegenUtils::GetBuilder()
 
 llvm::Module& CodegenUtils::GetModule()
 {
-	return m_module;
+	return *m_module;
+}
+
+void CodegenUtils::ReleaseModule(std::unique_ptr<llvm::LLVMContext>& context, std::unique_ptr<llvm::Module>& module)
+{
+	assert(m_module);
+	module = std::move(m_module);
+	context = std::move(m_context);
 }
 
 CodegenContext::CodegenContext()
 	: m_utils()
-	, m_scopes()
+	, m_variables()
+	, m_allocaInsertPoint(nullptr)
+	, m_loopDepth(0)
 	, m_printf(CreatePrintfBuiltinFunction(m_utils))
 	, m_scanf(CreateScanfBuiltinFunction(m_utils))
 {
 }
 
-void CodegenContext::PushScope()
+void CodegenContext::ResetVariables(size_t count)
 {
-	m_scopes.PushScope();
+	m_variables.assign(count, nullptr);
 }
 
-void CodegenContext::PopScope()
+void CodegenContext::SetVariable(size_t index, llvm::AllocaInst* value)
 {
-	m_scopes.PopScope();
+	m_variables.at(index) = value;
 }
 
-void CodegenContext::Define(const std::string& name, llvm::AllocaInst* value)
+llvm::AllocaInst* CodegenContext::GetVariable(size_t index)
 {
-	m_scopes.Define(name, value);
+	return m_variables.at(index);
 }
 
-void CodegenContext::Assign(const std::string& name, llvm::AllocaInst* value)
+void CodegenContext::SetAllocaInsertPoint(llvm::Instruction* insertPoint)
 {
-	m_scopes.Assign(name, value);
+	m_allocaInsertPoint = insertPoint;
+}
+
+llvm::AllocaInst* CodegenContext::CreateEntryBlockAlloca(llvm::Type* type, const std::string& name)
+{
+	assert(m_allocaInsertPoint);
+	llvm::IRBuilder<> builder(m_allocaInsertPoint);
+	return builder.CreateAlloca(type, nullptr, name);
+}
+
+void CodegenContext::EnterLoop()
+{
+	++m_loopDepth;
+}
+
+void CodegenContext::LeaveLoop()
+{
+	--m_loopDepth;
+}
+
+llvm::AllocaInst* CodegenContext::CreateBufferAlloca(llvm::Type* type, const std::string& name, bool isShared)
+{
+	if (m_loopDepth == 0 || isShared)
+	{
+		return CreateEntryBlockAlloca(type, name);
+	}
+	return m_utils.GetBuilder().CreateAlloca(type, nullptr, name);
+}
+
+llvm::Constant* CodegenContext::GetConstantArray(llvm::Constant* initializer, const std::string& name)
+{
+	// Constants are uniqued by LLVM, so equal arrays have the same initializer
+	auto found = m_constantArrays.find(initializer);
+	if (found != m_constantArrays.end())
+	{
+		return found->second;
+	}
+
+	auto global = new llvm::GlobalVariable(m_utils.GetModule(), initializer->getType(), true,
+		llvm::GlobalValue::PrivateLinkage, initializer, name);
+	global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+
+	llvm::Constant* zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(m_utils.GetLLVMContext()), 0);
+	llvm::Constant* indices[] = { zero, zero };
+	llvm::Constant* pointer = llvm::ConstantExpr::getInBoundsGetElementPtr(initializer->getType(), global, indices);
+	m_constantArrays.emplace(initializer, pointer);
+	return pointer;
 }
 
-llvm::AllocaInst* CodegenContext::GetVariable(const std::string& name)
+llvm::Constant* CodegenContext::GetStringConstant(const std::string& str)
 {
-	auto variable = m_scopes.GetValue(name);
-	return variable.value_or(nullptr);
+	return GetConstantArray(llvm::ConstantDataArray::getString(m_utils.GetLLVMContext(), str, true), ".str");
 }
 
 llvm::Function* CodegenContext::GetPrintf()
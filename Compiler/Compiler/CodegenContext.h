@@ -1,6 +1,9 @@
 #pragma once
-#include "ScopeChain.h"
+#include <memory>
 #include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #pragma warning(push, 0)
 #pragma warning(disable: 4146)
@@ -30,10 +33,13 @@ public:
 	llvm::IRBuilder<>& GetBuilder();
 	llvm::Module& GetModule();
 
+	// Passes ownership of the module and its context, e.g. to the JIT; utils can't be used after that
+	void ReleaseModule(std::unique_ptr<llvm::LLVMContext>& context, std::unique_ptr<llvm::Module>& module);
+
 private:
-	llvm::LLVMContext m_context;
+	std::unique_ptr<llvm::LLVMContext> m_context;
 	llvm::IRBuilder<> m_builder;
-	llvm::Module m_module;
+	std::unique_ptr<llvm::Module> m_module;
 };
 
 class CodegenContext
@@ -41,16 +47,31 @@ class CodegenContext
 public:
 	CodegenContext();
 
-	void PushScope();
-	void PopScope();
-
-	void Define(const std::string& name, llvm::AllocaInst* value);
-	void Assign(const std::string& name, llvm::AllocaInst* value);
+	// Variables of the function being generated are numbered by semantic analysis
+	void ResetVariables(size_t count);
+	void SetVariable(size_t index, llvm::AllocaInst* value);
 
 	CodegenUtils& GetUtils();
 
-	//  nullptr,        
-	llvm::AllocaInst* GetVariable(const std::string& name);
+	// Allocas are inserted before the given instruction of entry block of the current function
+	void SetAllocaInsertPoint(llvm::Instruction* insertPoint);
+	llvm::AllocaInst* CreateEntryBlockAlloca(llvm::Type* type, const std::string& name);
+
+	// Buffers of array and string literals are stored to other arrays and outlive the iteration,
+	//  so in loops every evaluation allocates a new buffer at the insertion point, that is released
+	//  on return; buffers outside of loops and shared ones (see SemanticInfo::IsLiteralBufferShared)
+	//  are allocated in the entry block
+	void EnterLoop();
+	void LeaveLoop();
+	llvm::AllocaInst* CreateBufferAlloca(llvm::Type* type, const std::string& name, bool isShared);
+
+	//  nullptr,     
+	llvm::AllocaInst* GetVariable(size_t index);
+
+	// Each distinct constant array is emitted once as private constant global,
+	//  returns pointer to its first element
+	llvm::Constant* GetConstantArray(llvm::Constant* initializer, const std::string& name);
+	llvm::Constant* GetStringConstant(const std::string& str);
 
 	llvm::Function* GetPrintf();
 	llvm::Function* GetScanf();
@@ -63,11 +84,14 @@ public:
 
 private:
 	CodegenUtils m_utils;
-	ScopeChain<llvm::AllocaInst*> m_scopes;
+	std::vector<llvm::AllocaInst*> m_variables;
+	llvm::Instruction* m_allocaInsertPoint;
+	unsigned m_loopDepth;
 
 	// builtin functions
 	llvm::Function* m_printf;
 	llvm::Function* m_scanf;
 
 	std::unordered_map<std::string, llvm::Function*> m_functions; // user defined
+	std::unordered_map<llvm::Constant*, llvm::Constant*> m_constantArrays;
 };
@@ -1,75 +1,16 @@
 #include "stdafx.h"
 #include "CodegenVisitor.h"
+#include <algorithm>
+#include <functional>
+#include <numeric>
 
 namespace
 {
-// Function forward declaration
-ExpressionType ToExpressionType(llvm::Type* type);
-
-// My compiler supports 32 bit integers and booleans
-ExpressionType ToExpressionTypeFromInt(llvm::Type* type)
-{
-	if (type->getIntegerBitWidth() == 32)
-	{
-		return { ExpressionType::Int, 0 };
-	}
-	if (type->getIntegerBitWidth() == 1)
-	{
-		return { ExpressionType::Bool, 0 };
-	}
-	throw std::logic_error("llvm::Type have unsupported integer bit width");
-}
-
-// Expression type can be string or array, depending on passed llvm::Type
-ExpressionType ToExpressionTypeFromPtr(llvm::Type* type)
+// Multidimensional array is stored in one buffer in row-major order, its value is
+//  the pointer to the first element and sizes of all dimensions except the first one
+bool IsDenseArray(const ExpressionType& type)
 {
-	assert(type->isPointerTy());
-	llvm::Type* ptrElementType = type->getPointerElementType();
-
-	if (ptrElementType->getTypeID() == llvm::Type::IntegerTyID && ptrElementType->getIntegerBitWidth() == 8)
-	{
-		return { ExpressionType::String, 0 };
-	}
-	if (ptrElementType->getTypeID() == llvm::Type::IntegerTyID && ptrElementType->getIntegerBitWidth() == 32)
-	{
-		return { ExpressionType::Int, 1 };
-	}
-	if (ptrElementType->getTypeID() == llvm::Type::IntegerTyID && ptrElementType->getIntegerBitWidth() == 1)
-	{
-		return { ExpressionType::Bool, 1 };
-	}
-	if (ptrElementType->getTypeID() == llvm::Type::DoubleTyID)
-	{
-		return { ExpressionType::Float, 1 };
-	}
-
-	// Processing as multidimensional array
-	if (ptrElementType->isPointerTy())
-	{
-		const ExpressionType typeOfPtrElement = ToExpressionTypeFromPtr(ptrElementType);
-		return { typeOfPtrElement.value, typeOfPtrElement.nesting + 1 };
-	}
-
-	assert(false);
-	throw std::logic_error("can't find proper array ExpressionType for llvm::Type* pointer type");
-}
-
-// Function performs cast from llvm::Type to ExpressionType
-ExpressionType ToExpressionType(llvm::Type* type)
-{
-	if (type->isIntegerTy())
-	{
-		return ToExpressionTypeFromInt(type);
-	}
-	if (type->isDoubleTy())
-	{
-		return { ExpressionType::Float, 0 };
-	}
-	if (type->isPointerTy())
-	{
-		return ToExpressionTypeFromPtr(type);
-	}
-	throw std::logic_error("can't convert llvm::Type to ExpressionType");
+	return type.nesting >= 2;
 }
 
 // Function performs cast from ExpressionType to llvm::Type
@@ -77,9 +18,13 @@ llvm::Type* ToLLVMType(ExpressionType type, llvm::LLVMContext& context)
 {
 	if (type.nesting != 0)
 	{
-		ExpressionType typeOfStored = { type.value, type.nesting - 1 };
-		llvm::Type* typeOfStoredLLVM = ToLLVMType(typeOfStored, context);
-		return typeOfStoredLLVM->getPointerTo();
+		llvm::Type* pointerType = ToLLVMType({ type.value, 0 }, context)->getPointerTo();
+		if (!IsDenseArray(type))
+		{
+			return pointerType;
+		}
+		llvm::Type* extentsType = llvm::ArrayType::get(llvm::Type::getInt32Ty(context), type.nesting - 1);
+		return llvm::StructType::get(context, { pointerType, extentsType });
 	}
 
 	switch (type.value)
@@ -97,14 +42,14 @@ llvm::Type* ToLLVMType(ExpressionType type, llvm::LLVMContext& context)
 	throw std::logic_error("can't convert ExpressionType to llvm::Type");
 }
 
+// Type of the value is known from semantic analysis, strings and arrays are never casted
 llvm::Value* ConvertToIntegerValue(
 	llvm::Value* value,
+	ExpressionType type,
 	llvm::LLVMContext& llvmContext,
 	llvm::IRBuilder<>& builder)
 {
-	const ExpressionType type = ToExpressionType(value->getType());
-
-	// Strings and arrays can't be casted to integer
+	assert(type.nesting == 0);
 	switch (type.value)
 	{
 	case ExpressionType::Int:
@@ -114,18 +59,18 @@ llvm::Value* ConvertToIntegerValue(
 	case ExpressionType::Bool:
 		return builder.CreateIntCast(value, llvm::Type::getInt32Ty(llvmContext), false, "icasttmp");
 	default:
-		throw std::invalid_argument("can't cast array to integer");
+		assert(false);
+		throw std::logic_error("can't cast " + ToString(type) + " to integer");
 	}
 }
 
 llvm::Value* ConvertToFloatValue(
 	llvm::Value* value,
+	ExpressionType type,
 	llvm::LLVMContext& llvmContext,
 	llvm::IRBuilder<>& builder)
 {
-	const ExpressionType type = ToExpressionType(value->getType());
-
-	// Strings and arrays can't be casted to float
+	assert(type.nesting == 0);
 	switch (type.value)
 	{
 	case ExpressionType::Int:
@@ -134,18 +79,18 @@ llvm::Value* ConvertToFloatValue(
 	case ExpressionType::Float:
 		return value;
 	default:
-		throw std::invalid_argument("can't cast array to integer");
+		assert(false);
+		throw std::logic_error("can't cast " + ToString(type) + " to float");
 	}
 }
 
 llvm::Value* ConvertToBooleanValue(
 	llvm::Value* value,
+	ExpressionType type,
 	llvm::LLVMContext& llvmContext,
 	llvm::IRBuilder<>& builder)
 {
-	const ExpressionType type = ToExpressionType(value->getType());
-
-	// Strings and arrays can't be casted to bool
+	assert(type.nesting == 0);
 	switch (type.value)
 	{
 	case ExpressionType::Int:
@@ -157,30 +102,36 @@ llvm::Value* ConvertToBooleanValue(
 	case ExpressionType::Bool:
 		return value;
 	default:
-		throw std::invalid_argument("can't cast array to bool");
+		assert(false);
+		throw std::logic_error("can't cast " + ToString(type) + " to bool");
 	}
 }
 
-//? TODO:      , 
-//?     nullptr  
-//  nullptr,   ,  
-//        
+// Semantic analysis guarantees, that values of different types are numeric scalars
 llvm::Value* CastValue(
 	llvm::Value* value,
-	ExpressionType type,
+	ExpressionType from,
+	ExpressionType to,
 	llvm::LLVMContext& llvmContext,
 	llvm::IRBuilder<>& builder)
 {
-	switch (type.value)
+	if (from == to)
+	{
+		return value;
+	}
+
+	switch (to.value)
 	{
 	case ExpressionType::Int:
-		return ConvertToIntegerValue(value, llvmContext, builder);
+		return ConvertToIntegerValue(value, from, llvmContext, builder);
 	case ExpressionType::Float:
-		return ConvertToFloatValue(value, llvmContext, builder);
+		return ConvertToFloatValue(value, from, llvmContext, builder);
 	case ExpressionType::Bool:
-		return ConvertToBooleanValue(value, llvmContext, builder);
+		return ConvertToBooleanValue(value, from, llvmContext, builder);
+	default:
+		assert(false);
+		throw std::logic_error("can't cast " + ToString(from) + " to " + ToString(to));
 	}
-	return nullptr;
 }
 
 llvm::Value* CreateIntegerBinaryExpression(
@@ -190,22 +141,16 @@ llvm::Value* CreateIntegerBinaryExpression(
 	llvm::LLVMContext& llvmContext,
 	llvm::IRBuilder<>& builder)
 {
-#ifdef _DEBUG
-	const ExpressionType ltype = ToExpressionType(left->getType());
-	const ExpressionType rtype = ToExpressionType(right->getType());
-	assert(ltype.value == ExpressionType::Int && rtype.value == ExpressionType::Int);
-#endif
-
 	switch (operation)
 	{
 	case BinaryExpressionAST::Or:
 		return builder.CreateOr(
-			ConvertToBooleanValue(left, llvmContext, builder), 
-			ConvertToBooleanValue(right, llvmContext, builder), "ortmp");
+			ConvertToBooleanValue(left, { ExpressionType::Int, 0 }, llvmContext, builder),
+			ConvertToBooleanValue(right, { ExpressionType::Int, 0 }, llvmContext, builder), "ortmp");
 	case BinaryExpressionAST::And:
 		return builder.CreateAnd(
-			ConvertToBooleanValue(left, llvmContext, builder),
-			ConvertToBooleanValue(right, llvmContext, builder), "andtmp");
+			ConvertToBooleanValue(left, { ExpressionType::Int, 0 }, llvmContext, builder),
+			ConvertToBooleanValue(right, { ExpressionType::Int, 0 }, llvmContext, builder), "andtmp");
 	case BinaryExpressionAST::Equals:
 		return builder.CreateICmpEQ(left, right, "eqtmp");
 	case BinaryExpressionAST::NotEquals:
@@ -241,22 +186,16 @@ llvm::Value* CreateFloatBinaryExpression(
 	llvm::LLVMContext& llvmContext,
 	llvm::IRBuilder<>& builder)
 {
-#ifdef _DEBUG
-	const ExpressionType ltype = ToExpressionType(left->getType());
-	const ExpressionType rtype = ToExpressionType(right->getType());
-	assert(ltype.value == ExpressionType::Float && rtype.value == ExpressionType::Float);
-#endif
-
 	switch (operation)
 	{
 	case BinaryExpressionAST::Or:
 		return builder.CreateOr(
-			ConvertToBooleanValue(left, llvmContext, builder),
-			ConvertToBooleanValue(right, llvmContext, builder), "ortmp");
+			ConvertToBooleanValue(left, { ExpressionType::Float, 0 }, llvmContext, builder),
+			ConvertToBooleanValue(right, { ExpressionType::Float, 0 }, llvmContext, builder), "ortmp");
 	case BinaryExpressionAST::And:
 		return builder.CreateAnd(
-			ConvertToBooleanValue(left, llvmContext, builder),
-			ConvertToBooleanValue(right, llvmContext, builder), "andtmp");
+			ConvertToBooleanValue(left, { ExpressionType::Float, 0 }, llvmContext, builder),
+			ConvertToBooleanValue(right, { ExpressionType::Float, 0 }, llvmContext, builder), "andtmp");
 	case BinaryExpressionAST::Equals:
 		return builder.CreateFCmpOEQ(left, right, "eqtmp");
 	case BinaryExpressionAST::NotEquals:
@@ -292,12 +231,6 @@ llvm::Value* CreateBooleanBinaryExpression(
 	llvm::LLVMContext&,
 	llvm::IRBuilder<> & builder)
 {
-#ifdef _DEBUG
-	const ExpressionType ltype = ToExpressionType(left->getType());
-	const ExpressionType rtype = ToExpressionType(right->getType());
-	assert(ltype.value == ExpressionType::Bool && rtype.value == ExpressionType::Bool);
-#endif
-
 	switch (operation)
 	{
 	case BinaryExpressionAST::Or:
@@ -321,17 +254,93 @@ llvm::Value* CreateBooleanBinaryExpression(
 	case BinaryExpressionAST::Mul:
 	case BinaryExpressionAST::Div:
 	case BinaryExpressionAST::Mod:
-		throw std::runtime_error("can't perform codegen for operator '" + ToString(operation) + "' on two booleans");
+		break;
 	}
 
 	assert(false);
 	throw std::logic_error("undefined BinaryExpressionAST::Operator in CreateBooleanBinaryExpression");
 }
 
+llvm::Value* CodegenBinaryExpression(
+	BinaryExpressionAST::Operator operation,
+	llvm::Value* left,
+	ExpressionType leftType,
+	llvm::Value* right,
+	ExpressionType rightType,
+	llvm::LLVMContext& llvmContext,
+	llvm::IRBuilder<>& builder)
+{
+	//         :
+	//  1.    ,        ,
+	//                     
+	//  2.       .   ,  
+	//          .   ,        (  )
+	const auto castType = GetPreferredType(leftType, rightType);
+	assert(castType);
+
+	// TODO: produce warning, when operands are casted
+	left = CastValue(left, leftType, *castType, llvmContext, builder);
+	right = CastValue(right, rightType, *castType, llvmContext, builder);
+
+	switch (castType->value)
+	{
+	case ExpressionType::Int:
+		return CreateIntegerBinaryExpression(left, right, operation, llvmContext, builder);
+	case ExpressionType::Float:
+		return CreateFloatBinaryExpression(left, right, operation, llvmContext, builder);
+	case ExpressionType::Bool:
+		return CreateBooleanBinaryExpression(left, right, operation, llvmContext, builder);
+	default:
+		assert(false);
+		throw std::logic_error("can't codegen binary operator '" + ToString(operation) + "' for " + ToString(*castType));
+	}
+}
+
+// Right operand of && and || is evaluated eagerly (without branches) only if it is small
+//  and can't trap or have side effects: division, array access and calls are guarded by left operand
+bool CanEvaluateEagerly(const IExpressionAST& node)
+{
+	const size_t maxNodesCount = 8;
+
+	std::vector<const IExpressionAST*> nodes = { &node };
+	for (size_t count = 0; !nodes.empty(); ++count)
+	{
+		const IExpressionAST* current = nodes.back();
+		nodes.pop_back();
+		if (count == maxNodesCount)
+		{
+			return false;
+		}
+
+		switch (current->GetKind())
+		{
+		case ExpressionKind::Literal:
+		case ExpressionKind::Identifier:
+			break;
+		case ExpressionKind::Unary:
+			nodes.push_back(&static_cast<const UnaryAST*>(current)->GetExpr());
+			break;
+		case ExpressionKind::Binary:
+		{
+			const auto binary = static_cast<const BinaryExpressionAST*>(current);
+			if (binary->GetOperator() == BinaryExpressionAST::Div || binary->GetOperator() == BinaryExpressionAST::Mod)
+			{
+				return false;
+			}
+			nodes.push_back(&binary->GetLeft());
+			nodes.push_back(&binary->GetRight());
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
 // Codegen arithmetic value negation
-llvm::Value* CodegenNegativeValue(llvm::Value* value, llvm::IRBuilder<>& builder)
+llvm::Value* CodegenNegativeValue(llvm::Value* value, ExpressionType type, llvm::IRBuilder<>& builder)
 {
-	const ExpressionType type = ToExpressionType(value->getType());
 	switch (type.value)
 	{
 	case ExpressionType::Int:
@@ -341,29 +350,55 @@ llvm::Value* CodegenNegativeValue(llvm::Value* value, llvm::IRBuilder<>& builder
 	case ExpressionType::Bool:
 		return builder.CreateNeg(value, "bnegtmp");
 	default:
-		throw std::runtime_error("can't codegen negative value of " + ToString(type) + " type");
+		assert(false);
+		throw std::logic_error("can't codegen negative value of " + ToString(type) + " type");
 	}
 }
 
 // Codegen boolean value negation
 llvm::Value* CreateValueNegation(
 	llvm::Value* value,
+	ExpressionType type,
 	llvm::LLVMContext& llvmContext,
 	llvm::IRBuilder<>& builder)
 {
-	return builder.CreateNot(ConvertToBooleanValue(value, llvmContext, builder));
+	return builder.CreateNot(ConvertToBooleanValue(value, type, llvmContext, builder));
 }
 
-llvm::Value* CreateDefaultValue(
-	ExpressionType type,
-	llvm::LLVMContext& llvmContext,
-	llvm::IRBuilder<>& builder)
+// Copies constant global array to the stack, returns pointer to the first element of the copy
+llvm::Value* CreateMutableCopy(llvm::Constant* source, llvm::ArrayType* arrayType, const std::string& name, bool isShared,
+	CodegenContext& context)
+{
+	llvm::IRBuilder<>& builder = context.GetUtils().GetBuilder();
+
+	llvm::AllocaInst* allocaInst = context.CreateBufferAlloca(arrayType, name, isShared);
+	llvm::Value* copy = builder.CreateBitCast(allocaInst, source->getType(), name + "_ptr");
+	builder.CreateMemCpy(copy, 1, source, 1, llvm::ConstantExpr::getSizeOf(arrayType));
+	return copy;
+}
+
+// String literals are shared by all evaluations unless the program modifies strings,
+//  then each evaluation gets its own copy on the stack: a copy outside of loops is made once per call,
+//  in loops every iteration makes a new one, unless the copy is shared (see CodegenContext::CreateBufferAlloca)
+llvm::Value* CreateStringValue(const std::string& str, bool writable, bool isShared, CodegenContext& context)
+{
+	llvm::Constant* constant = context.GetStringConstant(str);
+	if (!writable)
+	{
+		return constant;
+	}
+
+	llvm::Type* i8 = llvm::Type::getInt8Ty(context.GetUtils().GetLLVMContext());
+	return CreateMutableCopy(constant, llvm::ArrayType::get(i8, str.length() + 1), "str_alloc", isShared, context);
+}
+
+llvm::Value* CreateDefaultValue(ExpressionType type, bool writableStrings, CodegenContext& context)
 {
+	llvm::LLVMContext& llvmContext = context.GetUtils().GetLLVMContext();
+
 	if (type.nesting != 0)
 	{
-		const ExpressionType subtype = { type.value, type.nesting - 1 };
-		llvm::Value* subvalue = CreateDefaultValue(subtype, llvmContext, builder);
-		return llvm::Constant::getNullValue(subvalue->getType()->getPointerTo());
+		return llvm::Constant::getNullValue(ToLLVMType(type, llvmContext));
 	}
 
 	switch (type.value)
@@ -375,195 +410,248 @@ llvm::Value* CreateDefaultValue(
 	case ExpressionType::Bool:
 		return llvm::ConstantInt::get(llvm::Type::getInt1Ty(llvmContext), uint64_t(0));
 	case ExpressionType::String:
-	{
-		llvm::Type* i8 = llvm::Type::getInt8Ty(llvmContext);
-		llvm::ArrayType* arrayType = llvm::ArrayType::get(i8, 1);
-		llvm::AllocaInst* allocaInst = builder.CreateAlloca(arrayType, nullptr, "str_alloc");
-
-		//     
-		std::vector<llvm::Constant*> constants = { llvm::ConstantInt::get(llvm::Type::getInt8Ty(llvmContext), uint64_t(0)) };
-		llvm::Constant* arr = llvm::ConstantArray::get(arrayType, constants);
-
-		llvm::StoreInst* storeInst = builder.CreateStore(arr, allocaInst);
-		(void)storeInst;
-
-		return builder.CreateBitCast(allocaInst, llvm::Type::getInt8PtrTy(llvmContext), "str_to_i8_ptr");
-	}
+		// Empty string has no elements to write, so its copy is never changed and can be shared
+		return CreateStringValue("", writableStrings, true, context);
 	default:
 		assert(false);
 		throw std::logic_error("can't codegen default value for undefined ExpressionType");
 	}
 }
 
-class ContextScopeHelper
+// Distinct loop identifier, that loop passes use to attach their hints to the loop
+llvm::MDNode* CreateLoopID(llvm::LLVMContext& llvmContext)
+{
+	llvm::TempMDTuple temporary = llvm::MDNode::getTemporary(llvmContext, llvm::None);
+	llvm::MDNode* loopID = llvm::MDNode::getDistinct(llvmContext, { temporary.get() });
+	loopID->replaceOperandWith(0, loopID);
+	return loopID;
+}
+
+// Elements of multidimensional array literal are enumerated in row-major order
+const IExpressionAST& GetArrayLiteralElement(const LiteralConstantAST& node, const std::vector<unsigned>& extents, size_t index)
+{
+	size_t stride = std::accumulate(extents.begin() + 1, extents.end(), size_t(1), std::multiplies<size_t>());
+	const LiteralConstantAST* literal = &node;
+	for (size_t dimension = 0; ; ++dimension)
+	{
+		const auto& elements = boost::get<std::vector<std::shared_ptr<IExpressionAST>>>(literal->GetValue());
+		const IExpressionAST& element = *elements[index / stride];
+		if (dimension + 1 == extents.size())
+		{
+			return element;
+		}
+		index %= stride;
+		stride /= extents[dimension + 1];
+		literal = static_cast<const LiteralConstantAST*>(&element);
+	}
+}
+
+// Returns pointer to the first element of sub-array of dense array, that is selected by the given indices
+llvm::Value* CreateDenseElementPtr(
+	llvm::Value* array,
+	unsigned nesting,
+	llvm::ArrayRef<llvm::Value*> indices,
+	llvm::IRBuilder<>& builder)
 {
-public:
-	explicit ContextScopeHelper(CodegenContext& context)
-		: m_context(context)
+	assert(!indices.empty() && indices.size() <= nesting);
+	llvm::Value* offset = indices[0];
+	for (unsigned dimension = 1; dimension < nesting; ++dimension)
 	{
-		m_context.PushScope();
+		llvm::Value* extent = builder.CreateExtractValue(array, { 1, dimension - 1 }, "extent");
+		offset = builder.CreateNSWMul(offset, extent, "offset");
+		if (dimension < indices.size())
+		{
+			offset = builder.CreateNSWAdd(offset, indices[dimension], "offset");
+		}
 	}
+	llvm::Value* data = builder.CreateExtractValue(array, { 0 }, "data");
+	return builder.CreateInBoundsGEP(data, offset, "element_ptr");
+}
 
-	~ContextScopeHelper()
+// Value of sub-array of dense array, selected by the given count of indices and starting at the given pointer
+llvm::Value* CreateDenseSubArray(
+	llvm::Value* array,
+	unsigned nesting,
+	unsigned indexCount,
+	llvm::Value* pointer,
+	llvm::LLVMContext& llvmContext,
+	llvm::IRBuilder<>& builder)
+{
+	if (nesting - indexCount == 1)
 	{
-		m_context.PopScope();
+		return pointer;
 	}
 
-private:
-	CodegenContext& m_context;
-};
+	llvm::Type* extentsType = llvm::ArrayType::get(llvm::Type::getInt32Ty(llvmContext), nesting - indexCount - 1);
+	llvm::Value* subArray = llvm::UndefValue::get(llvm::StructType::get(llvmContext, { pointer->getType(), extentsType }));
+	subArray = builder.CreateInsertValue(subArray, pointer, { 0 });
+	for (unsigned i = 0; i + indexCount + 1 < nesting; ++i)
+	{
+		llvm::Value* extent = builder.CreateExtractValue(array, { 1, indexCount + i }, "extent");
+		subArray = builder.CreateInsertValue(subArray, extent, { 1, i });
+	}
+	return subArray;
+}
 }
 
 // Expression codegen visitor
-ExpressionCodegen::ExpressionCodegen(CodegenContext& context)
+ExpressionCodegen::ExpressionCodegen(CodegenContext& context, const SemanticInfo& info, const SemanticInfo::Function& func)
 	: m_context(context)
-	, m_stack()
+	, m_info(info)
+	, m_func(func)
 {
 }
 
 llvm::Value* ExpressionCodegen::Visit(const IExpressionAST& node)
 {
-	node.Accept(*this);
-	if (!m_stack.empty())
-	{
-		llvm::Value* value = m_stack.back();
-		m_stack.pop_back();
-		return value;
-	}
-	throw std::logic_error("internal error while generating code for expression");
-}
+	const size_t base = m_frames.size();
+	m_frames.push_back({ &node, 0, nullptr, {}, nullptr });
 
-llvm::Value* ExpressionCodegen::GenerateFunctionCall(const FunctionCallExpressionAST& node)
-{
-	CodegenUtils& utils = m_context.GetUtils();
-	llvm::IRBuilder<>& builder = utils.GetBuilder();
-	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
+	// Value of the last completed node, it is passed to its parent
+	llvm::Value* value = nullptr;
 
-	llvm::Function* func = m_context.GetFunction(node.GetName());
-	if (!func)
+	try
 	{
-		throw std::runtime_error("calling function '" + node.GetName() + "' that isn't defined");
+		while (m_frames.size() > base)
+		{
+			Frame& frame = m_frames.back();
+			if (const IExpressionAST* child = ExpressionVisitor::Visit(*frame.node, frame, value))
+			{
+				m_frames.push_back({ child, 0, nullptr, {}, nullptr });
+				value = nullptr;
+			}
+			else
+			{
+				value = frame.value;
+				m_frames.pop_back();
+			}
+		}
 	}
-
-	if (func->arg_size() != node.GetParamsCount())
+	catch (...)
 	{
-		boost::format fmt("function '%1%' expects %2% params, %3% given");
-		throw std::runtime_error((fmt % node.GetName() % func->arg_size() % node.GetParamsCount()).str());
+		m_frames.erase(m_frames.begin() + base, m_frames.end());
+		throw;
 	}
 
-	size_t index = 0;
-	std::vector<llvm::Value*> params;
+	return value;
+}
 
-	for (llvm::Argument& arg : func->args())
-	{
-		llvm::Value* value = Visit(node.GetParam(index));
+const IExpressionAST* ExpressionCodegen::Visit(const BinaryExpressionAST& node, Frame& frame, llvm::Value* child)
+{
+	const BinaryExpressionAST::Operator operation = node.GetOperator();
+	const bool isLogical = operation == BinaryExpressionAST::And || operation == BinaryExpressionAST::Or;
 
-		if (ToExpressionType(value->getType()) != ToExpressionType(arg.getType()))
+	switch (frame.step++)
+	{
+	case 0:
+		return &node.GetLeft();
+	case 1:
+		frame.value = child;
+		if (isLogical && !CanEvaluateEagerly(node.GetRight()))
 		{
-			llvm::Value* casted = CastValue(value, ToExpressionType(arg.getType()), llvmContext, builder);
-			if (!casted)
-			{
-				auto fmt = boost::format("function '%1%' expects '%2%' as parameter, '%3%' given (can't cast)")
-					% func->getName().str()
-					% ToString(ToExpressionType(arg.getType()))
-					% ToString(ToExpressionType(value->getType()));
-				throw std::runtime_error(fmt.str());
-			}
-
-			assert(ToExpressionType(casted->getType()) == ToExpressionType(arg.getType()));
-			params.push_back(casted);
-			++index;
-			continue;
+			BeginShortCircuit(node, frame, child);
 		}
-
-		assert(ToExpressionType(value->getType()) == ToExpressionType(arg.getType()));
-		params.push_back(value);
-		++index;
+		return &node.GetRight();
+	default:
+		break;
 	}
 
-	if (func->getReturnType()->getTypeID() == llvm::Type::VoidTyID)
+	if (frame.endBlock)
 	{
-		builder.CreateCall(func, params);
+		EndShortCircuit(node, frame, child);
 		return nullptr;
 	}
 
-	return builder.CreateCall(func, params, "calltmp");
+	CodegenUtils& utils = m_context.GetUtils();
+	frame.value = CodegenBinaryExpression(
+		node.GetOperator(),
+		frame.value, m_info.GetType(node.GetLeft()),
+		child, m_info.GetType(node.GetRight()),
+		utils.GetLLVMContext(), utils.GetBuilder());
+	return nullptr;
 }
 
-void ExpressionCodegen::Visit(const BinaryExpressionAST& node)
+// Right operand of && and || is generated in its own block, that is skipped, when left operand decides the result
+void ExpressionCodegen::BeginShortCircuit(const BinaryExpressionAST& node, Frame& frame, llvm::Value* left)
 {
 	CodegenUtils& utils = m_context.GetUtils();
-
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
-	llvm::Value* left = Visit(node.GetLeft());
-	llvm::Value* right = Visit(node.GetRight());
-
-	//         :
-	//  1.    ,        ,
-	//                     
-	//  2.       .   ,  
-	//          .   ,        (  )
-
-	if (ToExpressionType(left->getType()) != ToExpressionType(right->getType()))
-	{
-		const auto castType = GetPreferredType(
-			ToExpressionType(left->getType()),
-			ToExpressionType(right->getType()));
-
-		if (!castType)
+	const bool isAnd = node.GetOperator() == BinaryExpressionAST::And;
+	llvm::Function* func = builder.GetInsertBlock()->getParent();
+	llvm::BasicBlock* rightBlock = llvm::BasicBlock::Create(llvmContext, "rhs", func);
+	frame.endBlock = llvm::BasicBlock::Create(llvmContext, "logicend");
+
+	// Chain of the same operators (a && b && c) jumps to the end of the outermost one directly,
+	//  instead of testing result of each nested operator again
+	auto leftPhi = llvm::dyn_cast<llvm::PHINode>(left);
+	const auto& leftNode = node.GetLeft();
+	if (leftPhi && leftPhi->use_empty() && leftNode.GetKind() == ExpressionKind::Binary &&
+		static_cast<const BinaryExpressionAST&>(leftNode).GetOperator() == node.GetOperator() &&
+		leftPhi->getParent() == builder.GetInsertBlock() && &leftPhi->getParent()->front() == leftPhi)
+	{
+		llvm::BasicBlock* leftEnd = leftPhi->getParent();
+		for (unsigned i = 0; i < leftPhi->getNumIncomingValues(); ++i)
 		{
-			const auto fmt = boost::format("can't codegen operator '%1%' on operands with types '%2%' and '%3%'")
-				% ToString(node.GetOperator())
-				% ToString(ToExpressionType(left->getType()))
-				% ToString(ToExpressionType(right->getType()));
-			throw std::runtime_error(fmt.str());
+			llvm::BasicBlock* predecessor = leftPhi->getIncomingBlock(i);
+			llvm::BranchInst* branch = llvm::cast<llvm::BranchInst>(predecessor->getTerminator());
+			if (branch->isConditional())
+			{
+				branch->replaceUsesOfWith(leftEnd, frame.endBlock);
+			}
+			else
+			{
+				// Last right operand of the chain
+				llvm::Value* value = leftPhi->getIncomingValue(i);
+				branch->eraseFromParent();
+				builder.SetInsertPoint(predecessor);
+				builder.CreateCondBr(value, isAnd ? rightBlock : frame.endBlock, isAnd ? frame.endBlock : rightBlock);
+			}
+			frame.values.push_back(predecessor);
 		}
+		leftPhi->eraseFromParent();
+		leftEnd->eraseFromParent();
+	}
+	else
+	{
+		const ExpressionType castType = *GetPreferredType(m_info.GetType(node.GetLeft()), m_info.GetType(node.GetRight()));
+		llvm::Value* value = ConvertToBooleanValue(
+			CastValue(left, m_info.GetType(node.GetLeft()), castType, llvmContext, builder), castType, llvmContext, builder);
+		builder.CreateCondBr(value, isAnd ? rightBlock : frame.endBlock, isAnd ? frame.endBlock : rightBlock);
+		frame.values.push_back(builder.GetInsertBlock());
+	}
+	builder.SetInsertPoint(rightBlock);
+}
 
-		switch (castType->value)
-		{
-		case ExpressionType::Int:
-			left = ConvertToIntegerValue(left, llvmContext, builder);
-			right = ConvertToIntegerValue(right, llvmContext, builder);
-			break;
-		case ExpressionType::Float:
-			left = ConvertToFloatValue(left, llvmContext, builder);
-			right = ConvertToFloatValue(right, llvmContext, builder);
-			break;
-		case ExpressionType::Bool:
-			left = ConvertToBooleanValue(left, llvmContext, builder);
-			right = ConvertToBooleanValue(right, llvmContext, builder);
-			break;
-		case ExpressionType::String:
-			throw std::runtime_error("can't codegen binary operator for string");
-		default:
-			throw std::logic_error("can't codegen binary operator for undefined expression type");
-		}
+void ExpressionCodegen::EndShortCircuit(const BinaryExpressionAST& node, Frame& frame, llvm::Value* right)
+{
+	CodegenUtils& utils = m_context.GetUtils();
+	llvm::IRBuilder<>& builder = utils.GetBuilder();
+	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
-		// TODO: produce warning here
-	}
+	const bool isAnd = node.GetOperator() == BinaryExpressionAST::And;
+	const ExpressionType castType = *GetPreferredType(m_info.GetType(node.GetLeft()), m_info.GetType(node.GetRight()));
+	right = ConvertToBooleanValue(
+		CastValue(right, m_info.GetType(node.GetRight()), castType, llvmContext, builder), castType, llvmContext, builder);
+	llvm::BasicBlock* rightBlock = builder.GetInsertBlock();
+	builder.CreateBr(frame.endBlock);
 
-	assert(ToExpressionType(left->getType()) == ToExpressionType(right->getType()));
+	rightBlock->getParent()->getBasicBlockList().push_back(frame.endBlock);
+	builder.SetInsertPoint(frame.endBlock);
 
-	switch (ToExpressionType(left->getType()).value)
+	// Operator has result of the right operand, if it was evaluated
+	llvm::PHINode* phi = builder.CreatePHI(llvm::Type::getInt1Ty(llvmContext), unsigned(frame.values.size() + 1), isAnd ? "andtmp" : "ortmp");
+	llvm::Constant* knownResult = llvm::ConstantInt::get(llvm::Type::getInt1Ty(llvmContext), uint64_t(!isAnd));
+	for (llvm::Value* block : frame.values)
 	{
-	case ExpressionType::Int:
-		m_stack.push_back(CreateIntegerBinaryExpression(left, right, node.GetOperator(), llvmContext, builder));
-		break;
-	case ExpressionType::Float:
-		m_stack.push_back(CreateFloatBinaryExpression(left, right, node.GetOperator(), llvmContext, builder));
-		break;
-	case ExpressionType::Bool:
-		m_stack.push_back(CreateBooleanBinaryExpression(left, right, node.GetOperator(), llvmContext, builder));
-		break;
-	default:
-		throw std::runtime_error("can't codegen binary operator '" +
-			ToString(node.GetOperator()) + "' for " + ToString(ToExpressionType(left->getType())));
+		phi->addIncoming(knownResult, llvm::cast<llvm::BasicBlock>(block));
 	}
+	phi->addIncoming(right, rightBlock);
+	frame.value = phi;
 }
 
-void ExpressionCodegen::Visit(const LiteralConstantAST& node)
+const IExpressionAST* ExpressionCodegen::Visit(const LiteralConstantAST& node, Frame& frame, llvm::Value* child)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 
@@ -575,505 +663,563 @@ void ExpressionCodegen::Visit(const LiteralConstantAST& node)
 	if (constant.type() == typeid(int))
 	{
 		const int number = boost::get<int>(constant);
-		llvm::Value* value = llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvmContext), number);
-		m_stack.push_back(value);
+		frame.value = llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvmContext), number);
+		return nullptr;
 	}
 	else if (constant.type() == typeid(double))
 	{
 		const double number = boost::get<double>(constant);
-		llvm::Value* value = llvm::ConstantFP::get(llvm::Type::getDoubleTy(llvmContext), number);
-		m_stack.push_back(value);
+		frame.value = llvm::ConstantFP::get(llvm::Type::getDoubleTy(llvmContext), number);
+		return nullptr;
 	}
 	else if (constant.type() == typeid(bool))
 	{
 		const bool boolean = boost::get<bool>(constant);
-		llvm::Value* value = llvm::ConstantInt::get(llvm::Type::getInt1Ty(llvmContext), uint64_t(boolean));
-		m_stack.push_back(value);
+		frame.value = llvm::ConstantInt::get(llvm::Type::getInt1Ty(llvmContext), uint64_t(boolean));
+		return nullptr;
 	}
 	else if (constant.type() == typeid(std::string))
 	{
 		const std::string& str = boost::get<std::string>(constant);
-		llvm::Type* i8 = llvm::Type::getInt8Ty(llvmContext);
-		llvm::Constant* constantString = llvm::ConstantDataArray::getString(llvmContext, str, true);
-		llvm::ArrayType* arrayType = llvm::ArrayType::get(i8, str.length() + 1);
-
-		llvm::AllocaInst* allocaInst = builder.CreateAlloca(arrayType,
-			llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvmContext), uint64_t(str.length() + 1)), "str_alloc");
-		llvm::StoreInst* storeInst = builder.CreateStore(constantString, allocaInst);
-		(void)storeInst;
-
-		m_stack.push_back(builder.CreateBitCast(allocaInst, llvm::Type::getInt8PtrTy(llvmContext), "str_to_i8_ptr"));
+		frame.value = CreateStringValue(str, m_info.AreElementsWritten({ ExpressionType::String, 0 }),
+			m_info.IsLiteralBufferShared(node), m_context);
+		return nullptr;
 	}
 	else if (constant.type() == typeid(std::vector<std::shared_ptr<IExpressionAST>>))
 	{
-		const auto& expressions = boost::get<std::vector<std::shared_ptr<IExpressionAST>>>(constant);
-		if (expressions.empty())
+		// Elements (of all dimensions) are generated one by one, then stored to the array
+		const ExpressionType type = m_info.GetType(node);
+		const std::vector<unsigned>& extents = m_info.GetArrayExtents(node);
+		const size_t count = std::accumulate(extents.begin(), extents.end(), size_t(1), std::multiplies<size_t>());
+
+		std::vector<llvm::Value*>& values = frame.values;
+		if (frame.step != 0)
 		{
-			throw std::runtime_error("can't create empty array");
+			values.push_back(child);
 		}
+		if (frame.step < count)
+		{
+			return &GetArrayLiteralElement(node, extents, frame.step++);
+		}
+
+		llvm::Type* elementType = ToLLVMType({ type.value, 0 }, llvmContext);
+		llvm::ArrayType* arrayType = llvm::ArrayType::get(elementType, count);
 
-		std::vector<llvm::Value*> values(expressions.size());
-		for (size_t i = 0; i < values.size(); ++i)
+		// Sub-arrays of multidimensional array share its buffer, so it's modified by writes to any of them
+		bool writable = false;
+		for (unsigned nesting = 1; nesting <= type.nesting; ++nesting)
 		{
-			values[i] = Visit(*expressions[i]);
+			writable = writable || m_info.AreElementsWritten({ type.value, nesting });
 		}
 
-		ExpressionType type = ToExpressionType(values[0]->getType());
-		const bool hasSameType = std::all_of(values.begin() + 1, values.end(), [&type](llvm::Value* value) {
-			return ToExpressionType(value->getType()) == type;
-		});
-		if (!hasSameType)
+		// Literal of constants is emitted as global data, that is copied only if arrays of its type are modified
+		std::vector<llvm::Constant*> constants;
+		for (llvm::Value* value : values)
 		{
-			throw std::runtime_error("all array literal element must have same type");
+			if (auto constant = llvm::dyn_cast<llvm::Constant>(value))
+			{
+				constants.push_back(constant);
+			}
 		}
 
-		llvm::ArrayType* arrayType = llvm::ArrayType::get(values[0]->getType(), expressions.size());
-		llvm::AllocaInst* arrayValue = builder.CreateAlloca(
-			arrayType,
-			llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvmContext), uint64_t(expressions.size())),
-			"arr_alloc");
-		llvm::Value* arrayPtr = builder.CreateBitCast(arrayValue, values[0]->getType()->getPointerTo(), "bitcast");
+		llvm::Value* arrayPtr = nullptr;
+		if (constants.size() == values.size())
+		{
+			llvm::Constant* pointer = m_context.GetConstantArray(llvm::ConstantArray::get(arrayType, constants), ".arr");
+			arrayPtr = writable ? CreateMutableCopy(pointer, arrayType, "arr_alloc", m_info.IsLiteralBufferShared(node), m_context) : pointer;
+		}
+		else
+		{
+			llvm::AllocaInst* arrayValue = m_context.CreateBufferAlloca(arrayType, "arr_alloc", m_info.IsLiteralBufferShared(node));
+			arrayPtr = builder.CreateBitCast(arrayValue, elementType->getPointerTo(), "array_to_ptr");
 
-		for (size_t i = 0; i < values.size(); ++i)
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				llvm::Value* ptr = builder.CreateGEP(
+					arrayPtr,
+					llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), uint64_t(i)),
+					"element_ptr[" + std::to_string(i) + "]");
+				builder.CreateStore(values[i], ptr);
+			}
+		}
+
+		if (!IsDenseArray(type))
 		{
-			llvm::Value* ptr = builder.CreateGEP(
-				arrayPtr,
-				llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), uint64_t(i)),
-				"element_ptr[" + std::to_string(i) + "]");
-			builder.CreateStore(values[i], ptr);
+			frame.value = arrayPtr;
+			return nullptr;
 		}
 
-		m_stack.push_back(builder.CreateBitCast(arrayPtr, values[0]->getType()->getPointerTo(), "array_to_ptr"));
-	}
-	else
-	{
-		assert(false);
-		throw std::logic_error("Visiting LiteralConstantAST - can't codegen for undefined literal constant type");
+		// Sizes of all dimensions except the first one are stored with pointer to the buffer
+		llvm::Value* denseArray = llvm::UndefValue::get(ToLLVMType(type, llvmContext));
+		denseArray = builder.CreateInsertValue(denseArray, arrayPtr, { 0 });
+		for (unsigned i = 1; i < extents.size(); ++i)
+		{
+			llvm::Value* extent = llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvmContext), extents[i]);
+			denseArray = builder.CreateInsertValue(denseArray, extent, { 1, i - 1 });
+		}
+		frame.value = denseArray;
+		return nullptr;
 	}
+
+	assert(false);
+	throw std::logic_error("Visiting LiteralConstantAST - can't codegen for undefined literal constant type");
 }
 
-void ExpressionCodegen::Visit(const UnaryAST& node)
+const IExpressionAST* ExpressionCodegen::Visit(const UnaryAST& node, Frame& frame, llvm::Value* child)
 {
+	if (frame.step++ == 0)
+	{
+		return &node.GetExpr();
+	}
+
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
-	llvm::Value* value = Visit(node.GetExpr());
-
 	switch (node.GetOperator())
 	{
 	case UnaryAST::Plus:
-		m_stack.push_back(value);
+		frame.value = child;
 		break;
 	case UnaryAST::Minus:
-		m_stack.push_back(CodegenNegativeValue(value, builder));
+		frame.value = CodegenNegativeValue(child, m_info.GetType(node.GetExpr()), builder);
 		break;
 	case UnaryAST::Negation:
-		m_stack.push_back(CreateValueNegation(value, llvmContext, builder));
+		frame.value = CreateValueNegation(child, m_info.GetType(node.GetExpr()), llvmContext, builder);
 		break;
 	default:
 		assert(false);
 		throw std::logic_error("Visit(UnaryAST): undefined unary operator");
 	}
+	return nullptr;
 }
 
-void ExpressionCodegen::Visit(const IdentifierAST& node)
+const IExpressionAST* ExpressionCodegen::Visit(const IdentifierAST& node, Frame& frame, llvm::Value*)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 
-	const std::string& name = node.GetName();
-	llvm::AllocaInst* variable = m_context.GetVariable(name);
-
-	if (!variable)
-	{
-		throw std::runtime_error("variable '" + name + "' is not defined");
-	}
+	llvm::AllocaInst* variable = m_context.GetVariable(m_info.GetSymbol(node));
+	assert(variable);
 
-	llvm::Value* value = builder.CreateLoad(variable, name + "Value");
-	m_stack.push_back(value);
+	frame.value = builder.CreateLoad(variable, node.GetName() + "Value");
+	return nullptr;
 }
 
-void ExpressionCodegen::Visit(const FunctionCallExpressionAST& node)
+const IExpressionAST* ExpressionCodegen::Visit(const FunctionCallExpressionAST& node, Frame& frame, llvm::Value* child)
 {
-	llvm::Value* returnValue = GenerateFunctionCall(node);
-	if (!returnValue)
+	CodegenUtils& utils = m_context.GetUtils();
+	llvm::IRBuilder<>& builder = utils.GetBuilder();
+	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
+
+	const SemanticInfo::Function& callee = m_info.GetFunction(m_info.GetSymbol(node));
+
+	// Previously generated param is casted to the type of the argument
+	if (frame.step != 0)
+	{
+		const size_t index = frame.step - 1;
+		frame.values.push_back(CastValue(
+			child, m_info.GetType(node.GetParam(index)), callee.params[index], llvmContext, builder));
+	}
+
+	if (frame.step < node.GetParamsCount())
 	{
-		throw std::runtime_error("function '" + node.GetName() + "' returns void - you can't use it in expressions");
+		return &node.GetParam(frame.step++);
 	}
-	m_stack.push_back(returnValue);
+
+	llvm::Function* func = m_context.GetFunction(callee.name);
+	assert(func);
+
+	llvm::CallInst* call = builder.CreateCall(func, frame.values, callee.returnType ? "calltmp" : "");
+	call->setCallingConv(func->getCallingConv());
+	call->setDoesNotThrow();
+	frame.value = callee.returnType ? call : nullptr;
+	return nullptr;
 }
 
-void ExpressionCodegen::Visit(const ArrayElementAccessAST& node)
+const IExpressionAST* ExpressionCodegen::Visit(const ArrayElementAccessAST& node, Frame& frame, llvm::Value* child)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
-	llvm::AllocaInst* arrayPtr = m_context.GetVariable(node.GetName());
-	if (!arrayPtr)
+	if (frame.step == 0)
 	{
-		throw std::runtime_error("array '" + node.GetName() + "' is not defined");
+		llvm::AllocaInst* arrayPtr = m_context.GetVariable(m_info.GetSymbol(node));
+		assert(arrayPtr);
+		frame.value = builder.CreateLoad(arrayPtr, "load_array_ptr_from_variable");
 	}
-
-	if (!arrayPtr->getType()->getPointerElementType()->isPointerTy())
+	else
 	{
-		throw std::runtime_error("variable '" + node.GetName() + "' can't be accessed via index");
+		const IExpressionAST& indexNode = node.GetIndex(frame.step - 1);
+		frame.values.push_back(CastValue(child, m_info.GetType(indexNode), { ExpressionType::Int, 0 }, llvmContext, builder));
 	}
 
-	// Will contain pointer to element that user trying to access
-	llvm::Value* elementPtr = builder.CreateLoad(arrayPtr, "load_array_ptr_from_variable");
-	ExpressionType typeOfArray = ToExpressionType(elementPtr->getType());
-
-	if (node.GetIndexCount() > typeOfArray.nesting + (typeOfArray.value == ExpressionType::String ? 1 : 0))
+	if (frame.step < node.GetIndexCount())
 	{
-		auto fmt = boost::format("array %1% have only %2% dimension(s), but trying to access element by index #%3%")
-			% node.GetName()
-			% typeOfArray.nesting
-			% node.GetIndexCount();
-		throw std::runtime_error(fmt.str());
+		return &node.GetIndex(frame.step++);
 	}
 
-	for (size_t i = 0; i < node.GetIndexCount(); ++i)
+	// Dimensions of dense array are indexed at once, indices of pointers (or characters of string) - one by one
+	const SemanticInfo::Variable& array = m_func.variables[m_info.GetSymbol(node)];
+	const std::vector<llvm::Value*>& indices = frame.values;
+	size_t next = 0;
+	if (IsDenseArray(array.type))
 	{
-		llvm::Value* index = ConvertToIntegerValue(
-			Visit(node.GetIndex(i)), llvmContext, builder
-		);
-
-		elementPtr = builder.CreateLoad(builder.CreateGEP(elementPtr, index, "get_element_ptr"), "load_element");
+		next = std::min<size_t>(indices.size(), array.type.nesting);
+		llvm::Value* pointer = CreateDenseElementPtr(frame.value, array.type.nesting, llvm::makeArrayRef(indices).take_front(next), builder);
+		frame.value = (next < array.type.nesting)
+			? CreateDenseSubArray(frame.value, array.type.nesting, unsigned(next), pointer, llvmContext, builder)
+			: builder.CreateLoad(pointer, "load_element");
+	}
+	for (; next < indices.size(); ++next)
+	{
+		frame.value = builder.CreateLoad(builder.CreateGEP(frame.value, indices[next], "get_element_ptr"), "load_element");
 	}
-
-	llvm::Value* value = elementPtr;
 
 	// Since our language doesn't support char data type (int8_t), we need to cast character to integer
-	if (value->getType()->getTypeID() == llvm::Type::IntegerTyID && value->getType()->getIntegerBitWidth() == 8)
+	if (array.type.value == ExpressionType::String && node.GetIndexCount() == array.type.nesting + 1)
 	{
-		value = builder.CreateIntCast(value, llvm::Type::getInt32Ty(llvmContext), false, "icasttmp");
+		frame.value = builder.CreateIntCast(frame.value, llvm::Type::getInt32Ty(llvmContext), false, "icasttmp");
 	}
-
-	assert(value);
-	m_stack.push_back(value);
+	return nullptr;
 }
 
 // Statement codegen visitor
-StatementCodegen::StatementCodegen(CodegenContext& context)
+StatementCodegen::StatementCodegen(CodegenContext& context, const SemanticInfo& info, const SemanticInfo::Function& func)
 	: m_context(context)
-	, m_expressionCodegen(context)
+	, m_info(info)
+	, m_func(func)
+	, m_expressionCodegen(context, info, func)
 {
 }
 
 void StatementCodegen::Visit(const IStatementAST& node)
 {
-	node.Accept(*this);
-}
+	const size_t base = m_frames.size();
+	m_frames.push_back({ &node, 0, {}, {} });
 
-llvm::BasicBlock* StatementCodegen::GetLastBasicBlockBranch()
-{
-	return m_branchContinueStack.empty() ? nullptr : m_branchContinueStack.back();
+	try
+	{
+		while (m_frames.size() > base)
+		{
+			Frame& frame = m_frames.back();
+			if (const IStatementAST* child = StatementVisitor::Visit(*frame.node, frame))
+			{
+				m_frames.push_back({ child, 0, {}, {} });
+			}
+			else
+			{
+				m_frames.pop_back();
+			}
+		}
+	}
+	catch (...)
+	{
+		m_frames.erase(m_frames.begin() + base, m_frames.end());
+		throw;
+	}
 }
 
-void StatementCodegen::Visit(const VariableDeclarationAST& node)
+const IStatementAST* StatementCodegen::Visit(const VariableDeclarationAST& node, Frame&)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
 	const std::string& name = node.GetIdentifier().GetName();
-	if (m_context.GetVariable(name))
-	{
-		throw std::runtime_error("variable '" + name + "' is already defined");
-	}
 
 	//  
 	llvm::Type* type = ToLLVMType(node.GetType(), llvmContext);
-	llvm::AllocaInst* variable = builder.CreateAlloca(type, nullptr, name + "Ptr");
+	llvm::AllocaInst* variable = m_context.CreateEntryBlockAlloca(type, name + "Ptr");
+
+	// Variable lives until the end of enclosing composite statement
+	if (Frame* composite = GetEnclosingCompositeFrame())
+	{
+		builder.CreateLifetimeStart(variable);
+		composite->variables.push_back(variable);
+	}
 
 	//     
-	llvm::Value* defaultValue = CreateDefaultValue(node.GetType(), llvmContext, builder);
+	llvm::Value* defaultValue = CreateDefaultValue(node.GetType(), m_info.AreElementsWritten({ ExpressionType::String, 0 }), m_context);
 	builder.CreateStore(defaultValue, variable);
 
 	//    
-	m_context.Define(name, variable);
+	m_context.SetVariable(m_info.GetVariable(node), variable);
 
 	//    
 	if (const IExpressionAST* expression = node.GetExpression())
 	{
 		llvm::Value* value = m_expressionCodegen.Visit(*expression);
-
-		if (ToExpressionType(value->getType()) != node.GetType())
-		{
-			llvm::Value* casted = CastValue(value, node.GetType(), llvmContext, builder);
-			if (!casted)
-			{
-				auto fmt = boost::format("can't set expression of type '%1%' to variable '%2%' of type '%3%'")
-					% ToString(ToExpressionType(value->getType()))
-					% name
-					% ToString(node.GetType());
-				throw std::runtime_error(fmt.str());
-			}
-
-			// TODO: produce warning here
-			assert(casted->getType()->getTypeID() == variable->getType()->getPointerElementType()->getTypeID());
-			builder.CreateStore(casted, variable);
-			return;
-		}
-
-		assert(value->getType()->getTypeID() == variable->getType()->getPointerElementType()->getTypeID());
-		builder.CreateStore(value, variable);
+		// TODO: produce warning, when value is casted
+		builder.CreateStore(CastValue(value, m_info.GetType(*expression), node.GetType(), llvmContext, builder), variable);
 	}
+	return nullptr;
 }
 
-void StatementCodegen::Visit(const AssignStatementAST& node)
+const IStatementAST* StatementCodegen::Visit(const AssignStatementAST& node, Frame&)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
-	const std::string& name = node.GetIdentifier().GetName();
-	llvm::AllocaInst* variable = m_context.GetVariable(name);
-	if (!variable)
-	{
-		throw std::runtime_error("can't assign because variable '" + name + "' is not defined");
-	}
+	const size_t index = m_info.GetVariable(node);
+	llvm::AllocaInst* variable = m_context.GetVariable(index);
+	assert(variable);
 
 	llvm::Value* value = m_expressionCodegen.Visit(node.GetExpr());
-
-	if (ToExpressionType(value->getType()) != ToExpressionType(variable->getType()->getPointerElementType()))
-	{
-		llvm::Value* casted = CastValue(value, ToExpressionType(variable->getType()->getPointerElementType()), llvmContext, builder);
-		if (!casted)
-		{
-			auto fmt = boost::format("can't set expression of type '%1%' to variable '%2%' of type '%3%'")
-				% ToString(ToExpressionType(value->getType()))
-				% name
-				% ToString(ToExpressionType(variable->getType()->getPointerElementType()));
-			throw std::runtime_error(fmt.str());
-		}
-
-		// TODO: produce warning here
-		assert(casted->getType()->getTypeID() == variable->getType()->getPointerElementType()->getTypeID());
-		builder.CreateStore(casted, variable);
-		return;
-	}
-
-	assert(value->getType()->getTypeID() == variable->getType()->getPointerElementType()->getTypeID());
-	builder.CreateStore(value, variable);
+	// TODO: produce warning, when value is casted
+	builder.CreateStore(CastValue(value, m_info.GetType(node.GetExpr()), m_func.variables[index].type, llvmContext, builder), variable);
+	return nullptr;
 }
 
-void StatementCodegen::Visit(const ArrayElementAssignAST& node)
+const IStatementAST* StatementCodegen::Visit(const ArrayElementAssignAST& node, Frame&)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
-	llvm::AllocaInst* arrayPtr = m_context.GetVariable(node.GetName());
-	if (!arrayPtr)
-	{
-		throw std::runtime_error("variable '" + node.GetName() + "' is not defined");
-	}
-
-	if (!arrayPtr->getType()->getPointerElementType()->isPointerTy())
-	{
-		throw std::runtime_error("variable '" + node.GetName() + "' is not array and can't be accessed via index");
-	}
+	const size_t index = m_info.GetVariable(node);
+	llvm::AllocaInst* arrayPtr = m_context.GetVariable(index);
+	assert(arrayPtr);
 
 	llvm::Value* element = builder.CreateLoad(arrayPtr, "load_array");
-	const ExpressionType typeOfArray = ToExpressionType(element->getType());
 
-	if (node.GetIndexCount() > typeOfArray.nesting + (typeOfArray.value == ExpressionType::String ? 1 : 0))
+	std::vector<llvm::Value*> indices(node.GetIndexCount());
+	for (size_t i = 0; i < indices.size(); ++i)
 	{
-		const auto fmt = boost::format("array %1% have only %2% dimension(s), but trying to assign element with index #%3%")
-			% node.GetName()
-			% typeOfArray.nesting
-			% node.GetIndexCount();
-		throw std::runtime_error(fmt.str());
+		const IExpressionAST& indexNode = node.GetIndex(i);
+		indices[i] = CastValue(m_expressionCodegen.Visit(indexNode), m_info.GetType(indexNode), { ExpressionType::Int, 0 }, llvmContext, builder);
 	}
 
-	llvm::Value* gep = nullptr;
+	llvm::Value* expression = m_expressionCodegen.Visit(node.GetExpression());
 
-	for (size_t i = 0; i < node.GetIndexCount(); ++i)
+	const ExpressionType& typeOfArray = m_func.variables[index].type;
+	llvm::Value* gep = nullptr;
+	size_t next = 0;
+	if (IsDenseArray(typeOfArray))
 	{
-		llvm::Value* index = ConvertToIntegerValue(m_expressionCodegen.Visit(node.GetIndex(i)), llvmContext, builder);
-		gep = builder.CreateGEP(element, index, "get_element_ptr");
-		element = builder.CreateLoad(gep);
-	}
+		next = std::min<size_t>(indices.size(), typeOfArray.nesting);
+		gep = CreateDenseElementPtr(element, typeOfArray.nesting, llvm::makeArrayRef(indices).take_front(next), builder);
 
-	llvm::Value* expression = m_expressionCodegen.Visit(node.GetExpression());
+		// Sub-array of dense array is assigned by copying, since it is a part of the buffer;
+		//  it's assigned from literal of known size, program traps if the row has other size
+		if (next < typeOfArray.nesting)
+		{
+			const std::vector<unsigned>& extents = m_info.GetArrayExtents(node.GetExpression());
+			llvm::Value* mismatch = llvm::ConstantInt::getFalse(llvmContext);
+			for (size_t i = 0; i < extents.size(); ++i)
+			{
+				llvm::Value* extent = builder.CreateExtractValue(element, { 1, unsigned(next - 1 + i) }, "extent");
+				llvm::Value* literalExtent = llvm::ConstantInt::get(llvm::Type::getInt32Ty(llvmContext), extents[i]);
+				mismatch = builder.CreateOr(mismatch, builder.CreateICmpNE(extent, literalExtent), "row_size_mismatch");
+			}
 
-	// Since we have no support for int8_t, in case of string element assign, we need to cast integer
-	assert(gep->getType()->isPointerTy());
-	if (gep->getType()->getPointerElementType()->getTypeID() == llvm::Type::IntegerTyID &&
-		gep->getType()->getPointerElementType()->getIntegerBitWidth() == 8 &&
-		expression->getType()->getTypeID() == llvm::Type::IntegerTyID && expression->getType()->getIntegerBitWidth() == 32)
+			llvm::Function* func = builder.GetInsertBlock()->getParent();
+			llvm::BasicBlock* trapBlock = llvm::BasicBlock::Create(llvmContext, "row_size_trap", func);
+			llvm::BasicBlock* copyBlock = llvm::BasicBlock::Create(llvmContext, "row_copy", func);
+			builder.CreateCondBr(mismatch, trapBlock, copyBlock);
+			builder.SetInsertPoint(trapBlock);
+			builder.CreateCall(llvm::Intrinsic::getDeclaration(&utils.GetModule(), llvm::Intrinsic::trap));
+			builder.CreateUnreachable();
+			builder.SetInsertPoint(copyBlock);
+
+			const size_t count = std::accumulate(extents.begin(), extents.end(), size_t(1), std::multiplies<size_t>());
+			llvm::Value* source = IsDenseArray({ typeOfArray.value, typeOfArray.nesting - unsigned(next) })
+				? builder.CreateExtractValue(expression, { 0 }, "data")
+				: expression;
+			llvm::Type* elementType = ToLLVMType({ typeOfArray.value, 0 }, llvmContext);
+			llvm::Value* size = builder.CreateMul(
+				llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), uint64_t(count)),
+				llvm::ConstantExpr::getSizeOf(elementType),
+				"size");
+			builder.CreateMemMove(gep, 1, source, 1, size);
+			return nullptr;
+		}
+	}
+	for (; next < indices.size(); ++next)
 	{
-		expression = builder.CreateIntCast(expression, llvm::Type::getInt8Ty(llvmContext), false, "int32_to_int8");
+		if (gep)
+		{
+			element = builder.CreateLoad(gep);
+		}
+		gep = builder.CreateGEP(element, indices[next], "get_element_ptr");
 	}
 
-	// TODO:   assert  if
-	// assert(expression->getType()->getTypeID() == gep->getType()->getPointerElementType()->getTypeID());
-
-	if (expression->getType()->getTypeID() != gep->getType()->getPointerElementType()->getTypeID())
+	// Since we have no support for int8_t, in case of string element assign, we need to cast integer
+	if (typeOfArray.value == ExpressionType::String && node.GetIndexCount() == typeOfArray.nesting + 1)
 	{
-		auto fmt = boost::format("trying to assign expression of type %1% to array element of type %2%")
-			% ToString(ToExpressionType(expression->getType()))
-			% ToString(ToExpressionType(gep->getType()->getPointerElementType()));
-		throw std::runtime_error(fmt.str());
+		expression = builder.CreateIntCast(expression, llvm::Type::getInt8Ty(llvmContext), false, "int32_to_int8");
 	}
 
+	assert(gep);
 	llvm::StoreInst* storeInst = builder.CreateStore(expression, gep);
 	(void)storeInst;
+	return nullptr;
 }
 
-void StatementCodegen::Visit(const ReturnStatementAST& node)
+const IStatementAST* StatementCodegen::Visit(const ReturnStatementAST& node, Frame&)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
-	llvm::Function* func = builder.GetInsertBlock()->getParent();
-	if (func->getReturnType()->getTypeID() == llvm::Type::VoidTyID)
+	if (!m_func.returnType)
 	{
-		if (node.GetExpression())
-		{
-			llvm::Value* value = m_expressionCodegen.Visit(*node.GetExpression());
-			const ExpressionType type = ToExpressionType(value->getType());
-			throw std::runtime_error("function '" + func->getName().str() + "' can't return value of type " + ToString(type));
-		}
 		builder.CreateRet(nullptr);
-		return;
-	}
-
-	const ExpressionType funcReturnType = ToExpressionType(func->getReturnType());
-	if (!node.GetExpression())
-	{
-		throw std::runtime_error("return statement must have expression of type" + ToString(funcReturnType));
-	}
-
-	llvm::Value* value = m_expressionCodegen.Visit(*node.GetExpression());
-	if (ToExpressionType(value->getType()) != funcReturnType)
-	{
-		value = CastValue(value, funcReturnType, llvmContext, builder);
-		if (!value)
-		{
-			auto fmt = boost::format("returning expression of type %1% must be at least convertible to function return type (%2%)")
-				% ToString(ToExpressionType(value->getType()))
-				% ToString(funcReturnType);
-			throw std::runtime_error(fmt.str());
-		}
+		return nullptr;
 	}
 
-	assert(ToExpressionType(value->getType()) == funcReturnType);
-	builder.CreateRet(value);
+	const IExpressionAST& expression = *node.GetExpression();
+	llvm::Value* value = m_expressionCodegen.Visit(expression);
+	builder.CreateRet(CastValue(value, m_info.GetType(expression), *m_func.returnType, llvmContext, builder));
+	return nullptr;
 }
 
-void StatementCodegen::Visit(const IfStatementAST& node)
+const IStatementAST* StatementCodegen::Visit(const IfStatementAST& node, Frame& frame)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
-	llvm::Function* func = builder.GetInsertBlock()->getParent();
+	llvm::BasicBlock*& thenBlock = frame.blocks[0];
+	llvm::BasicBlock*& elseBlock = frame.blocks[1];
+	llvm::BasicBlock*& continueBlock = frame.blocks[2];
+
+	if (frame.step == 0)
+	{
+		llvm::Function* func = builder.GetInsertBlock()->getParent();
 
-	llvm::BasicBlock* thenBlock = llvm::BasicBlock::Create(llvmContext, "then", func);
-	llvm::BasicBlock* elseBlock = llvm::BasicBlock::Create(llvmContext, "else", func);
-	llvm::BasicBlock* continueBlock = llvm::BasicBlock::Create(llvmContext, "continue", func);
+		thenBlock = llvm::BasicBlock::Create(llvmContext, "then", func);
+		elseBlock = llvm::BasicBlock::Create(llvmContext, "else", func);
+		continueBlock = llvm::BasicBlock::Create(llvmContext, "continue", func);
 
-	llvm::Value* value = m_expressionCodegen.Visit(node.GetExpr());
-	value = ConvertToBooleanValue(value, llvmContext, builder);
-	builder.CreateCondBr(value, thenBlock, elseBlock);
+		llvm::Value* value = m_expressionCodegen.Visit(node.GetExpr());
+		value = ConvertToBooleanValue(value, m_info.GetType(node.GetExpr()), llvmContext, builder);
+		builder.CreateCondBr(value, thenBlock, elseBlock);
 
-	auto putBrAfterBranchInsertionIfNecessary = [&](llvm::BasicBlock* branch) {
-		//     ,   
-		if (!branch->getTerminator())
+		builder.SetInsertPoint(thenBlock);
+		frame.step = 1;
+		return &node.GetThenStmt();
+	}
+
+	if (frame.step == 1)
+	{
+		PutBranchToContinueIfNecessary(continueBlock);
+
+		builder.SetInsertPoint(elseBlock);
+		frame.step = 2;
+		if (node.GetElseStmt())
 		{
-			builder.CreateBr(continueBlock);
-			return;
+			return node.GetElseStmt();
 		}
-		//     if ,     continue   ,
-		//    
-		if (!m_branchContinueStack.empty())
+	}
+
+	PutBranchToContinueIfNecessary(continueBlock);
+
+	builder.SetInsertPoint(continueBlock);
+	return nullptr;
+}
+
+StatementCodegen::Frame* StatementCodegen::GetEnclosingCompositeFrame()
+{
+	for (auto it = m_frames.rbegin(); it != m_frames.rend(); ++it)
+	{
+		if (it->node->GetKind() == StatementKind::Composite)
 		{
-			const bool hasTerminated = m_branchContinueStack.back()->getTerminator();
-			m_branchContinueStack.pop_back();
-			if (!hasTerminated)
-			{
-				builder.CreateBr(continueBlock);
-			}
+			return &*it;
 		}
-	};
+	}
+	return nullptr;
+}
 
-	builder.SetInsertPoint(thenBlock);
-	Visit(node.GetThenStmt());
-	putBrAfterBranchInsertionIfNecessary(thenBlock);
+void StatementCodegen::PutBranchToContinueIfNecessary(llvm::BasicBlock* continueBlock)
+{
+	llvm::IRBuilder<>& builder = m_context.GetUtils().GetBuilder();
 
-	builder.SetInsertPoint(elseBlock);
-	if (node.GetElseStmt())
+	// Nested statements may end in another block, than the branch has started with,
+	//  the branch falls through only if the last of them has no terminator
+	if (!builder.GetInsertBlock()->getTerminator())
 	{
-		Visit(*node.GetElseStmt());
+		builder.CreateBr(continueBlock);
 	}
-	putBrAfterBranchInsertionIfNecessary(elseBlock);
-
-	builder.SetInsertPoint(continueBlock);
-	m_branchContinueStack.push_back(continueBlock);
 }
 
-void StatementCodegen::Visit(const WhileStatementAST& node)
+const IStatementAST* StatementCodegen::Visit(const WhileStatementAST& node, Frame& frame)
 {
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
 
+	llvm::BasicBlock*& body = frame.blocks[0];
+	llvm::BasicBlock*& afterLoop = frame.blocks[1];
+
 	llvm::Function* func = builder.GetInsertBlock()->getParent();
 
-	llvm::BasicBlock* body = llvm::BasicBlock::Create(llvmContext, "loop", func);
-	llvm::BasicBlock* afterLoop = llvm::BasicBlock::Create(llvmContext, "afterloop", func);
+	// Loop is generated in rotated form: condition is checked before the first iteration
+	//  and in the single latch at the end of body, so loop passes get the canonical loop
+	//  with preheader, header, latch and dedicated exit
+	if (frame.step++ == 0)
+	{
+		llvm::BasicBlock* preheader = llvm::BasicBlock::Create(llvmContext, "preheader", func);
+		body = llvm::BasicBlock::Create(llvmContext, "loop", func);
+		afterLoop = llvm::BasicBlock::Create(llvmContext, "afterloop");
 
-	llvm::Value* value = ConvertToBooleanValue(m_expressionCodegen.Visit(node.GetExpr()), llvmContext, builder);
-	builder.CreateCondBr(value, body, afterLoop);
+		llvm::Value* value = ConvertToBooleanValue(m_expressionCodegen.Visit(node.GetExpr()), m_info.GetType(node.GetExpr()), llvmContext, builder);
+		builder.CreateCondBr(value, preheader, afterLoop);
 
-	auto putBrAfterBranchInsertionIfNecessary = [&](llvm::BasicBlock* branch) {
-		if (!branch->getTerminator())
-		{
-			value = ConvertToBooleanValue(m_expressionCodegen.Visit(node.GetExpr()), llvmContext, builder);
-			builder.CreateCondBr(value, body, afterLoop);
-		}
-		if (!m_branchContinueStack.empty() && !m_branchContinueStack.back()->getTerminator())
-		{
-			builder.SetInsertPoint(m_branchContinueStack.back());
-			value = ConvertToBooleanValue(m_expressionCodegen.Visit(node.GetExpr()), llvmContext, builder);
-			builder.CreateCondBr(value, body, afterLoop);
-		}
-		if (!m_branchContinueStack.empty())
-		{
-			m_branchContinueStack.pop_back();
-		}
-	};
+		builder.SetInsertPoint(preheader);
+		builder.CreateBr(body);
 
-	builder.SetInsertPoint(body);
-	Visit(node.GetStatement());
-	putBrAfterBranchInsertionIfNecessary(body);
+		builder.SetInsertPoint(body);
+		m_context.EnterLoop();
+		return &node.GetStatement();
+	}
+
+	if (!builder.GetInsertBlock()->getTerminator())
+	{
+		llvm::BasicBlock* loopExit = llvm::BasicBlock::Create(llvmContext, "loopexit", func);
+
+		llvm::Value* value = ConvertToBooleanValue(m_expressionCodegen.Visit(node.GetExpr()), m_info.GetType(node.GetExpr()), llvmContext, builder);
+		llvm::BranchInst* latch = builder.CreateCondBr(value, body, loopExit);
+		latch->setMetadata(llvm::LLVMContext::MD_loop, CreateLoopID(llvmContext));
 
+		builder.SetInsertPoint(loopExit);
+		builder.CreateBr(afterLoop);
+	}
+
+	m_context.LeaveLoop();
+	func->getBasicBlockList().push_back(afterLoop);
 	builder.SetInsertPoint(afterLoop);
-	m_branchContinueStack.push_back(afterLoop);
+	return nullptr;
 }
 
-void StatementCodegen::Visit(const CompositeStatementAST& node)
+const IStatementAST* StatementCodegen::Visit(const CompositeStatementAST& node, Frame& frame)
 {
-	ContextScopeHelper scopedContext(m_context);
 	llvm::IRBuilder<>& builder = m_context.GetUtils().GetBuilder();
 
-	for (size_t i = 0; i < node.GetCount(); ++i)
+	if (frame.step != 0 && builder.GetInsertBlock()->getTerminator())
+	{
+		// TODO: produce warning about unreachable code
+		frame.step = node.GetCount();
+	}
+
+	if (frame.step < node.GetCount())
+	{
+		return &node.GetStatement(frame.step++);
+	}
+
+	if (!builder.GetInsertBlock()->getTerminator())
 	{
-		node.GetStatement(i).Accept(*this);
-		if (builder.GetInsertBlock()->getTerminator())
+		for (llvm::AllocaInst* variable : frame.variables)
 		{
-			break;
+			builder.CreateLifetimeEnd(variable);
 		}
-		// TODO: produce warning about unreachable code
 	}
+	return nullptr;
 }
 
-void StatementCodegen::Visit(const BuiltinCallStatementAST& node)
+const IStatementAST* StatementCodegen::Visit(const BuiltinCallStatementAST& node, Frame&)
 {
 	switch (node.GetBuiltin())
 	{
@@ -1087,6 +1233,7 @@ void StatementCodegen::Visit(const BuiltinCallStatementAST& node)
 		assert(false);
 		throw std::logic_error("can't codegen undefined builtin call");
 	}
+	return nullptr;
 }
 
 void StatementCodegen::CodegenAsPrint(const BuiltinCallStatementAST& node)
@@ -1098,18 +1245,14 @@ void StatementCodegen::CodegenAsPrint(const BuiltinCallStatementAST& node)
 	std::vector<llvm::Value*> expressions(node.GetParamsCount());
 	for (size_t i = 0; i < expressions.size(); ++i)
 	{
-		expressions[i] = m_expressionCodegen.Visit(node.GetExpression(i));
-		if (ToExpressionType(expressions[i]->getType()) == ExpressionType{ ExpressionType::Bool, 0 })
+		const IExpressionAST& expression = node.GetExpression(i);
+		expressions[i] = CodegenBuiltinArgument(expression);
+		if (m_info.GetType(expression) == ExpressionType{ ExpressionType::Bool, 0 })
 		{
-			expressions[i] = ConvertToIntegerValue(expressions[i], llvmContext, builder);
+			expressions[i] = ConvertToIntegerValue(expressions[i], { ExpressionType::Bool, 0 }, llvmContext, builder);
 		}
 	}
 
-	if (expressions.empty() || ToExpressionType(expressions.front()->getType()) != ExpressionType{ ExpressionType::String, 0 })
-	{
-		throw std::runtime_error("print statement requires string as first argument");
-	}
-
 	builder.CreateCall(m_context.GetPrintf(), expressions, "printtmp");
 }
 
@@ -1118,138 +1261,172 @@ void StatementCodegen::CodegenAsScan(const BuiltinCallStatementAST& node)
 	CodegenUtils& utils = m_context.GetUtils();
 	llvm::IRBuilder<>& builder = utils.GetBuilder();
 
-	if (node.GetParamsCount() < 2)
-	{
-		throw std::runtime_error("scan statement expects at least 2 parameters, " + std::to_string(node.GetParamsCount()) + " given");
-	}
-
 	std::vector<llvm::Value*> expressions(node.GetParamsCount());
-	expressions[0] = m_expressionCodegen.Visit(node.GetExpression(0));
-	if (ToExpressionType(expressions[0]->getType()) != ExpressionType{ ExpressionType::String, 0 })
-	{
-		throw std::runtime_error("scan statement requires string as first argument");
-	}
+	expressions[0] = CodegenBuiltinArgument(node.GetExpression(0));
 
+	// Addresses of variables are passed instead of their values
 	for (size_t i = 1; i < expressions.size(); ++i)
 	{
-		const IdentifierAST* identifier = dynamic_cast<const IdentifierAST*>(&node.GetExpression(i));
-		if (!identifier)
-		{
-			throw std::runtime_error("you can only pass identifiers to scan");
-		}
+		expressions[i] = m_context.GetVariable(m_info.GetSymbol(node.GetExpression(i)));
+		assert(expressions[i]);
+	}
 
-		if (auto variable = m_context.GetVariable(identifier->GetName()))
-		{
-			expressions[i] = variable;
-		}
-		else
+	builder.CreateCall(m_context.GetScanf(), expressions, "scantmp");
+}
+
+// Builtins never modify their arguments, so string literals are passed without copying
+llvm::Value* StatementCodegen::CodegenBuiltinArgument(const IExpressionAST& expression)
+{
+	if (expression.GetKind() == ExpressionKind::Literal)
+	{
+		const LiteralConstantAST::Value& constant = static_cast<const LiteralConstantAST&>(expression).GetValue();
+		if (const std::string* str = boost::get<std::string>(&constant))
 		{
-			throw std::runtime_error("variable '" + identifier->GetName() + "' is not defined");
+			return m_context.GetStringConstant(*str);
 		}
 	}
-
-	builder.CreateCall(m_context.GetScanf(), expressions, "scantmp");
+	return m_expressionCodegen.Visit(expression);
 }
 
-void StatementCodegen::Visit(const FunctionCallStatementAST& node)
+const IStatementAST* StatementCodegen::Visit(const FunctionCallStatementAST& node, Frame&)
 {
-	llvm::Value* returnValue = m_expressionCodegen.GenerateFunctionCall(node.GetCallAsDerived());
+	llvm::Value* returnValue = m_expressionCodegen.Visit(node.GetCall());
 	if (returnValue)
 	{
 		// TODO: produce warning about unused function return value
 	}
+	return nullptr;
 }
 
-Codegen::Codegen(CodegenContext& context)
+Codegen::Codegen(CodegenContext& context, const SemanticInfo& info)
 	: m_context(context)
+	, m_info(info)
 {
 }
 
-void Codegen::Generate(const ProgramAST& program)
+void Codegen::Generate(const ProgramAST& program, const std::vector<size_t>& functions, const std::vector<std::string>& externalFunctions)
 {
-	for (size_t i = 0; i < program.GetFunctionsCount(); ++i)
+	DeclareFunctions(functions, externalFunctions, false);
+	for (size_t index : functions)
 	{
-		GenerateFunc(program.GetFunction(i));
+		GenerateFunc(program.GetFunction(index), m_info.GetFunction(index));
 	}
 }
 
-void Codegen::GenerateFunc(const FunctionAST& func)
+void Codegen::GeneratePart(const ProgramAST& program, const std::vector<size_t>& declaredFunctions, const std::vector<size_t>& definedFunctions, const std::vector<std::string>& externalFunctions)
 {
-	CodegenUtils& utils = m_context.GetUtils();
+	DeclareFunctions(declaredFunctions, externalFunctions, true);
+	for (size_t index : definedFunctions)
+	{
+		GenerateFunc(program.GetFunction(index), m_info.GetFunction(index));
+	}
+}
 
+void Codegen::DeclareFunctions(const std::vector<size_t>& functions, const std::vector<std::string>& externalFunctions, bool isPart)
+{
+	CodegenUtils& utils = m_context.GetUtils();
 	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
-	llvm::IRBuilder<>& builder = utils.GetBuilder();
-	llvm::Module& llvmModule = utils.GetModule();
 
-	const std::string& name = func.GetIdentifier().GetName();
+	//     ,       
+	for (size_t index : functions)
+	{
+		const SemanticInfo::Function& func = m_info.GetFunction(index);
 
-	//   
-	llvm::Type* returnType = func.GetReturnType() ?
-		ToLLVMType(*func.GetReturnType(), llvmContext) :
-		llvm::Type::getVoidTy(llvmContext);
+		//       
+		llvm::Type* returnType = func.returnType ?
+			ToLLVMType(*func.returnType, llvmContext) :
+			llvm::Type::getVoidTy(llvmContext);
 
-	//    
-	std::vector<llvm::Type*> argumentTypes;
-	argumentTypes.reserve(func.GetParams().size());
-	for (const FunctionAST::Param& param : func.GetParams())
-	{
-		argumentTypes.push_back(ToLLVMType(param.second, llvmContext));
+		std::vector<llvm::Type*> argumentTypes;
+		argumentTypes.reserve(func.params.size());
+		for (const ExpressionType& param : func.params)
+		{
+			argumentTypes.push_back(ToLLVMType(param, llvmContext));
+		}
+
+		llvm::FunctionType* funcType = llvm::FunctionType::get(returnType, argumentTypes, false);
+		const bool isExternal = std::find(externalFunctions.begin(), externalFunctions.end(), func.name) != externalFunctions.end();
+		llvm::Function* llvmFunc = llvm::Function::Create(funcType,
+			isExternal || isPart ? llvm::Function::ExternalLinkage : llvm::Function::InternalLinkage, func.name, &utils.GetModule());
+
+		// Internal functions are called only from the module, so their signature can be changed by optimizer
+		if (!isExternal)
+		{
+			llvmFunc->setCallingConv(llvm::CallingConv::Fast);
+			if (isPart)
+			{
+				llvmFunc->setVisibility(llvm::GlobalValue::HiddenVisibility);
+			}
+		}
+		// The language has no exceptions
+		llvmFunc->setDoesNotThrow();
+		m_context.AddFunction(func.name, llvmFunc);
 	}
+}
 
-	//     
-	llvm::FunctionType* funcType = llvm::FunctionType::get(returnType, argumentTypes, false);
-	llvm::Function* llvmFunc = llvm::Function::Create(
-		funcType, llvm::Function::ExternalLinkage, name, &llvmModule);
-	m_context.AddFunction(func.GetIdentifier().GetName(), llvmFunc);
+void Codegen::GenerateFunc(const FunctionAST& func, const SemanticInfo::Function& info)
+{
+	CodegenUtils& utils = m_context.GetUtils();
 
-	//    ,    
-	ContextScopeHelper scopedContext(m_context);
+	llvm::LLVMContext& llvmContext = utils.GetLLVMContext();
+	llvm::IRBuilder<>& builder = utils.GetBuilder();
+
+	const std::string& name = info.name;
+	llvm::Function* llvmFunc = m_context.GetFunction(name);
+	assert(llvmFunc);
+
+	m_context.ResetVariables(info.variables.size());
 
 	//       
 	llvm::BasicBlock* bb = llvm::BasicBlock::Create(llvmContext, name + "_entry", llvmFunc);
 	builder.SetInsertPoint(bb);
 
+	// All stack slots of the function are allocated at the beginning of entry block,
+	//  so they are promoted to registers by mem2reg and not reallocated in loops
+	llvm::Instruction* allocaPoint = new llvm::BitCastInst(
+		llvm::UndefValue::get(llvm::Type::getInt32Ty(llvmContext)), llvm::Type::getInt32Ty(llvmContext), "allocapt", bb);
+	m_context.SetAllocaInsertPoint(allocaPoint);
+
+	//    ,     (   )
 	size_t index = 0;
 	for (llvm::Argument& argument : llvmFunc->args())
 	{
-		assert(index < func.GetParams().size());
-		const FunctionAST::Param& param = func.GetParams()[index];
-		argument.setName(func.GetParams()[index].first);
+		assert(index < info.params.size());
+		const SemanticInfo::Variable& param = info.variables[index];
+		argument.setName(param.name);
 
-		llvm::AllocaInst* variable = builder.CreateAlloca(ToLLVMType(param.second, llvmContext), nullptr, param.first + "Ptr");
-		m_context.Define(param.first, variable);
+		llvm::AllocaInst* variable = m_context.CreateEntryBlockAlloca(ToLLVMType(param.type, llvmContext), param.name + "Ptr");
+		m_context.SetVariable(index, variable);
 		builder.CreateStore(&argument, variable);
 
 		++index;
 	}
 
 	//     (  )
-	StatementCodegen statementCodegen(m_context);
+	StatementCodegen statementCodegen(m_context, m_info, info);
 	statementCodegen.Visit(func.GetStatement());
 
 	//  return void
-	assert(!llvmFunc->getBasicBlockList().empty());
-	llvm::BasicBlock* last =
-		(statementCodegen.GetLastBasicBlockBranch()) ? statementCodegen.GetLastBasicBlockBranch()
-		: &llvmFunc->getBasicBlockList().back();
-
+	llvm::BasicBlock* last = builder.GetInsertBlock();
 	assert(last);
 	if (llvmFunc->getReturnType()->getTypeID() == llvm::Type::VoidTyID && !last->getTerminator())
 	{
 		builder.SetInsertPoint(last);
 		builder.CreateRet(nullptr);
 	}
-	else if (bool(func.GetReturnType()) && !last->getTerminator())
+	else if (bool(info.returnType) && !last->getTerminator())
 	{
 		builder.SetInsertPoint(last);
-		builder.CreateRet(CreateDefaultValue(*func.GetReturnType(), llvmContext, builder));
+		builder.CreateRet(CreateDefaultValue(*info.returnType, m_info.AreElementsWritten({ ExpressionType::String, 0 }), m_context));
 	}
 
+	m_context.SetAllocaInsertPoint(nullptr);
+	allocaPoint->eraseFromParent();
+
 	for (llvm::BasicBlock& basicBlock : llvmFunc->getBasicBlockList())
 	{
 		if (!basicBlock.getTerminator())
 		{
-			llvmFunc->dump();
 			throw std::runtime_error("every path must have return statement");
 		}
 	}
@@ -1257,9 +1434,10 @@ void Codegen::GenerateFunc(const FunctionAST& func)
 	std::string output;
 	llvm::raw_string_ostream out(output);
 
+	// Parts of the program are generated concurrently, so the invalid function is reported in the error
 	if (llvm::verifyFunction(*llvmFunc, &out))
 	{
-		utils.GetModule().dump();
+		llvmFunc->print(out);
 		llvmFunc->eraseFromParent();
 		throw std::runtime_error(out.str());
 	}
@@ -1,64 +1,126 @@
 #pragma once
 #include "../AST/AST.h"
+#include "../AST/StaticVisitor.h"
 #include "CodegenContext.h"
+#include "SemanticAnalyzer.h"
 #include <vector>
 
-class ExpressionCodegen : public IExpressionVisitor
+// Code generation of a node, that is suspended until its child is generated
+struct ExpressionCodegenFrame
 {
+	const IExpressionAST* node;
+	size_t step;
+	llvm::Value* value;
+	std::vector<llvm::Value*> values;
+	// Block after short-circuit operator, blocks that jump to it with known result are kept in values
+	llvm::BasicBlock* endBlock;
+};
+
+// Expressions are generated without recursion: nodes waiting for their children
+//  are kept in the explicit stack of frames, so depth of expression is limited only by the heap.
+// Types and names are taken from the results of semantic analysis, so the program is known to be correct.
+class ExpressionCodegen
+	: private ExpressionVisitor<ExpressionCodegen, const IExpressionAST*, ExpressionCodegenFrame&, llvm::Value*>
+{
+	friend class ExpressionVisitor<ExpressionCodegen, const IExpressionAST*, ExpressionCodegenFrame&, llvm::Value*>;
+	using Frame = ExpressionCodegenFrame;
+
 public:
-	explicit ExpressionCodegen(CodegenContext& context);
+	ExpressionCodegen(CodegenContext& context, const SemanticInfo& info, const SemanticInfo::Function& func);
+
+	// Returns nullptr for call of void function
 	llvm::Value* Visit(const IExpressionAST& node);
-	llvm::Value* GenerateFunctionCall(const FunctionCallExpressionAST& node);
 
 private:
-	void Visit(const BinaryExpressionAST& node) override;
-	void Visit(const LiteralConstantAST& node) override;
-	void Visit(const UnaryAST& node) override;
-	void Visit(const IdentifierAST& node) override;
-	void Visit(const FunctionCallExpressionAST& node) override;
-	void Visit(const ArrayElementAccessAST& node) override;
+	// Each overload is resumed with the value of the previously requested child
+	//  (nullptr on the first call) and returns the next child to generate,
+	//  or nullptr when value of the node is stored in the frame
+	const IExpressionAST* Visit(const BinaryExpressionAST& node, Frame& frame, llvm::Value* child);
+	const IExpressionAST* Visit(const LiteralConstantAST& node, Frame& frame, llvm::Value* child);
+	const IExpressionAST* Visit(const UnaryAST& node, Frame& frame, llvm::Value* child);
+	const IExpressionAST* Visit(const IdentifierAST& node, Frame& frame, llvm::Value* child);
+	const IExpressionAST* Visit(const FunctionCallExpressionAST& node, Frame& frame, llvm::Value* child);
+	const IExpressionAST* Visit(const ArrayElementAccessAST& node, Frame& frame, llvm::Value* child);
+
+	void BeginShortCircuit(const BinaryExpressionAST& node, Frame& frame, llvm::Value* left);
+	void EndShortCircuit(const BinaryExpressionAST& node, Frame& frame, llvm::Value* right);
 
 private:
 	CodegenContext& m_context;
-	std::vector<llvm::Value*> m_stack;
+	const SemanticInfo& m_info;
+	const SemanticInfo::Function& m_func;
+	std::vector<Frame> m_frames;
 };
 
-class StatementCodegen : public IStatementVisitor
+struct StatementCodegenFrame
 {
+	const IStatementAST* node;
+	size_t step;
+	// Basic blocks of if (then, else, continue) and while (loop, afterloop) statements
+	llvm::BasicBlock* blocks[3];
+	// Variables declared directly in the composite statement, their lifetime ends with it
+	std::vector<llvm::AllocaInst*> variables;
+};
+
+class StatementCodegen
+	: private StatementVisitor<StatementCodegen, const IStatementAST*, StatementCodegenFrame&>
+{
+	friend class StatementVisitor<StatementCodegen, const IStatementAST*, StatementCodegenFrame&>;
+	using Frame = StatementCodegenFrame;
+
 public:
-	explicit StatementCodegen(CodegenContext& context);
+	StatementCodegen(CodegenContext& context, const SemanticInfo& info, const SemanticInfo::Function& func);
 	void Visit(const IStatementAST& node);
-	llvm::BasicBlock* GetLastBasicBlockBranch();
 
 private:
-	void Visit(const VariableDeclarationAST& node) override;
-	void Visit(const ReturnStatementAST& node) override;
-	void Visit(const AssignStatementAST& node) override;
-	void Visit(const ArrayElementAssignAST& node) override;
-	void Visit(const IfStatementAST& node) override;
-	void Visit(const WhileStatementAST& node) override;
-	void Visit(const CompositeStatementAST& node) override;
-	void Visit(const BuiltinCallStatementAST& node) override;
-	void Visit(const FunctionCallStatementAST& node) override;
+	// Same protocol as in ExpressionCodegen: returns the next nested statement or nullptr
+	const IStatementAST* Visit(const VariableDeclarationAST& node, Frame& frame);
+	const IStatementAST* Visit(const ReturnStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const AssignStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const ArrayElementAssignAST& node, Frame& frame);
+	const IStatementAST* Visit(const IfStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const WhileStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const CompositeStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const BuiltinCallStatementAST& node, Frame& frame);
+	const IStatementAST* Visit(const FunctionCallStatementAST& node, Frame& frame);
 
 	void CodegenAsPrint(const BuiltinCallStatementAST& node);
 	void CodegenAsScan(const BuiltinCallStatementAST& node);
+	llvm::Value* CodegenBuiltinArgument(const IExpressionAST& expression);
+
+	void PutBranchToContinueIfNecessary(llvm::BasicBlock* continueBlock);
+	Frame* GetEnclosingCompositeFrame();
 
 private:
 	CodegenContext& m_context;
+	const SemanticInfo& m_info;
+	const SemanticInfo::Function& m_func;
 	ExpressionCodegen m_expressionCodegen;
-	std::vector<llvm::BasicBlock*> m_branchContinueStack;
+	std::vector<Frame> m_frames;
 };
 
 class Codegen
 {
 public:
-	explicit Codegen(CodegenContext& context);
-	void Generate(const ProgramAST& program);
+	Codegen(CodegenContext& context, const SemanticInfo& info);
+
+	// Generates only functions with the given indices; callees of them must be listed too.
+	// Only external functions are visible outside of the module, others get internal linkage
+	//  and fast calling convention
+	void Generate(const ProgramAST& program, const std::vector<size_t>& functions, const std::vector<std::string>& externalFunctions);
+
+	// Generates a part of the program, that is compiled separately and linked with other parts:
+	//  bodies of the defined functions and declarations of others, that they call.
+	// All functions are external, functions not listed as external are hidden outside of the program
+	void GeneratePart(const ProgramAST& program, const std::vector<size_t>& declaredFunctions, const std::vector<size_t>& definedFunctions, const std::vector<std::string>& externalFunctions);
 
 private:
-	void GenerateFunc(const FunctionAST& func);
+	// All functions are declared before generation of bodies, so they can call each other.
+	// In a part of the module all functions are external, otherwise the parts can't be linked
+	void DeclareFunctions(const std::vector<size_t>& functions, const std::vector<std::string>& externalFunctions, bool isPart);
+	void GenerateFunc(const FunctionAST& func, const SemanticInfo::Function& info);
 
 private:
 	CodegenContext& m_context;
+	const SemanticInfo& m_info;
 };
@@ -0,0 +1,77 @@
+#include "stdafx.h"
+#include "CompileCache.h"
+#include "CacheFiles.h"
+#include <llvm/Support/CachePruning.h>
+
+CompileCache::CompileCache(const std::string& directory, uint64_t maxSizeBytes, const std::string& configuration)
+	: m_directory(directory)
+	, m_maxSizeBytes(maxSizeBytes)
+	, m_configuration(configuration)
+	, m_stored(false)
+{
+}
+
+CompileCache::~CompileCache()
+{
+	// Unlike JitObjectCache, pruning is done at most once in the default interval of LLVM (20 minutes),
+	//  like in ThinLTO cache: in per-function mode the directory holds an entry for every batch of functions,
+	//  and scanning it on every run costs more than compiling a small program (0.6s for 3000 entries).
+	// Between prunings the cache may exceed the limit by what is stored in the interval
+	if (m_stored)
+	{
+		llvm::CachePruningPolicy policy;
+		policy.MaxSizeBytes = m_maxSizeBytes;
+		llvm::pruneCache(m_directory, policy);
+	}
+}
+
+bool CompileCache::LoadProgram(const std::string& text, std::string& ir, std::string& object)
+{
+	// Both files are needed, one of them may be already pruned
+	return LoadEntry(GetEntryPath("program", text, ".ll"), ir) &&
+		LoadEntry(GetEntryPath("program", text, ".o"), object);
+}
+
+void CompileCache::StoreProgram(const std::string& text, const std::string& ir, const std::string& object)
+{
+	StoreEntry(GetEntryPath("program", text, ".ll"), ir);
+	StoreEntry(GetEntryPath("program", text, ".o"), object);
+}
+
+bool CompileCache::LoadFunctions(const std::string& key, std::string& object)
+{
+	return LoadEntry(GetEntryPath("functions", key, ".o"), object);
+}
+
+void CompileCache::StoreFunctions(const std::string& key, const std::string& object)
+{
+	StoreEntry(GetEntryPath("functions", key, ".o"), object);
+}
+
+std::string CompileCache::GetEntryPath(const std::string& kind, const std::string& key, const char* extension)const
+{
+	llvm::MD5 hash;
+	hash.update(m_configuration);
+	hash.update(kind);
+	hash.update(key);
+	return GetCacheEntryPath(m_directory, hash, extension);
+}
+
+bool CompileCache::LoadEntry(const std::string& path, std::string& data)const
+{
+	auto buffer = ReadCacheEntry(path);
+	if (!buffer)
+	{
+		return false;
+	}
+	data = buffer->getBuffer().str();
+	return true;
+}
+
+void CompileCache::StoreEntry(const std::string& path, const std::string& data)
+{
+	if (WriteCacheEntry(m_directory, path, data))
+	{
+		m_stored = true;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+
+// On-disk content-addressed cache of compiler outputs.
+// Program entry is IR and object code of the whole program, named by hash of the source text
+//  and the configuration (compiler build, LLVM version, target and options affecting the code).
+// Functions entry is object code of a batch of functions, compiled in their own module;
+//  its key is built by the caller from the functions and signatures of their callees.
+// Least recently used entries are removed when total size of the cache exceeds the limit.
+class CompileCache
+{
+public:
+	CompileCache(const std::string& directory, uint64_t maxSizeBytes, const std::string& configuration);
+	~CompileCache();
+
+	// Failures of the cache are ignored: Load returns false and outputs are compiled as if there was no cache
+	bool LoadProgram(const std::string& text, std::string& ir, std::string& object);
+	void StoreProgram(const std::string& text, const std::string& ir, const std::string& object);
+
+	bool LoadFunctions(const std::string& key, std::string& object);
+	void StoreFunctions(const std::string& key, const std::string& object);
+
+private:
+	std::string GetEntryPath(const std::string& kind, const std::string& key, const char* extension)const;
+	bool LoadEntry(const std::string& path, std::string& data)const;
+	void StoreEntry(const std::string& path, const std::string& data);
+
+private:
+	std::string m_directory;
+	uint64_t m_maxSizeBytes;
+	std::string m_configuration;
+	bool m_stored;
+};
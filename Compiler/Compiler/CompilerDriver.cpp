@@ -9,9 +9,32 @@
 #include "../Parser/LLParserTable.h"
 #include "../Utils/file_utils.h"
 #include "Misc.h"
+#include "ASTOptimizer.h"
+#include "BytecodeCompiler.h"
+#include "BytecodeInterpreter.h"
+#include "CallGraph.h"
+#include "../AST/ASTSerialization.h"
+#include "JitEngine.h"
+#include "JitObjectCache.h"
+#include "OptimizationPipeline.h"
+#include "ParseCache.h"
+#include "SemanticAnalyzer.h"
+#include "TieredEngine.h"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/Support/MD5.h>
+#include <numeric>
+#include <thread>
 
 namespace
 {
+// Expected and maximal count of functions in a batch of per-function compilation
+const size_t gcBatchSize = 16;
+const size_t gcMaxBatchSize = 64;
+
 bool VerifyGrammarTerminalsMatchLexerTokens(const Grammar& grammar, std::string& unmatch)
 {
 	for (size_t row = 0; row < grammar.GetProductionsCount(); ++row)
@@ -31,9 +54,9 @@ bool VerifyGrammarTerminalsMatchLexerTokens(const Grammar& grammar, std::string&
 	return true;
 }
 
-std::unique_ptr<LLParser> CreateParser()
+std::unique_ptr<Grammar> CreateGrammar()
 {
-	auto grammar = GrammarBuilder(std::make_unique<GrammarProductionFactory>())
+	return GrammarBuilder(std::make_unique<GrammarProductionFactory>())
 		.AddProduction("<Program>          -> <FunctionList> EndOfFile")
 		// 
 		.AddProduction("<FunctionList>               -> <Function> <FunctionList>")
@@ -150,24 +173,592 @@ std::unique_ptr<LLParser> CreateParser()
 		//  
 		.AddProduction("<Identifier>            -> Identifier {OnIdentifierParsed}")
 		.Build();
+}
+
+// Hash of all productions including their attributes: any change of the grammar
+//  or of the semantic actions invalidates previously cached parse results
+std::string GetGrammarVersion(const Grammar& grammar)
+{
+	llvm::MD5 hash;
+	for (size_t row = 0; row < grammar.GetProductionsCount(); ++row)
+	{
+		const auto production = grammar.GetProduction(row);
+		hash.update(production->GetLeftPart());
+		hash.update("->");
+		for (size_t col = 0; col < production->GetSymbolsCount(); ++col)
+		{
+			const GrammarSymbol& symbol = production->GetSymbol(col);
+			hash.update(symbol.GetType() == GrammarSymbolType::Terminal ? " t:" : " n:");
+			hash.update(symbol.GetText());
+			if (symbol.GetAttribute())
+			{
+				hash.update("{" + *symbol.GetAttribute() + "}");
+			}
+		}
+		hash.update(";");
+	}
+
+	llvm::MD5::MD5Result result;
+	hash.final(result);
+	return result.digest().str().str();
+}
 
+std::unique_ptr<LLParser> CreateParser(const Grammar& grammar)
+{
 	std::string unmatch;
-	if (VerifyGrammarTerminalsMatchLexerTokens(*grammar, unmatch))
+	if (VerifyGrammarTerminalsMatchLexerTokens(grammar, unmatch))
 	{
-		return std::make_unique<LLParser>(std::make_unique<Lexer>(), CreateParserTable(*grammar), std::cout);
+		return std::make_unique<LLParser>(std::make_unique<Lexer>(), CreateParserTable(grammar), std::cout);
 	}
 	throw std::logic_error("lexer doesn't know about '" + unmatch + "' token, but grammar does");
 }
+
+llvm::CodeGenOpt::Level GetCodeGenOptLevel(unsigned optimizationLevel)
+{
+	switch (optimizationLevel)
+	{
+	case 0:
+		return llvm::CodeGenOpt::None;
+	case 1:
+		return llvm::CodeGenOpt::Less;
+	case 2:
+		return llvm::CodeGenOpt::Default;
+	default:
+		return llvm::CodeGenOpt::Aggressive;
+	}
+}
+
+// "native" is replaced with the processor of the host and its detected features,
+//  explicitly listed features are applied after them
+std::string GetTargetFeatures(const CompilerOptions& options, std::string& cpu)
+{
+	llvm::SubtargetFeatures features;
+	cpu = options.targetCpu;
+
+	if (cpu == "native")
+	{
+		cpu = llvm::sys::getHostCPUName().str();
+		llvm::StringMap<bool> hostFeatures;
+		if (llvm::sys::getHostCPUFeatures(hostFeatures))
+		{
+			for (const auto& feature : hostFeatures)
+			{
+				features.AddFeature(feature.first(), feature.second);
+			}
+		}
+	}
+
+	std::istringstream explicitFeatures(options.targetFeatures);
+	std::string feature;
+	while (std::getline(explicitFeatures, feature, ','))
+	{
+		features.AddFeature(feature);
+	}
+	return features.getString();
+}
+
+// Flags of every floating point operation of the module
+llvm::FastMathFlags GetFastMathFlags(const CompilerOptions& options)
+{
+	llvm::FastMathFlags flags;
+	if (options.fastMath)
+	{
+		flags.setFast();
+	}
+	if (options.fpReassociate)
+	{
+		flags.setAllowReassoc();
+	}
+	if (options.fpContract)
+	{
+		flags.setAllowContract(true);
+	}
+	if (options.fpNoNaNs)
+	{
+		flags.setNoNaNs();
+	}
+	if (options.fpNoInfs)
+	{
+		flags.setNoInfs();
+	}
+	return flags;
+}
+
+// Functions are compiled in batches: setting up the optimizer and the backend for a module costs
+//  several milliseconds, more than compiling a small function. Batch ends after the function, whose key hash
+//  is divisible by gcBatchSize, so boundaries depend on the functions rather than on their positions:
+//  changed, added or removed function invalidates its batch and maybe the next one
+std::vector<std::vector<size_t>> SplitToBatches(const std::vector<std::string>& keys)
+{
+	std::vector<std::vector<size_t>> batches;
+	bool isBatchEnded = true;
+	for (size_t i = 0; i < keys.size(); ++i)
+	{
+		if (isBatchEnded)
+		{
+			batches.emplace_back();
+		}
+		batches.back().push_back(i);
+
+		llvm::MD5 hash;
+		hash.update(keys[i]);
+		llvm::MD5::MD5Result result;
+		hash.final(result);
+		isBatchEnded = (result.low() % gcBatchSize == 0) || (batches.back().size() == gcMaxBatchSize);
+	}
+	return batches;
+}
+
+// Indices of functions, that are reachable from the entry points, in order of the program
+std::vector<size_t> SelectReachableFunctions(const CallGraph& graph, const CompilerOptions& options)
+{
+	const std::vector<std::string> entries = options.exportedFunctions.empty() ?
+		std::vector<std::string>{ "main" } : options.exportedFunctions;
+
+	std::vector<size_t> roots;
+	for (const std::string& name : entries)
+	{
+		auto function = graph.FindFunction(name);
+		if (!function)
+		{
+			throw std::runtime_error("entry function '" + name + "' is not defined");
+		}
+		roots.push_back(*function);
+	}
+	return graph.GetReachableFunctions(roots);
+}
+
+// Data layout and triple of the target are used by the middle-end passes
+void SetModuleTarget(llvm::Module& llvmModule, const llvm::TargetMachine& targetMachine)
+{
+	llvmModule.setDataLayout(targetMachine.createDataLayout());
+	llvmModule.setTargetTriple(targetMachine.getTargetTriple().str());
+
+	// Backend and middle-end passes (vectorizer, cost model) use the processor of the function
+	for (llvm::Function& func : llvmModule)
+	{
+		if (!func.isDeclaration())
+		{
+			func.addFnAttr("target-cpu", targetMachine.getTargetCPU());
+			if (!targetMachine.getTargetFeatureString().empty())
+			{
+				func.addFnAttr("target-features", targetMachine.getTargetFeatureString());
+			}
+		}
+	}
+}
+
+// Instruction selection and emission of the whole module are done by one pass manager
+void EmitObjectCode(llvm::Module& llvmModule, llvm::TargetMachine& targetMachine, llvm::raw_pwrite_stream& dest)
+{
+	llvm::legacy::PassManager pass;
+
+	llvm::TargetLibraryInfoImpl TLII(targetMachine.getTargetTriple());
+	pass.add(new llvm::TargetLibraryInfoWrapperPass(TLII));
+
+	if (targetMachine.addPassesToEmitFile(pass, dest, nullptr, llvm::TargetMachine::CGFT_ObjectFile, false, nullptr))
+	{
+		throw std::runtime_error("TargetMachine can't emit a file of this type");
+	}
+
+	pass.run(llvmModule);
+}
+
+void EmitObjectCodeToMemory(llvm::Module& llvmModule, llvm::TargetMachine& targetMachine, std::string& object)
+{
+	llvm::SmallVector<char, 0> buffer;
+	llvm::raw_svector_ostream dest(buffer);
+	EmitObjectCode(llvmModule, targetMachine, dest);
+	object.assign(buffer.begin(), buffer.end());
+}
+
+// Partitions of defined functions in order of the module: the largest functions are distributed first,
+//  every one to the partition with the least count of instructions
+std::vector<unsigned> AssignPartitions(const llvm::Module& llvmModule, unsigned partitionCount)
+{
+	std::vector<unsigned> sizes;
+	for (const llvm::Function& func : llvmModule)
+	{
+		if (!func.isDeclaration())
+		{
+			sizes.push_back(func.getInstructionCount());
+		}
+	}
+
+	std::vector<size_t> order(sizes.size());
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+		return sizes[lhs] > sizes[rhs];
+	});
+
+	std::vector<unsigned> partitions(sizes.size());
+	std::vector<uint64_t> loads(partitionCount);
+	for (size_t index : order)
+	{
+		const unsigned partition = unsigned(std::min_element(loads.begin(), loads.end()) - loads.begin());
+		partitions[index] = partition;
+		loads[partition] += sizes[index];
+	}
+	return partitions;
+}
+
+// Local symbols become hidden external ones, so references between partitions are resolved
+//  when object files are linked; global variables are defined only in the first partition
+void KeepPartition(llvm::Module& llvmModule, const std::vector<unsigned>& partitions, unsigned partition)
+{
+	for (llvm::GlobalValue& value : llvmModule.global_values())
+	{
+		if (value.hasLocalLinkage())
+		{
+			// Names are made unique in order of the module, so they are the same in every partition
+			if (!value.hasName())
+			{
+				value.setName("partition.local");
+			}
+			value.setLinkage(llvm::GlobalValue::ExternalLinkage);
+			value.setVisibility(llvm::GlobalValue::HiddenVisibility);
+		}
+	}
+
+	size_t index = 0;
+	for (llvm::Function& func : llvmModule)
+	{
+		if (!func.isDeclaration() && partitions[index++] != partition)
+		{
+			func.deleteBody();
+		}
+	}
+
+	if (partition != 0)
+	{
+		for (llvm::GlobalVariable& variable : llvmModule.globals())
+		{
+			variable.setInitializer(nullptr);
+		}
+	}
+}
+
+// Index of the partition is inserted before extension: "output.o" -> "output.1.o"
+std::string GetPartitionPath(const std::string& filepath, size_t partition)
+{
+	const size_t dot = filepath.find_last_of('.');
+	const size_t separator = filepath.find_last_of("/\\");
+	if (dot == std::string::npos || (separator != std::string::npos && dot < separator))
+	{
+		return filepath + "." + std::to_string(partition);
+	}
+	return filepath.substr(0, dot) + "." + std::to_string(partition) + filepath.substr(dot);
+}
+
+// Functions, that are visible outside of the object file: main and explicitly exported ones
+std::vector<std::string> GetExternalFunctions(const CompilerOptions& options)
+{
+	std::vector<std::string> functions = options.exportedFunctions;
+	functions.push_back("main");
+	return functions;
+}
+
+// Build of the compiler is identified by size and modification time of its executable, like ccache does
+std::string GetCompilerBuildId()
+{
+	static const int anchor = 0;
+	const std::string path = llvm::sys::fs::getMainExecutable(nullptr, const_cast<int*>(&anchor));
+	llvm::sys::fs::file_status status;
+	if (path.empty() || llvm::sys::fs::status(path, status))
+	{
+		return "unknown";
+	}
+	return std::to_string(status.getSize()) + "@" +
+		std::to_string(status.getLastModificationTime().time_since_epoch().count());
+}
+
+// Everything besides the source text, that affects outputs of the compiler
+std::string GetCacheConfiguration(const CompilerOptions& options, const llvm::TargetMachine& targetMachine)
+{
+	const llvm::FastMathFlags fastMathFlags = GetFastMathFlags(options);
+	std::ostringstream out;
+	out << "compiler=" << GetCompilerBuildId()
+		<< "|llvm=" << LLVM_VERSION_STRING
+		<< "|target=" << targetMachine.getTargetTriple().str()
+		<< "," << targetMachine.getTargetCPU().str()
+		<< "," << targetMachine.getTargetFeatureString().str()
+		<< "|O" << options.optimizationLevel << "s" << options.sizeLevel
+		<< "|fp=" << fastMathFlags.isFast() << fastMathFlags.allowReassoc() << fastMathFlags.allowContract()
+		<< fastMathFlags.noNaNs() << fastMathFlags.noInfs()
+		<< "|reachable-only=" << options.reachableOnly
+		// Parallel generation drops names of values in IR
+		<< "|discard-names=" << (options.irgenThreads > 1)
+		<< "|functions=" << options.cacheFunctions
+		<< "|export=";
+	for (const std::string& name : options.exportedFunctions)
+	{
+		out << name << ",";
+	}
+	return out.str();
 }
 
-CompilerDriver::CompilerDriver(std::ostream& log)
+std::string GetSignature(const SemanticInfo::Function& func, bool isExternal)
+{
+	std::string signature = func.name + (isExternal ? " external(" : "(");
+	for (const ExpressionType& param : func.params)
+	{
+		signature += ToString(param) + ",";
+	}
+	return signature + ")->" + (func.returnType ? ToString(*func.returnType) : "void");
+}
+
+// Object code of a function compiled in its own module depends on the function itself, on how it's
+//  called and what it calls, and on the only whole-program fact used by codegen: which array types are modified
+std::string GetFunctionCacheKey(const ProgramAST& program, const SemanticInfo& semantics, const CallGraph& graph,
+	size_t function, const std::vector<std::string>& externalFunctions)
+{
+	auto getSignature = [&](size_t index) {
+		const SemanticInfo::Function& func = semantics.GetFunction(index);
+		const bool isExternal = std::find(externalFunctions.begin(), externalFunctions.end(), func.name) != externalFunctions.end();
+		return GetSignature(func, isExternal);
+	};
+
+	// Callees are sorted by name rather than by index, so reordering of functions doesn't change the key
+	std::vector<std::string> callees;
+	for (size_t callee : graph.GetCallees(function))
+	{
+		callees.push_back(getSignature(callee));
+	}
+	std::sort(callees.begin(), callees.end());
+
+	std::string key = getSignature(function) + "\n" + SerializeFunction(program.GetFunction(function)) + "\ncallees:";
+	for (const std::string& callee : callees)
+	{
+		key += callee + ";";
+	}
+	key += "\nwritten arrays:";
+	for (const ExpressionType& type : semantics.GetWrittenArrayTypes())
+	{
+		key += ToString(type) + ";";
+	}
+	return key;
+}
+}
+
+CompilerDriver::CompilerDriver(std::ostream& log, const CompilerOptions& options)
 	: m_log(log)
+	, m_options(options)
 {
 }
 
 void CompilerDriver::Compile(const std::string& text)
 {
-	auto parser = CreateParser();
+	if (!m_options.compileCacheDirectory.empty())
+	{
+		m_compileCache = std::make_unique<CompileCache>(m_options.compileCacheDirectory, m_options.compileCacheSizeLimit,
+			GetCacheConfiguration(m_options, GetTargetMachine()));
+		std::string object;
+		if (!m_options.cacheFunctions && m_compileCache->LoadProgram(text, m_outputIR, object))
+		{
+			// Cache hit: parsing, analysis and all of code generation are skipped
+			m_outputObjects = { std::move(object) };
+			return;
+		}
+	}
+
+	auto ast = Parse(text);
+
+	// All semantic errors are reported here, code generation doesn't check the program
+	auto semantics = AnalyzeProgram(*ast);
+
+	std::vector<size_t> functions(ast->GetFunctionsCount());
+	std::iota(functions.begin(), functions.end(), size_t(0));
+	OptimizeProgram(*ast, *semantics, functions);
+
+	// Graph is built from the optimized program, so calls in pruned branches don't make functions reachable.
+	// Flat representation is created once for the compilation and is not needed after that
+	if (m_options.reachableOnly || m_options.cacheFunctions || m_options.tiered)
+	{
+		m_callGraph = std::make_unique<CallGraph>(*CreateFlatAST(*ast));
+	}
+	if (m_options.reachableOnly)
+	{
+		functions = SelectReachableFunctions(*m_callGraph, m_options);
+	}
+
+	if (m_options.interpret)
+	{
+		m_bytecode = CompileToBytecode(*ast, *semantics, functions);
+		if (m_options.tiered)
+		{
+			// Hot functions are generated from the same program later, while it's running
+			m_program = std::move(ast);
+			m_semantics = std::move(semantics);
+		}
+		return;
+	}
+
+	if (m_options.cacheFunctions)
+	{
+		CompileFunctions(*ast, *semantics, *m_callGraph, functions);
+		return;
+	}
+
+	if (m_options.irgenThreads > 1)
+	{
+		CompileParts(*ast, *semantics, functions);
+		return;
+	}
+
+	m_context.GetUtils().GetBuilder().setFastMathFlags(GetFastMathFlags(m_options));
+
+	Codegen generator(m_context, *semantics);
+	generator.Generate(*ast, functions, GetExternalFunctions(m_options));
+
+	llvm::TargetMachine& targetMachine = GetTargetMachine();
+	llvm::Module& llvmModule = m_context.GetUtils().GetModule();
+	SetModuleTarget(llvmModule, targetMachine);
+
+	// In lazy mode functions are optimized separately, when they are compiled by the JIT
+	if (!m_options.lazy)
+	{
+		OptimizeModule(llvmModule, targetMachine, m_options.optimizationLevel, m_options.sizeLevel);
+	}
+
+	if (m_compileCache)
+	{
+		llvm::raw_string_ostream out(m_outputIR);
+		llvmModule.print(out, nullptr);
+		out.flush();
+
+		m_outputObjects.resize(1);
+		EmitObjectCodeToMemory(llvmModule, targetMachine, m_outputObjects[0]);
+		m_compileCache->StoreProgram(text, m_outputIR, m_outputObjects[0]);
+	}
+}
+
+// Batch is generated with declarations of callees of its functions only, so its module and the cache key
+//  don't depend on the rest of the program
+void CompilerDriver::CompileFunctions(const ProgramAST& program, const SemanticInfo& semantics, const CallGraph& graph,
+	const std::vector<size_t>& functions)
+{
+	llvm::TargetMachine& targetMachine = GetTargetMachine();
+	const std::vector<std::string> externalFunctions = GetExternalFunctions(m_options);
+
+	std::vector<std::string> keys;
+	for (size_t function : functions)
+	{
+		keys.push_back(GetFunctionCacheKey(program, semantics, graph, function, externalFunctions));
+	}
+
+	const std::vector<std::vector<size_t>> batches = SplitToBatches(keys);
+	m_outputObjects.resize(batches.size());
+	for (size_t i = 0; i < batches.size(); ++i)
+	{
+		// Keys are prefixed by their lengths, so different batches can't have the same key
+		std::string key;
+		std::vector<size_t> definedFunctions;
+		std::vector<size_t> declaredFunctions;
+		for (size_t index : batches[i])
+		{
+			key += std::to_string(keys[index].size()) + ":" + keys[index];
+			definedFunctions.push_back(functions[index]);
+			const std::vector<size_t> callees = graph.GetCallees(functions[index]);
+			declaredFunctions.insert(declaredFunctions.end(), callees.begin(), callees.end());
+		}
+		if (m_compileCache->LoadFunctions(key, m_outputObjects[i]))
+		{
+			continue;
+		}
+
+		declaredFunctions.insert(declaredFunctions.end(), definedFunctions.begin(), definedFunctions.end());
+		std::sort(declaredFunctions.begin(), declaredFunctions.end());
+		declaredFunctions.erase(std::unique(declaredFunctions.begin(), declaredFunctions.end()), declaredFunctions.end());
+
+		CodegenContext context;
+		context.GetUtils().GetBuilder().setFastMathFlags(GetFastMathFlags(m_options));
+		Codegen generator(context, semantics);
+		generator.GeneratePart(program, declaredFunctions, definedFunctions, externalFunctions);
+
+		llvm::Module& llvmModule = context.GetUtils().GetModule();
+		SetModuleTarget(llvmModule, targetMachine);
+		OptimizeModule(llvmModule, targetMachine, m_options.optimizationLevel, m_options.sizeLevel);
+		EmitObjectCodeToMemory(llvmModule, targetMachine, m_outputObjects[i]);
+		m_compileCache->StoreFunctions(key, m_outputObjects[i]);
+	}
+}
+
+// Parts are generated, optimized and compiled by their own threads into their own LLVM contexts,
+//  like separate translation units: calls between parts are resolved by the linker, so nothing is merged
+//  on this thread. Optimizer doesn't see across parts, calls between them aren't inlined
+void CompilerDriver::CompileParts(const ProgramAST& program, const SemanticInfo& semantics, const std::vector<size_t>& functions)
+{
+	const unsigned partCount = unsigned(std::max<size_t>(std::min<size_t>(m_options.irgenThreads, functions.size()), 1));
+	const std::vector<std::string> externalFunctions = GetExternalFunctions(m_options);
+
+	// Target machines are created here, registry of targets isn't initialized in parallel
+	std::vector<std::unique_ptr<llvm::TargetMachine>> targetMachines;
+	for (unsigned part = 0; part < partCount; ++part)
+	{
+		targetMachines.push_back(CreateTargetMachine());
+	}
+
+	m_outputObjects.resize(partCount);
+	std::vector<std::exception_ptr> errors(partCount);
+	std::vector<std::thread> threads;
+	for (unsigned part = 0; part < partCount; ++part)
+	{
+		threads.emplace_back([&, part] {
+			try
+			{
+				// Functions are distributed round-robin rather than on demand, so objects don't depend on scheduling of threads
+				std::vector<size_t> definedFunctions;
+				for (size_t i = part; i < functions.size(); i += partCount)
+				{
+					definedFunctions.push_back(functions[i]);
+				}
+
+				CodegenContext context;
+				context.GetUtils().GetBuilder().setFastMathFlags(GetFastMathFlags(m_options));
+				Codegen generator(context, semantics);
+				generator.GeneratePart(program, functions, definedFunctions, externalFunctions);
+
+				llvm::Module& llvmModule = context.GetUtils().GetModule();
+				llvm::TargetMachine& targetMachine = *targetMachines[part];
+				SetModuleTarget(llvmModule, targetMachine);
+				OptimizeModule(llvmModule, targetMachine, m_options.optimizationLevel, m_options.sizeLevel);
+				EmitObjectCodeToMemory(llvmModule, targetMachine, m_outputObjects[part]);
+			}
+			catch (...)
+			{
+				errors[part] = std::current_exception();
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	for (const std::exception_ptr& error : errors)
+	{
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+}
+
+std::unique_ptr<ProgramAST> CompilerDriver::Parse(const std::string& text)
+{
+	auto grammar = CreateGrammar();
+
+	std::unique_ptr<ParseCache> cache;
+	if (!m_options.parseCacheDirectory.empty())
+	{
+		cache = std::make_unique<ParseCache>(m_options.parseCacheDirectory, GetGrammarVersion(*grammar));
+		if (auto ast = cache->Load(text))
+		{
+			// Cache hit: building of the parser table and parsing itself are skipped
+			return ast;
+		}
+	}
+
+	auto parser = CreateParser(*grammar);
 	auto ast = parser->Parse(text);
 
 	if (!ast)
@@ -175,11 +766,23 @@ void CompilerDriver::Compile(const std::string& text)
 		throw std::runtime_error("can't build ast");
 	}
 
-	Codegen generator(m_context);
-	generator.Generate(*ast);
+	if (cache)
+	{
+		cache->Store(text, *ast);
+	}
+	return ast;
+}
+
+llvm::TargetMachine& CompilerDriver::GetTargetMachine()
+{
+	if (!m_targetMachine)
+	{
+		m_targetMachine = CreateTargetMachine();
+	}
+	return *m_targetMachine;
 }
 
-void CompilerDriver::SaveObjectCodeToFile(const std::string& filepath)
+std::unique_ptr<llvm::TargetMachine> CompilerDriver::CreateTargetMachine()
 {
 	auto targetTriple = llvm::sys::getDefaultTargetTriple();
 
@@ -191,7 +794,6 @@ void CompilerDriver::SaveObjectCodeToFile(const std::string& filepath)
 
 	std::string error;
 	auto target = llvm::TargetRegistry::lookupTarget(targetTriple, error);
-	llvm::Triple hostTriple(targetTriple);
 
 	// Print an error and exit if we couldn't find the requested target.
 	// This generally occurs if we've forgotten to initialise the
@@ -201,12 +803,53 @@ void CompilerDriver::SaveObjectCodeToFile(const std::string& filepath)
 		throw std::runtime_error(error);
 	}
 
-	auto cpu = "generic";
-	auto features = "";
+	std::string cpu;
+	const std::string features = GetTargetFeatures(m_options, cpu);
+
+	std::unique_ptr<llvm::MCSubtargetInfo> subtargetInfo(target->createMCSubtargetInfo(targetTriple, cpu, features));
+	if (!subtargetInfo->isCPUStringValid(cpu))
+	{
+		throw std::runtime_error("unknown target cpu '" + cpu + "'");
+	}
 
+	// Backend checks some of the relaxations for the whole function rather than per operation
+	const llvm::FastMathFlags fastMathFlags = GetFastMathFlags(m_options);
 	llvm::TargetOptions opt;
+	opt.AllowFPOpFusion = fastMathFlags.allowContract() ? llvm::FPOpFusion::Fast : llvm::FPOpFusion::Standard;
+	opt.UnsafeFPMath = fastMathFlags.isFast();
+	opt.NoNaNsFPMath = fastMathFlags.noNaNs();
+	opt.NoInfsFPMath = fastMathFlags.noInfs();
 	auto rm = llvm::Optional<llvm::Reloc::Model>();
-	auto targetMachine = target->createTargetMachine(targetTriple, cpu, features, opt, rm);
+	return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(targetTriple, cpu, features, opt, rm,
+		llvm::None, GetCodeGenOptLevel(m_options.optimizationLevel)));
+}
+
+void CompilerDriver::SaveObjectCodeToFile(const std::string& filepath)
+{
+	if (!m_outputObjects.empty())
+	{
+		// Objects are compiled already, every part and every function in per-function mode has its own file
+		const bool isPartitioned = m_options.cacheFunctions || m_options.irgenThreads > 1;
+		for (size_t i = 0; i < m_outputObjects.size(); ++i)
+		{
+			auto file = file_utils::OpenFileForWriting(isPartitioned ? GetPartitionPath(filepath, i) : filepath,
+				std::ios::out | std::ios::binary);
+			file->write(m_outputObjects[i].data(), m_outputObjects[i].size());
+		}
+		return;
+	}
+
+	llvm::TargetMachine& targetMachine = GetTargetMachine();
+
+	//    IR-   .
+	llvm::Module& llvmModule = m_context.GetUtils().GetModule();
+	llvmModule.setDataLayout(targetMachine.createDataLayout());
+
+	if (m_options.codegenPartitions > 1)
+	{
+		SavePartitionedObjectCode(filepath);
+		return;
+	}
 
 	std::error_code errorCode;
 	llvm::raw_fd_ostream dest(filepath.c_str(), errorCode, llvm::sys::fs::F_None);
@@ -216,29 +859,158 @@ void CompilerDriver::SaveObjectCodeToFile(const std::string& filepath)
 		throw std::runtime_error("Could not open file: " + errorCode.message());
 	}
 
-	llvm::legacy::PassManager pass;
-
-	llvm::TargetLibraryInfoImpl TLII(hostTriple);
-	pass.add(new llvm::TargetLibraryInfoWrapperPass(TLII));
+	EmitObjectCode(llvmModule, targetMachine, dest);
+	dest.flush();
+}
 
-	//    IR-   .
+// Partitions are compiled like LTO backends do it: every thread reads the module from bitcode
+//  to its own LLVM context, because contexts can't be used by several threads, and drops bodies
+//  of functions from other partitions, so the module is serialized only once
+void CompilerDriver::SavePartitionedObjectCode(const std::string& filepath)
+{
 	llvm::Module& llvmModule = m_context.GetUtils().GetModule();
-	llvmModule.setDataLayout(targetMachine->createDataLayout());
+	const std::vector<unsigned> partitions = AssignPartitions(llvmModule, m_options.codegenPartitions);
+
+	std::string bitcode;
+	llvm::raw_string_ostream out(bitcode);
+	llvm::WriteBitcodeToFile(llvmModule, out);
+	out.flush();
 
-	if (targetMachine->addPassesToEmitFile(pass, dest, nullptr, llvm::TargetMachine::CGFT_ObjectFile, false, nullptr))
+	// Target machines are created here, registry of targets isn't initialized in parallel
+	std::vector<std::unique_ptr<llvm::TargetMachine>> targetMachines;
+	for (unsigned partition = 0; partition < m_options.codegenPartitions; ++partition)
 	{
-		throw std::runtime_error("TargetMachine can't emit a file of this type");
+		targetMachines.push_back(CreateTargetMachine());
 	}
 
-	pass.run(llvmModule);
-	dest.flush();
+	std::vector<std::exception_ptr> errors(m_options.codegenPartitions);
+	std::vector<std::thread> threads;
+	for (unsigned partition = 0; partition < m_options.codegenPartitions; ++partition)
+	{
+		threads.emplace_back([&, partition] {
+			try
+			{
+				// Bodies are read lazily, so only functions of the partition are read
+				llvm::LLVMContext context;
+				auto partitionModule = llvm::getLazyBitcodeModule(llvm::MemoryBufferRef(bitcode, "partition"), context);
+				if (!partitionModule)
+				{
+					throw std::runtime_error(llvm::toString(partitionModule.takeError()));
+				}
+				KeepPartition(**partitionModule, partitions, partition);
+				if (llvm::Error error = (*partitionModule)->materializeAll())
+				{
+					throw std::runtime_error(llvm::toString(std::move(error)));
+				}
+
+				std::error_code errorCode;
+				llvm::raw_fd_ostream dest(GetPartitionPath(filepath, partition), errorCode, llvm::sys::fs::F_None);
+				if (errorCode)
+				{
+					throw std::runtime_error("Could not open file: " + errorCode.message());
+				}
+				EmitObjectCode(**partitionModule, *targetMachines[partition], dest);
+				dest.flush();
+			}
+			catch (...)
+			{
+				errors[partition] = std::current_exception();
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	for (const std::exception_ptr& error : errors)
+	{
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
 }
 
 void CompilerDriver::SaveIRToFile(const std::string& filepath)
 {
+	if (m_options.cacheFunctions || m_options.irgenThreads > 1)
+	{
+		throw std::logic_error("IR of the whole program isn't generated in per-function and parallel modes");
+	}
+	if (m_compileCache)
+	{
+		auto file = file_utils::OpenFileForWriting(filepath);
+		file->write(m_outputIR.data(), m_outputIR.size());
+		return;
+	}
+
 	auto file = file_utils::OpenFileForWriting(filepath);
 	CodegenUtils& codegenUtils = m_context.GetUtils();
 	llvm::Module& llvmModule = codegenUtils.GetModule();
 	llvm::raw_os_ostream os(*file);
 	llvmModule.print(os, nullptr);
 }
+
+int CompilerDriver::Run(const std::vector<std::string>& arguments)
+{
+	std::vector<std::string> argv = { m_options.inputFile };
+	argv.insert(argv.end(), arguments.begin(), arguments.end());
+
+	if (m_bytecode && m_options.tiered)
+	{
+		return RunTiered(argv);
+	}
+	if (m_bytecode)
+	{
+		return RunBytecode(*m_bytecode, argv);
+	}
+
+	llvm::TargetMachine& targetMachine = GetTargetMachine();
+
+	std::unique_ptr<JitObjectCache> cache;
+	if (!m_options.objectCacheDirectory.empty())
+	{
+		cache = std::make_unique<JitObjectCache>(m_options.objectCacheDirectory, m_options.objectCacheSizeLimit, targetMachine);
+	}
+
+	std::unique_ptr<JitEngine> engine;
+	if (m_options.lazy)
+	{
+		engine = std::make_unique<JitEngine>(targetMachine, [this, &targetMachine](llvm::Module& module) {
+			OptimizeModule(module, targetMachine, m_options.optimizationLevel, m_options.sizeLevel);
+		}, cache.get());
+	}
+	else
+	{
+		engine = std::make_unique<JitEngine>(targetMachine, cache.get());
+	}
+
+	std::unique_ptr<llvm::LLVMContext> context;
+	std::unique_ptr<llvm::Module> module;
+	m_context.GetUtils().ReleaseModule(context, module);
+	engine->AddModule(std::move(context), std::move(module));
+	return engine->RunMain(argv);
+}
+
+int CompilerDriver::RunTiered(const std::vector<std::string>& argv)
+{
+	llvm::TargetMachine& targetMachine = GetTargetMachine();
+	const CallGraph& graph = *m_callGraph;
+
+	// Hot function is generated with all of its callees, none of them is visible outside of the module
+	TieredEngine engine(*m_bytecode, targetMachine, [&](size_t function, CodegenContext& context) {
+		context.GetUtils().GetBuilder().setFastMathFlags(GetFastMathFlags(m_options));
+		Codegen generator(context, *m_semantics);
+		generator.Generate(*m_program, graph.GetReachableFunctions({ function }), {});
+		SetModuleTarget(context.GetUtils().GetModule(), targetMachine);
+	}, [&](llvm::Module& module) {
+		OptimizeModule(module, targetMachine, m_options.optimizationLevel, m_options.sizeLevel);
+	}, m_options.tierThreshold);
+
+	const int result = engine.RunMain(argv);
+
+	// Output of the program goes first
+	std::fflush(stdout);
+	engine.PrintReport(m_log);
+	return result;
+}
@@ -1,19 +1,57 @@
 #pragma once
 #include <string>
 #include <ostream>
+#include "Bytecode.h"
+#include "CallGraph.h"
 #include "CodegenContext.h"
+#include "CompileCache.h"
+#include "CompilerOptions.h"
+#include "SemanticAnalyzer.h"
+#include "../AST/AST.h"
 
 class CompilerDriver
 {
 public:
-	explicit CompilerDriver(std::ostream& log);
+	explicit CompilerDriver(std::ostream& log, const CompilerOptions& options = CompilerOptions());
 
 	void Compile(const std::string& text);
 
 	void SaveObjectCodeToFile(const std::string& filepath);
 	void SaveIRToFile(const std::string& filepath);
 
+	// Executes main of the compiled program in the JIT or in the interpreter, program name is passed as argv[0].
+	// Module is moved to the JIT, so it can't be saved after that
+	int Run(const std::vector<std::string>& arguments);
+
+private:
+	std::unique_ptr<ProgramAST> Parse(const std::string& text);
+	// Created on first use for the host
+	llvm::TargetMachine& GetTargetMachine();
+	std::unique_ptr<llvm::TargetMachine> CreateTargetMachine();
+	// Partitions of the module are compiled in parallel to files with their indices in names
+	void SavePartitionedObjectCode(const std::string& filepath);
+	// Every function is compiled in its own module through the compile cache
+	void CompileFunctions(const ProgramAST& program, const SemanticInfo& semantics, const CallGraph& graph,
+		const std::vector<size_t>& functions);
+	// Parts of the program are compiled in parallel, every one to its own object
+	void CompileParts(const ProgramAST& program, const SemanticInfo& semantics, const std::vector<size_t>& functions);
+	int RunTiered(const std::vector<std::string>& argv);
+
 private:
 	std::ostream& m_log;
+	CompilerOptions m_options;
 	CodegenContext m_context;
+	std::unique_ptr<llvm::TargetMachine> m_targetMachine;
+	// Compiled instead of LLVM module in interpreter mode
+	std::unique_ptr<BytecodeProgram> m_bytecode;
+	// Kept in tiered mode for generation of hot functions
+	std::unique_ptr<ProgramAST> m_program;
+	std::unique_ptr<SemanticInfo> m_semantics;
+	// Built for reachable-only, per-function and tiered modes
+	std::unique_ptr<CallGraph> m_callGraph;
+	// With the compile cache and in parallel mode outputs are produced by Compile, files are written from memory;
+	//  there are several objects in per-function and parallel modes
+	std::unique_ptr<CompileCache> m_compileCache;
+	std::string m_outputIR;
+	std::vector<std::string> m_outputObjects;
 };
@@ -0,0 +1,247 @@
+#include "stdafx.h"
+#include "CompilerOptions.h"
+#include <algorithm>
+#include <cctype>
+#include <thread>
+
+namespace
+{
+// Returns true and stores value if argument has form "<name>=<value>"
+bool MatchOption(const std::string& argument, const std::string& name, std::string& value)
+{
+	if (argument.compare(0, name.length(), name) == 0 &&
+		argument.length() > name.length() &&
+		argument[name.length()] == '=')
+	{
+		value = argument.substr(name.length() + 1);
+		return true;
+	}
+	return false;
+}
+
+uint64_t ParseUnsigned(const std::string& value, const std::string& what)
+{
+	std::istringstream in(value);
+	uint64_t result = 0;
+	if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])) || !(in >> result) || !in.eof())
+	{
+		throw std::invalid_argument(what + " must be a non-negative integer, got '" + value + "'");
+	}
+	return result;
+}
+}
+
+CompilerOptions ParseCommandLine(int argc, char** argv)
+{
+	CompilerOptions options;
+	bool inputFileSpecified = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument = argv[i];
+		std::string value;
+
+		if (MatchOption(argument, "--parse-cache", value))
+		{
+			if (value.empty())
+			{
+				throw std::invalid_argument("parse cache directory can't be empty");
+			}
+			options.parseCacheDirectory = value;
+		}
+		else if (argument == "--reachable-only")
+		{
+			options.reachableOnly = true;
+		}
+		else if (MatchOption(argument, "--export", value))
+		{
+			// Comma separated list of names, implies --reachable-only
+			std::istringstream names(value);
+			std::string name;
+			while (std::getline(names, name, ','))
+			{
+				if (name.empty())
+				{
+					throw std::invalid_argument("exported function name can't be empty");
+				}
+				options.exportedFunctions.push_back(name);
+			}
+			if (options.exportedFunctions.empty())
+			{
+				throw std::invalid_argument("export list can't be empty");
+			}
+			options.reachableOnly = true;
+		}
+		else if (MatchOption(argument, "-march", value) || MatchOption(argument, "-mcpu", value))
+		{
+			if (value.empty())
+			{
+				throw std::invalid_argument("target cpu can't be empty");
+			}
+			options.targetCpu = value;
+		}
+		else if (MatchOption(argument, "-mattr", value))
+		{
+			if (value.empty())
+			{
+				throw std::invalid_argument("target features can't be empty");
+			}
+			options.targetFeatures += options.targetFeatures.empty() ? value : "," + value;
+		}
+		else if (argument == "--fast-math")
+		{
+			options.fastMath = true;
+		}
+		else if (argument == "--fp-reassoc")
+		{
+			options.fpReassociate = true;
+		}
+		else if (argument == "--fp-contract")
+		{
+			options.fpContract = true;
+		}
+		else if (argument == "--no-nans")
+		{
+			options.fpNoNaNs = true;
+		}
+		else if (argument == "--no-infs")
+		{
+			options.fpNoInfs = true;
+		}
+		else if (MatchOption(argument, "--irgen-threads", value))
+		{
+			options.irgenThreads = unsigned(ParseUnsigned(value, "IR generation thread count"));
+			if (options.irgenThreads == 0)
+			{
+				options.irgenThreads = std::max(std::thread::hardware_concurrency(), 1u);
+			}
+		}
+		else if (MatchOption(argument, "--codegen-partitions", value))
+		{
+			options.codegenPartitions = unsigned(ParseUnsigned(value, "codegen partition count"));
+			if (options.codegenPartitions == 0)
+			{
+				options.codegenPartitions = std::max(std::thread::hardware_concurrency(), 1u);
+			}
+		}
+		else if (argument == "--run")
+		{
+			options.run = true;
+		}
+		else if (argument == "--lazy")
+		{
+			options.run = true;
+			options.lazy = true;
+		}
+		else if (argument == "--interpret")
+		{
+			options.run = true;
+			options.interpret = true;
+		}
+		else if (argument == "--tiered")
+		{
+			options.run = true;
+			options.interpret = true;
+			options.tiered = true;
+		}
+		else if (MatchOption(argument, "--tier-threshold", value))
+		{
+			options.tierThreshold = ParseUnsigned(value, "tier threshold");
+			if (options.tierThreshold == 0)
+			{
+				throw std::invalid_argument("tier threshold must be positive");
+			}
+		}
+		else if (MatchOption(argument, "--object-cache", value))
+		{
+			if (value.empty())
+			{
+				throw std::invalid_argument("object cache directory can't be empty");
+			}
+			options.objectCacheDirectory = value;
+		}
+		else if (MatchOption(argument, "--object-cache-size", value))
+		{
+			options.objectCacheSizeLimit = ParseUnsigned(value, "object cache size") * 1024 * 1024;
+		}
+		else if (MatchOption(argument, "--compile-cache", value))
+		{
+			if (value.empty())
+			{
+				throw std::invalid_argument("compile cache directory can't be empty");
+			}
+			options.compileCacheDirectory = value;
+		}
+		else if (MatchOption(argument, "--compile-cache-size", value))
+		{
+			options.compileCacheSizeLimit = ParseUnsigned(value, "compile cache size") * 1024 * 1024;
+		}
+		else if (argument == "--cache-functions")
+		{
+			options.cacheFunctions = true;
+		}
+		else if (argument == "--")
+		{
+			options.programArguments.assign(argv + i + 1, argv + argc);
+			break;
+		}
+		else if (argument == "-Os")
+		{
+			options.optimizationLevel = 2;
+			options.sizeLevel = 1;
+		}
+		else if (argument.length() == 3 && argument.compare(0, 2, "-O") == 0 && argument[2] >= '0' && argument[2] <= '3')
+		{
+			options.optimizationLevel = unsigned(argument[2] - '0');
+			options.sizeLevel = 0;
+		}
+		else if (!argument.empty() && argument[0] == '-')
+		{
+			throw std::invalid_argument("unknown option '" + argument + "'");
+		}
+		else if (!inputFileSpecified)
+		{
+			options.inputFile = argument;
+			inputFileSpecified = true;
+		}
+		else
+		{
+			throw std::invalid_argument("only one input file can be specified");
+		}
+	}
+
+	if (!options.programArguments.empty() && !options.run)
+	{
+		throw std::invalid_argument("program arguments can be passed only with --run");
+	}
+	if (options.codegenPartitions > 1 && options.run)
+	{
+		throw std::invalid_argument("--codegen-partitions can't be combined with --run");
+	}
+	if (options.irgenThreads > 1 && (options.run || options.codegenPartitions > 1 || !options.compileCacheDirectory.empty()))
+	{
+		throw std::invalid_argument("--irgen-threads can't be combined with --run, --codegen-partitions and compile cache");
+	}
+	if (!options.objectCacheDirectory.empty() && !options.run)
+	{
+		throw std::invalid_argument("object cache can be used only with --run");
+	}
+	if (options.interpret && (options.lazy || !options.objectCacheDirectory.empty()))
+	{
+		throw std::invalid_argument("--interpret can't be combined with --lazy and object cache");
+	}
+	if (!options.compileCacheDirectory.empty() && (options.run || options.codegenPartitions > 1))
+	{
+		throw std::invalid_argument("compile cache can't be combined with --run and --codegen-partitions");
+	}
+	if (options.cacheFunctions && options.compileCacheDirectory.empty())
+	{
+		throw std::invalid_argument("--cache-functions requires --compile-cache");
+	}
+	if (options.tiered && options.optimizationLevel < 2)
+	{
+		options.optimizationLevel = 3;
+		options.sizeLevel = 0;
+	}
+	return options;
+}
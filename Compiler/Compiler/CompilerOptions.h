@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CompilerOptions
+{
+	std::string inputFile = "input.txt";
+	// Directory of the parse cache, caching is disabled if it's empty
+	std::string parseCacheDirectory;
+	// Only functions reachable from the entry points are generated:
+	//  from exported functions if they are listed, otherwise from main
+	bool reachableOnly = false;
+	std::vector<std::string> exportedFunctions;
+	// --irgen-threads=<count> splits the program into parts, that are generated, optimized and compiled
+	//  to separate object files in parallel ("output.0.o", ...), 0 means count of processor cores
+	unsigned irgenThreads = 1;
+	// --codegen-partitions=<count> splits the optimized module into partitions, that are compiled
+	//  to separate object files in parallel ("output.0.o", ...), 0 means count of processor cores
+	unsigned codegenPartitions = 1;
+	// -O0..-O3 set optimization level, -Os sets level 2 with size level 1
+	unsigned optimizationLevel = 0;
+	unsigned sizeLevel = 0;
+	// -march=/-mcpu= select processor of the target, "native" means processor of the host
+	//  with its detected features; -mattr= adds comma separated "+feature"/"-feature" list
+	std::string targetCpu = "generic";
+	std::string targetFeatures;
+	// Floating point arithmetic may be optimized as if it was real arithmetic:
+	//  --fast-math enables all relaxations, others enable only one of them
+	bool fastMath = false;
+	bool fpReassociate = false; // --fp-reassoc
+	bool fpContract = false; // --fp-contract, fusion of multiply and add
+	bool fpNoNaNs = false; // --no-nans
+	bool fpNoInfs = false; // --no-infs
+	// --run executes main in the JIT instead of writing output files,
+	//  arguments after "--" are passed to the program
+	bool run = false;
+	// --lazy implies --run, every function is optimized and compiled on its first call
+	bool lazy = false;
+	// --interpret implies --run, main is executed by the bytecode interpreter without LLVM
+	bool interpret = false;
+	// --tiered implies --interpret, functions that are called or loop --tier-threshold=<count> times
+	//  are compiled in the background and called natively after that; optimization level
+	//  of the native tier is raised to -O3, if lower than -O2 is specified
+	bool tiered = false;
+	uint64_t tierThreshold = 1000;
+	std::vector<std::string> programArguments;
+	// Directory of the JIT object cache, caching is disabled if it's empty;
+	//  least recently used objects are removed when the cache exceeds the size limit
+	std::string objectCacheDirectory;
+	uint64_t objectCacheSizeLimit = 512 * 1024 * 1024; // --object-cache-size in megabytes, 0 - no limit
+	// --compile-cache=<directory> stores IR and object code of compiled programs by hash of the source text
+	//  and of the configuration, the same program isn't parsed and compiled again
+	std::string compileCacheDirectory;
+	uint64_t compileCacheSizeLimit = 512 * 1024 * 1024; // --compile-cache-size in megabytes, 0 - no limit
+	// --cache-functions compiles batches of about 16 functions to their own object files ("output.0.o", ...)
+	//  through the compile cache, so only batches of changed functions are compiled again; IR file isn't written
+	//  and functions of different batches aren't inlined into each other
+	bool cacheFunctions = false;
+};
+
+// Throws std::invalid_argument if command line contains unknown or malformed options
+CompilerOptions ParseCommandLine(int argc, char** argv);
@@ -0,0 +1,171 @@
+#include "stdafx.h"
+#include "JitEngine.h"
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/MC/SubtargetFeature.h>
+
+namespace
+{
+void ThrowIfFailed(llvm::Error error)
+{
+	if (error)
+	{
+		throw std::runtime_error(llvm::toString(std::move(error)));
+	}
+}
+
+template <typename T>
+T GetOrThrow(llvm::Expected<T> value)
+{
+	if (!value)
+	{
+		throw std::runtime_error(llvm::toString(value.takeError()));
+	}
+	return std::move(*value);
+}
+
+// JIT is created for the same target as the given target machine
+llvm::orc::JITTargetMachineBuilder CreateTargetMachineBuilder(const llvm::TargetMachine& targetMachine)
+{
+	llvm::orc::JITTargetMachineBuilder builder(targetMachine.getTargetTriple());
+	builder.setCPU(targetMachine.getTargetCPU().str());
+	builder.addFeatures(llvm::SubtargetFeatures(targetMachine.getTargetFeatureString()).getFeatures());
+	builder.setOptions(targetMachine.Options);
+	builder.setCodeGenOptLevel(targetMachine.getOptLevel());
+	return builder;
+}
+
+// Objects are looked up in the cache before running the backend and are stored to it after
+template <typename Builder>
+auto CreateJit(const llvm::TargetMachine& targetMachine, llvm::ObjectCache* cache)
+{
+	Builder builder;
+	builder.setJITTargetMachineBuilder(CreateTargetMachineBuilder(targetMachine));
+	if (cache)
+	{
+		builder.setCompileFunctionCreator([cache](llvm::orc::JITTargetMachineBuilder targetMachineBuilder) -> llvm::Expected<llvm::orc::IRCompileLayer::CompileFunction> {
+			auto compilerTargetMachine = targetMachineBuilder.createTargetMachine();
+			if (!compilerTargetMachine)
+			{
+				return compilerTargetMachine.takeError();
+			}
+			return llvm::orc::TMOwningSimpleCompiler(std::move(*compilerTargetMachine), cache);
+		});
+	}
+	return GetOrThrow(builder.create());
+}
+
+// Undefined symbols of generated code are searched in the host process
+void AddProcessSymbols(llvm::orc::LLJIT& jit)
+{
+	const char prefix = jit.getDataLayout().getGlobalPrefix();
+	jit.getMainJITDylib().setGenerator(
+		GetOrThrow(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix)));
+}
+
+template <typename Result, typename... Args>
+Result CallAddress(llvm::JITTargetAddress address, Args... args)
+{
+	return reinterpret_cast<Result(*)(Args...)>(static_cast<uintptr_t>(address))(args...);
+}
+}
+
+JitEngine::JitEngine(const llvm::TargetMachine& targetMachine, llvm::ObjectCache* cache)
+	: m_lazyJit(nullptr)
+	, m_hasMain(false)
+	, m_mainTakesArguments(false)
+	, m_mainReturnsInt(false)
+{
+	m_jit = CreateJit<llvm::orc::LLJITBuilder>(targetMachine, cache);
+	AddProcessSymbols(*m_jit);
+}
+
+JitEngine::JitEngine(const llvm::TargetMachine& targetMachine, ModuleOptimizer optimizer, llvm::ObjectCache* cache)
+	: m_lazyJit(nullptr)
+	, m_hasMain(false)
+	, m_mainTakesArguments(false)
+	, m_mainReturnsInt(false)
+{
+	auto lazyJit = CreateJit<llvm::orc::LLLazyJITBuilder>(targetMachine, cache);
+
+	// Partition contains only the requested function, its callees are reached through stubs
+	lazyJit->setPartitionFunction(llvm::orc::CompileOnDemandLayer::compileRequested);
+	lazyJit->setLazyCompileTransform([optimizer](llvm::orc::ThreadSafeModule module, const auto&) -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+		optimizer(*module.getModule());
+		return module;
+	});
+
+	m_lazyJit = lazyJit.get();
+	m_jit = std::move(lazyJit);
+	AddProcessSymbols(*m_jit);
+}
+
+void JitEngine::AddModule(std::unique_ptr<llvm::LLVMContext> context, std::unique_ptr<llvm::Module> module)
+{
+	if (llvm::Function* main = module->getFunction("main"))
+	{
+		llvm::FunctionType* type = main->getFunctionType();
+		m_mainTakesArguments = type->getNumParams() == 2 &&
+			type->getParamType(0)->isIntegerTy(32) &&
+			type->getParamType(1)->isPointerTy();
+		m_mainReturnsInt = type->getReturnType()->isIntegerTy(32);
+
+		if ((type->getNumParams() != 0 && !m_mainTakesArguments) ||
+			(!type->getReturnType()->isVoidTy() && !m_mainReturnsInt))
+		{
+			throw std::runtime_error("main can't be run: it must take no parameters or (argc: Int, argv: Array<String>) and return Int or nothing");
+		}
+		m_hasMain = true;
+	}
+
+	llvm::orc::ThreadSafeModule threadSafeModule(std::move(module), std::move(context));
+	if (m_lazyJit)
+	{
+		ThrowIfFailed(m_lazyJit->addLazyIRModule(std::move(threadSafeModule)));
+	}
+	else
+	{
+		ThrowIfFailed(m_jit->addIRModule(std::move(threadSafeModule)));
+	}
+}
+
+int JitEngine::RunMain(const std::vector<std::string>& arguments)
+{
+	if (!m_hasMain)
+	{
+		throw std::runtime_error("program doesn't have main function");
+	}
+
+	// Generated code is compiled here, on the first lookup; in lazy mode only main is compiled
+	//  and the other functions are compiled when they are called
+	const llvm::JITTargetAddress address = GetSymbolAddress("main");
+
+	std::vector<char*> argv;
+	for (const std::string& argument : arguments)
+	{
+		argv.push_back(const_cast<char*>(argument.c_str()));
+	}
+	argv.push_back(nullptr);
+	const int argc = int(arguments.size());
+
+	if (m_mainReturnsInt)
+	{
+		return m_mainTakesArguments ?
+			CallAddress<int>(address, argc, argv.data()) :
+			CallAddress<int>(address);
+	}
+
+	if (m_mainTakesArguments)
+	{
+		CallAddress<void>(address, argc, argv.data());
+	}
+	else
+	{
+		CallAddress<void>(address);
+	}
+	return 0;
+}
+
+llvm::JITTargetAddress JitEngine::GetSymbolAddress(const std::string& name)
+{
+	return GetOrThrow(m_jit->lookup(name)).getAddress();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#pragma warning(push, 0)
+#pragma warning(disable: 4146)
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Target/TargetMachine.h>
+#pragma warning(pop)
+
+// In-process execution of generated code with ORC JIT.
+// Code is compiled for the same target as object files, external symbols
+//  (printf, scanf and library functions called by the backend) are resolved in the host process.
+class JitEngine
+{
+public:
+	using ModuleOptimizer = std::function<void(llvm::Module& module)>;
+
+	// Whole module is compiled on the first lookup of main.
+	// Compiled objects are reused from the cache if it's given, it must outlive the engine
+	explicit JitEngine(const llvm::TargetMachine& targetMachine, llvm::ObjectCache* cache = nullptr);
+	// Lazy mode: every function is split into its own module, that is optimized and compiled
+	//  on the first call of the function, calls go through stubs that jump to the compiler
+	JitEngine(const llvm::TargetMachine& targetMachine, ModuleOptimizer optimizer, llvm::ObjectCache* cache = nullptr);
+
+	void AddModule(std::unique_ptr<llvm::LLVMContext> context, std::unique_ptr<llvm::Module> module);
+
+	// main may be declared without parameters or with (argc: Int, argv: Array<String>),
+	//  arguments are passed as argv, returns result of main or 0 if it returns nothing
+	int RunMain(const std::vector<std::string>& arguments);
+
+	// Code of the symbol is compiled on the first lookup, throws if the symbol isn't defined
+	llvm::JITTargetAddress GetSymbolAddress(const std::string& name);
+
+private:
+	std::unique_ptr<llvm::orc::LLJIT> m_jit;
+	llvm::orc::LLLazyJIT* m_lazyJit; // nullptr in eager mode
+	bool m_hasMain;
+	bool m_mainTakesArguments;
+	bool m_mainReturnsInt;
+};
@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "JitObjectCache.h"
+#include "CacheFiles.h"
+#include <cstring>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CachePruning.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace
+{
+// Module identifier and source file name don't affect the code, in lazy mode they differ
+//  for partitions of the same function
+std::string PrintModuleCode(const llvm::Module& module)
+{
+	std::string text;
+	llvm::raw_string_ostream out(text);
+	module.print(out, nullptr);
+	out.flush();
+
+	size_t begin = 0;
+	for (const char* header : { "; ModuleID", "source_filename" })
+	{
+		if (text.compare(begin, std::strlen(header), header) == 0)
+		{
+			const size_t end = text.find('\n', begin);
+			begin = (end == std::string::npos) ? text.size() : end + 1;
+		}
+	}
+	return text.substr(begin);
+}
+}
+
+JitObjectCache::JitObjectCache(const std::string& directory, uint64_t maxSizeBytes, const llvm::TargetMachine& targetMachine)
+	: m_directory(directory)
+	, m_maxSizeBytes(maxSizeBytes)
+	, m_stored(false)
+{
+	m_targetKey = std::string(LLVM_VERSION_STRING) + "|" +
+		targetMachine.getTargetTriple().str() + "|" +
+		targetMachine.getTargetCPU().str() + "|" +
+		targetMachine.getTargetFeatureString().str() + "|" +
+		std::to_string(int(targetMachine.getOptLevel()));
+}
+
+JitObjectCache::~JitObjectCache()
+{
+	// Pruning scans the whole directory, so it's done once for all objects stored by the run.
+	// Entry is an object of a module, there are few of them, so the limit is kept on every run
+	if (m_stored)
+	{
+		llvm::CachePruningPolicy policy;
+		policy.Interval = std::chrono::seconds(0);
+		policy.MaxSizeBytes = m_maxSizeBytes;
+		llvm::pruneCache(m_directory, policy);
+	}
+}
+
+void JitObjectCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object)
+{
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_pendingEntries.find(module);
+		if (found == m_pendingEntries.end())
+		{
+			return;
+		}
+		path = std::move(found->second);
+		m_pendingEntries.erase(found);
+	}
+
+	if (!WriteCacheEntry(m_directory, path, object.getBuffer()))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stored = true;
+}
+
+std::unique_ptr<llvm::MemoryBuffer> JitObjectCache::getObject(const llvm::Module* module)
+{
+	const std::string path = GetEntryPath(*module);
+
+	auto buffer = ReadCacheEntry(path);
+	if (!buffer)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pendingEntries[module] = path;
+	}
+	return buffer;
+}
+
+std::string JitObjectCache::GetEntryPath(const llvm::Module& module)const
+{
+	llvm::MD5 hash;
+	hash.update(m_targetKey);
+	hash.update(PrintModuleCode(module));
+	return GetCacheEntryPath(m_directory, hash, ".o");
+}
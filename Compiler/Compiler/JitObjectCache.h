@@ -0,0 +1,38 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#pragma warning(push, 0)
+#pragma warning(disable: 4146)
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Target/TargetMachine.h>
+#pragma warning(pop)
+
+// On-disk cache of objects compiled by the JIT.
+// Entry is named by hash of the module IR and the target configuration (triple, cpu, features,
+//  backend optimization level and LLVM version), so on warm start the backend isn't run.
+// Least recently used entries are removed when total size of the cache exceeds the limit.
+class JitObjectCache : public llvm::ObjectCache
+{
+public:
+	JitObjectCache(const std::string& directory, uint64_t maxSizeBytes, const llvm::TargetMachine& targetMachine);
+	~JitObjectCache();
+
+	// Failures of the cache are ignored: object is compiled as if there was no cache
+	void notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) override;
+	std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* module) override;
+
+private:
+	std::string GetEntryPath(const llvm::Module& module)const;
+
+private:
+	std::string m_directory;
+	uint64_t m_maxSizeBytes;
+	std::string m_targetKey;
+	bool m_stored;
+
+	// Path is computed once for the module: on miss it's used again to store the object
+	std::mutex m_mutex;
+	std::unordered_map<const llvm::Module*, std::string> m_pendingEntries;
+};
@@ -0,0 +1,62 @@
+#include "stdafx.h"
+#include "OptimizationPipeline.h"
+
+#pragma warning(push, 0)
+#pragma warning(disable: 4146)
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#pragma warning(pop)
+
+void OptimizeModule(
+	llvm::Module& module,
+	llvm::TargetMachine& targetMachine,
+	unsigned optimizationLevel,
+	unsigned sizeLevel)
+{
+	if (optimizationLevel == 0)
+	{
+		return;
+	}
+
+	llvm::PassManagerBuilder builder;
+	builder.OptLevel = optimizationLevel;
+	builder.SizeLevel = sizeLevel;
+
+	// Builder takes ownership of the inliner and the library info
+	builder.Inliner = (optimizationLevel > 1) ?
+		llvm::createFunctionInliningPass(optimizationLevel, sizeLevel, false) :
+		llvm::createAlwaysInlinerLegacyPass();
+	builder.LibraryInfo = new llvm::TargetLibraryInfoImpl(llvm::Triple(module.getTargetTriple()));
+
+	const bool vectorize = optimizationLevel > 1 && sizeLevel == 0;
+	builder.LoopVectorize = vectorize;
+	builder.SLPVectorize = vectorize;
+
+	// Target specific passes and cost model of the target
+	targetMachine.adjustPassManager(builder);
+
+	llvm::legacy::FunctionPassManager functionPasses(&module);
+	functionPasses.add(llvm::createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+	builder.populateFunctionPassManager(functionPasses);
+
+	llvm::legacy::PassManager modulePasses;
+	modulePasses.add(llvm::createTargetTransformInfoWrapperPass(targetMachine.getTargetIRAnalysis()));
+	builder.populateModulePassManager(modulePasses);
+
+	functionPasses.doInitialization();
+	for (llvm::Function& function : module)
+	{
+		if (!function.isDeclaration())
+		{
+			functionPasses.run(function);
+		}
+	}
+	functionPasses.doFinalization();
+
+	modulePasses.run(module);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#pragma warning(push, 0)
+#pragma warning(disable: 4146)
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#pragma warning(pop)
+
+// Middle-end passes are selected by levels in the same way as clang does:
+//  0 - no passes, 1 - promotion of allocas to registers (mem2reg/SROA) and scalar cleanups,
+//  2 - also GVN, LICM, inlining and vectorization, 3 - more aggressive inlining and unrolling.
+// Size level 1 (-Os) disables vectorization and makes inlining and unrolling conservative.
+void OptimizeModule(
+	llvm::Module& module,
+	llvm::TargetMachine& targetMachine,
+	unsigned optimizationLevel,
+	unsigned sizeLevel);
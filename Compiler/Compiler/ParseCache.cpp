@@ -0,0 +1,45 @@
+#include "stdafx.h"
+#include "ParseCache.h"
+#include "CacheFiles.h"
+#include "../AST/ASTSerialization.h"
+
+ParseCache::ParseCache(const std::string& directory, const std::string& grammarVersion)
+	: m_directory(directory)
+	, m_grammarVersion(grammarVersion)
+{
+}
+
+std::unique_ptr<ProgramAST> ParseCache::Load(const std::string& text)const
+{
+	// Big entries are memory-mapped, so deserialization reads them directly from page cache
+	auto buffer = ReadCacheEntry(GetEntryPath(text));
+	if (!buffer)
+	{
+		return nullptr;
+	}
+
+	try
+	{
+		return DeserializeProgram(buffer->getBufferStart(), buffer->getBufferSize());
+	}
+	catch (const std::runtime_error&)
+	{
+		// Corrupted entry is treated as a miss, it will be overwritten after parsing
+		return nullptr;
+	}
+}
+
+void ParseCache::Store(const std::string& text, const ProgramAST& program)const
+{
+	// Failure is ignored like in other caches, the program is parsed again next time
+	WriteCacheEntry(m_directory, GetEntryPath(text), SerializeProgram(program));
+}
+
+std::string ParseCache::GetEntryPath(const std::string& text)const
+{
+	llvm::MD5 hash;
+	hash.update(m_grammarVersion);
+	hash.update(std::to_string(gcASTSerializationVersion));
+	hash.update(text);
+	return GetCacheEntryPath(m_directory, hash, ".ast");
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "../AST/AST.h"
+#include <string>
+
+// On-disk cache of parsed programs.
+// Entry is a serialized ast stored in a file, that is named by hash of the source text,
+//  grammar version and ast serialization format version, so stale entries are never matched.
+class ParseCache
+{
+public:
+	explicit ParseCache(const std::string& directory, const std::string& grammarVersion);
+
+	// Failures of the cache are ignored: Load returns nullptr if there is no valid entry for the text
+	std::unique_ptr<ProgramAST> Load(const std::string& text)const;
+	void Store(const std::string& text, const ProgramAST& program)const;
+
+private:
+	std::string GetEntryPath(const std::string& text)const;
+
+private:
+	std::string m_directory;
+	std::string m_grammarVersion;
+};
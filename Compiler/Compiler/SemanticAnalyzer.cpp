@@ -0,0 +1,758 @@
+#include "stdafx.h"
+#include "SemanticAnalyzer.h"
+#include "ScopeChain.h"
+#include "../AST/ASTTraversal.h"
+#include "../AST/StaticVisitor.h"
+#include <algorithm>
+
+namespace
+{
+bool IsNumeric(const ExpressionType& type)
+{
+	return type.nesting == 0 && type.value != ExpressionType::String;
+}
+
+// Value of type 'from' can be stored to variable (or passed as parameter) of type 'to'
+bool IsAssignable(const ExpressionType& from, const ExpressionType& to)
+{
+	return from == to || (IsNumeric(from) && IsNumeric(to));
+}
+
+// Type of element, that is accessed by the given number of indices;
+//  characters of string are represented as integers
+ExpressionType GetElementType(const ExpressionType& type, size_t indexCount)
+{
+	ExpressionType element = type;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		if (element.nesting != 0)
+		{
+			--element.nesting;
+		}
+		else
+		{
+			assert(element.value == ExpressionType::String);
+			element = { ExpressionType::Int, 0 };
+		}
+	}
+	return element;
+}
+
+// State of the analysis, that is shared by expression and statement checkers
+struct AnalysisState
+{
+	SemanticInfo& info;
+	std::unordered_map<std::string, size_t> functions;
+	ScopeChain<size_t> scopes;
+	size_t function;
+
+	size_t GetVariable(const std::string& name)
+	{
+		auto variable = scopes.GetValue(name);
+		if (!variable)
+		{
+			throw std::runtime_error("variable '" + name + "' is not defined");
+		}
+		return *variable;
+	}
+
+	const ExpressionType& GetVariableType(size_t variable)const
+	{
+		return info.GetFunction(function).variables[variable].type;
+	}
+
+	ExpressionType GetValueType(const IExpressionAST& node)const
+	{
+		const auto type = info.GetOptionalType(node);
+		if (!type)
+		{
+			const auto& call = static_cast<const FunctionCallExpressionAST&>(node);
+			throw std::runtime_error("function '" + call.GetName() + "' returns void - you can't use it in expressions");
+		}
+		return *type;
+	}
+};
+
+void CheckIndexable(const std::string& name, const ExpressionType& type, size_t indexCount)
+{
+	if (type.nesting == 0 && type.value != ExpressionType::String)
+	{
+		throw std::runtime_error("variable '" + name + "' can't be accessed via index");
+	}
+	if (indexCount > type.nesting + (type.value == ExpressionType::String ? 1 : 0))
+	{
+		auto fmt = boost::format("array %1% have only %2% dimension(s), but trying to access element by index #%3%")
+			% name
+			% type.nesting
+			% indexCount;
+		throw std::runtime_error(fmt.str());
+	}
+}
+
+void CheckIndex(const ExpressionType& type)
+{
+	if (!IsNumeric(type))
+	{
+		throw std::runtime_error("can't use value of type " + ToString(type) + " as array index");
+	}
+}
+
+void CheckCondition(const ExpressionType& type)
+{
+	if (!IsNumeric(type))
+	{
+		throw std::runtime_error("can't use value of type " + ToString(type) + " as condition");
+	}
+}
+
+// Types of children are already known when node is checked (post-order)
+class ExpressionChecker : private ExpressionVisitor<ExpressionChecker, void>
+{
+	friend class ExpressionVisitor<ExpressionChecker, void>;
+
+public:
+	explicit ExpressionChecker(AnalysisState& state)
+		: m_state(state)
+	{
+	}
+
+	void Check(const IExpressionAST& node)
+	{
+		ExpressionVisitor::Visit(node);
+	}
+
+private:
+	void Visit(const BinaryExpressionAST& node)
+	{
+		const ExpressionType left = m_state.GetValueType(node.GetLeft());
+		const ExpressionType right = m_state.GetValueType(node.GetRight());
+
+		const auto operandType = GetPreferredType(left, right);
+		if (!operandType || operandType->value == ExpressionType::String)
+		{
+			const auto fmt = boost::format("can't codegen operator '%1%' on operands with types '%2%' and '%3%'")
+				% ToString(node.GetOperator())
+				% ToString(left)
+				% ToString(right);
+			throw std::runtime_error(fmt.str());
+		}
+
+		switch (node.GetOperator())
+		{
+		case BinaryExpressionAST::Plus:
+		case BinaryExpressionAST::Minus:
+		case BinaryExpressionAST::Mul:
+		case BinaryExpressionAST::Div:
+		case BinaryExpressionAST::Mod:
+			if (operandType->value == ExpressionType::Bool)
+			{
+				throw std::runtime_error("can't perform codegen for operator '" + ToString(node.GetOperator()) + "' on two booleans");
+			}
+			Annotate(node, *operandType);
+			break;
+		default:
+			Annotate(node, ExpressionType{ ExpressionType::Bool, 0 });
+			break;
+		}
+	}
+
+	void Visit(const LiteralConstantAST& node)
+	{
+		const LiteralConstantAST::Value& constant = node.GetValue();
+		if (constant.type() == typeid(int))
+		{
+			Annotate(node, ExpressionType{ ExpressionType::Int, 0 });
+		}
+		else if (constant.type() == typeid(double))
+		{
+			Annotate(node, ExpressionType{ ExpressionType::Float, 0 });
+		}
+		else if (constant.type() == typeid(bool))
+		{
+			Annotate(node, ExpressionType{ ExpressionType::Bool, 0 });
+		}
+		else if (constant.type() == typeid(std::string))
+		{
+			Annotate(node, ExpressionType{ ExpressionType::String, 0 });
+		}
+		else
+		{
+			const auto& expressions = boost::get<std::vector<std::shared_ptr<IExpressionAST>>>(constant);
+			if (expressions.empty())
+			{
+				throw std::runtime_error("can't create empty array");
+			}
+
+			const ExpressionType type = m_state.GetValueType(*expressions.front());
+			for (const auto& expression : expressions)
+			{
+				if (m_state.GetValueType(*expression) != type)
+				{
+					throw std::runtime_error("all array literal element must have same type");
+				}
+			}
+
+			// Multidimensional arrays are stored in one buffer, so their literals must be rectangular
+			std::vector<unsigned> extents = { unsigned(expressions.size()) };
+			if (type.nesting != 0)
+			{
+				const std::vector<unsigned>* rowExtents = nullptr;
+				for (const auto& expression : expressions)
+				{
+					if (expression->GetKind() != ExpressionKind::Literal ||
+						(rowExtents && m_state.info.GetArrayExtents(*expression) != *rowExtents))
+					{
+						throw std::runtime_error("elements of multidimensional array literal must be array literals of the same size");
+					}
+					rowExtents = &m_state.info.GetArrayExtents(*expression);
+				}
+				extents.insert(extents.end(), rowExtents->begin(), rowExtents->end());
+			}
+
+			Annotate(node, ExpressionType{ type.value, type.nesting + 1 });
+			m_state.info.SetArrayExtents(node, extents);
+		}
+	}
+
+	void Visit(const UnaryAST& node)
+	{
+		const ExpressionType type = m_state.GetValueType(node.GetExpr());
+		switch (node.GetOperator())
+		{
+		case UnaryAST::Plus:
+			Annotate(node, type);
+			break;
+		case UnaryAST::Minus:
+			if (!IsNumeric(type))
+			{
+				throw std::runtime_error("can't codegen negative value of " + ToString(type) + " type");
+			}
+			Annotate(node, type);
+			break;
+		case UnaryAST::Negation:
+			CheckCondition(type);
+			Annotate(node, ExpressionType{ ExpressionType::Bool, 0 });
+			break;
+		default:
+			assert(false);
+			throw std::logic_error("can't check undefined unary operator");
+		}
+	}
+
+	void Visit(const IdentifierAST& node)
+	{
+		const size_t variable = m_state.GetVariable(node.GetName());
+		Annotate(node, m_state.GetVariableType(variable), variable);
+	}
+
+	void Visit(const FunctionCallExpressionAST& node)
+	{
+		auto found = m_state.functions.find(node.GetName());
+		if (found == m_state.functions.end())
+		{
+			throw std::runtime_error("calling function '" + node.GetName() + "' that isn't defined");
+		}
+
+		const SemanticInfo::Function& func = m_state.info.GetFunction(found->second);
+		if (func.params.size() != node.GetParamsCount())
+		{
+			boost::format fmt("function '%1%' expects %2% params, %3% given");
+			throw std::runtime_error((fmt % node.GetName() % func.params.size() % node.GetParamsCount()).str());
+		}
+
+		for (size_t i = 0; i < node.GetParamsCount(); ++i)
+		{
+			const ExpressionType type = m_state.GetValueType(node.GetParam(i));
+			if (!IsAssignable(type, func.params[i]))
+			{
+				auto fmt = boost::format("function '%1%' expects '%2%' as parameter, '%3%' given (can't cast)")
+					% node.GetName()
+					% ToString(func.params[i])
+					% ToString(type);
+				throw std::runtime_error(fmt.str());
+			}
+		}
+
+		m_state.info.SetExpressionInfo(node, func.returnType, found->second);
+	}
+
+	void Visit(const ArrayElementAccessAST& node)
+	{
+		const size_t variable = m_state.GetVariable(node.GetName());
+		const ExpressionType& type = m_state.GetVariableType(variable);
+
+		CheckIndexable(node.GetName(), type, node.GetIndexCount());
+		for (size_t i = 0; i < node.GetIndexCount(); ++i)
+		{
+			CheckIndex(m_state.GetValueType(node.GetIndex(i)));
+		}
+		Annotate(node, GetElementType(type, node.GetIndexCount()), variable);
+	}
+
+	void Annotate(const IExpressionAST& node, const ExpressionType& type, size_t symbol = SemanticInfo::npos)
+	{
+		m_state.info.SetExpressionInfo(node, type, symbol);
+	}
+
+private:
+	AnalysisState& m_state;
+};
+
+// Declarations are processed before children of statement, other checks - after them
+class StatementChecker : private StatementVisitor<StatementChecker, void>
+{
+	friend class StatementVisitor<StatementChecker, void>;
+
+public:
+	explicit StatementChecker(AnalysisState& state)
+		: m_state(state)
+	{
+	}
+
+	void Enter(const IStatementAST& node)
+	{
+		if (node.GetKind() == StatementKind::Composite)
+		{
+			m_state.scopes.PushScope();
+		}
+		else if (node.GetKind() == StatementKind::VariableDeclaration)
+		{
+			// Variable is visible in its own initializer, it has default value there
+			const auto& declaration = static_cast<const VariableDeclarationAST&>(node);
+			const std::string& name = declaration.GetIdentifier().GetName();
+			if (m_state.scopes.GetValue(name))
+			{
+				throw std::runtime_error("variable '" + name + "' is already defined");
+			}
+
+			const size_t variable = m_state.info.AddVariable(m_state.function, { name, declaration.GetType() });
+			m_state.scopes.Define(name, variable);
+			m_state.info.SetStatementVariable(node, variable);
+		}
+	}
+
+	void Leave(const IStatementAST& node)
+	{
+		StatementVisitor::Visit(node);
+	}
+
+private:
+	void Visit(const VariableDeclarationAST& node)
+	{
+		if (const IExpressionAST* expression = node.GetExpression())
+		{
+			CheckAssignment(node.GetIdentifier().GetName(), node.GetType(), m_state.GetValueType(*expression));
+		}
+	}
+
+	void Visit(const AssignStatementAST& node)
+	{
+		const std::string& name = node.GetIdentifier().GetName();
+		auto variable = m_state.scopes.GetValue(name);
+		if (!variable)
+		{
+			throw std::runtime_error("can't assign because variable '" + name + "' is not defined");
+		}
+
+		CheckAssignment(name, m_state.GetVariableType(*variable), m_state.GetValueType(node.GetExpr()));
+		m_state.info.SetStatementVariable(node, *variable);
+	}
+
+	void Visit(const ArrayElementAssignAST& node)
+	{
+		const size_t variable = m_state.GetVariable(node.GetName());
+		const ExpressionType& type = m_state.GetVariableType(variable);
+
+		CheckIndexable(node.GetName(), type, node.GetIndexCount());
+		for (size_t i = 0; i < node.GetIndexCount(); ++i)
+		{
+			CheckIndex(m_state.GetValueType(node.GetIndex(i)));
+		}
+
+		// Characters of strings are assigned from integers, other elements must have exactly the same type
+		const ExpressionType element = GetElementType(type, node.GetIndexCount());
+		const ExpressionType expression = m_state.GetValueType(node.GetExpression());
+		if (expression != element)
+		{
+			auto fmt = boost::format("trying to assign expression of type %1% to array element of type %2%")
+				% ToString(expression)
+				% ToString(element);
+			throw std::runtime_error(fmt.str());
+		}
+
+		// Row of multidimensional array is copied into its buffer, so the size of the row
+		//  must be known; arrays have no stored length, it's known only for literals
+		if (type.nesting >= 2 && node.GetIndexCount() < type.nesting &&
+			node.GetExpression().GetKind() != ExpressionKind::Literal)
+		{
+			throw std::runtime_error("row of multidimensional array '" + node.GetName() + "' can only be assigned from array literal");
+		}
+		m_state.info.SetElementsWritten(GetElementType(type, node.GetIndexCount() - 1));
+		m_state.info.SetStatementVariable(node, variable);
+	}
+
+	void Visit(const ReturnStatementAST& node)
+	{
+		const SemanticInfo::Function& func = m_state.info.GetFunction(m_state.function);
+		if (!func.returnType)
+		{
+			if (node.GetExpression())
+			{
+				const ExpressionType type = m_state.GetValueType(*node.GetExpression());
+				throw std::runtime_error("function '" + func.name + "' can't return value of type " + ToString(type));
+			}
+			return;
+		}
+
+		if (!node.GetExpression())
+		{
+			throw std::runtime_error("return statement must have expression of type " + ToString(*func.returnType));
+		}
+
+		const ExpressionType type = m_state.GetValueType(*node.GetExpression());
+		if (!IsAssignable(type, *func.returnType))
+		{
+			auto fmt = boost::format("returning expression of type %1% must be at least convertible to function return type (%2%)")
+				% ToString(type)
+				% ToString(*func.returnType);
+			throw std::runtime_error(fmt.str());
+		}
+	}
+
+	void Visit(const IfStatementAST& node)
+	{
+		CheckCondition(m_state.GetValueType(node.GetExpr()));
+	}
+
+	void Visit(const WhileStatementAST& node)
+	{
+		CheckCondition(m_state.GetValueType(node.GetExpr()));
+	}
+
+	void Visit(const CompositeStatementAST&)
+	{
+		m_state.scopes.PopScope();
+	}
+
+	void Visit(const BuiltinCallStatementAST& node)
+	{
+		const ExpressionType string = { ExpressionType::String, 0 };
+		switch (node.GetBuiltin())
+		{
+		case BuiltinCallStatementAST::Print:
+			if (node.GetParamsCount() == 0 || m_state.GetValueType(node.GetExpression(0)) != string)
+			{
+				throw std::runtime_error("print statement requires string as first argument");
+			}
+			for (size_t i = 1; i < node.GetParamsCount(); ++i)
+			{
+				m_state.GetValueType(node.GetExpression(i));
+			}
+			break;
+		case BuiltinCallStatementAST::Scan:
+			if (node.GetParamsCount() < 2)
+			{
+				throw std::runtime_error("scan statement expects at least 2 parameters, " + std::to_string(node.GetParamsCount()) + " given");
+			}
+			if (m_state.GetValueType(node.GetExpression(0)) != string)
+			{
+				throw std::runtime_error("scan statement requires string as first argument");
+			}
+			for (size_t i = 1; i < node.GetParamsCount(); ++i)
+			{
+				if (node.GetExpression(i).GetKind() != ExpressionKind::Identifier)
+				{
+					throw std::runtime_error("you can only pass identifiers to scan");
+				}
+			}
+			break;
+		default:
+			assert(false);
+			throw std::logic_error("can't check undefined builtin call");
+		}
+	}
+
+	void Visit(const FunctionCallStatementAST&)
+	{
+		// Value of the call (if any) is ignored
+	}
+
+	void CheckAssignment(const std::string& name, const ExpressionType& variable, const ExpressionType& value)
+	{
+		if (!IsAssignable(value, variable))
+		{
+			auto fmt = boost::format("can't set expression of type '%1%' to variable '%2%' of type '%3%'")
+				% ToString(value)
+				% name
+				% ToString(variable);
+			throw std::runtime_error(fmt.str());
+		}
+	}
+
+private:
+	AnalysisState& m_state;
+};
+
+void AnalyzeFunction(AnalysisState& state, const FunctionAST& func)
+{
+	state.scopes.PushScope();
+	for (const FunctionAST::Param& param : func.GetParams())
+	{
+		if (state.scopes.GetValue(param.first))
+		{
+			throw std::runtime_error("parameter '" + param.first + "' is already defined");
+		}
+		state.scopes.Define(param.first, state.info.AddVariable(state.function, { param.first, param.second }));
+	}
+
+	ExpressionChecker expressionChecker(state);
+	StatementChecker statementChecker(state);
+
+	TraverseDepthFirst(MakeNodeRef(func.GetStatement()), [&](const ASTNodeRef& node) {
+		if (node.statement)
+		{
+			statementChecker.Enter(*node.statement);
+		}
+	}, [&](const ASTNodeRef& node) {
+		if (node.statement)
+		{
+			statementChecker.Leave(*node.statement);
+		}
+		else
+		{
+			expressionChecker.Check(*node.expression);
+		}
+	});
+
+	state.scopes.PopScope();
+}
+
+// Copy of literal, that is assigned to a variable, is kept only by this variable, if its value is never copied:
+//  arrays and strings, that are values of the variable, are used only as arguments of print and scan.
+//  Rows of multidimensional arrays and arguments of print and scan are used only by their statements
+void MarkSharedLiteralBuffers(SemanticInfo& info, size_t function, const FunctionAST& func)
+{
+	auto isBufferLiteral = [&](const IExpressionAST& node) {
+		return node.GetKind() == ExpressionKind::Literal && !IsNumeric(info.GetType(node));
+	};
+
+	std::unordered_set<const IExpressionAST*> builtinArguments;
+	std::vector<bool> isCopied(info.GetFunction(function).variables.size(), false);
+	std::vector<std::pair<size_t, const IExpressionAST*>> assignedLiterals;
+
+	TraverseDepthFirst(MakeNodeRef(func.GetStatement()), [&](const ASTNodeRef& node) {
+		if (node.expression)
+		{
+			const ExpressionKind kind = node.expression->GetKind();
+			if ((kind == ExpressionKind::Identifier || kind == ExpressionKind::ArrayElementAccess) &&
+				!IsNumeric(info.GetType(*node.expression)) && !builtinArguments.count(node.expression))
+			{
+				isCopied[info.GetSymbol(*node.expression)] = true;
+			}
+			return;
+		}
+
+		switch (node.statement->GetKind())
+		{
+		case StatementKind::BuiltinCall:
+		{
+			const auto& call = static_cast<const BuiltinCallStatementAST&>(*node.statement);
+			for (size_t i = 0; i < call.GetParamsCount(); ++i)
+			{
+				builtinArguments.insert(&call.GetExpression(i));
+				if (isBufferLiteral(call.GetExpression(i)))
+				{
+					info.SetLiteralBufferShared(call.GetExpression(i));
+				}
+			}
+			break;
+		}
+		case StatementKind::VariableDeclaration:
+		{
+			const auto& declaration = static_cast<const VariableDeclarationAST&>(*node.statement);
+			if (declaration.GetExpression() && isBufferLiteral(*declaration.GetExpression()))
+			{
+				assignedLiterals.emplace_back(info.GetVariable(declaration), declaration.GetExpression());
+			}
+			break;
+		}
+		case StatementKind::Assign:
+		{
+			const auto& assign = static_cast<const AssignStatementAST&>(*node.statement);
+			if (isBufferLiteral(assign.GetExpr()))
+			{
+				assignedLiterals.emplace_back(info.GetVariable(assign), &assign.GetExpr());
+			}
+			break;
+		}
+		case StatementKind::ArrayElementAssign:
+		{
+			const auto& assign = static_cast<const ArrayElementAssignAST&>(*node.statement);
+			const ExpressionType& type = info.GetFunction(function).variables[info.GetVariable(assign)].type;
+			if (type.nesting >= 2 && assign.GetIndexCount() < type.nesting)
+			{
+				info.SetLiteralBufferShared(assign.GetExpression());
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}, [](const ASTNodeRef&) {});
+
+	for (const auto& assigned : assignedLiterals)
+	{
+		if (!isCopied[assigned.first])
+		{
+			info.SetLiteralBufferShared(*assigned.second);
+		}
+	}
+}
+}
+
+size_t SemanticInfo::AddFunction(const Function& function)
+{
+	m_functions.push_back(function);
+	return m_functions.size() - 1;
+}
+
+size_t SemanticInfo::AddVariable(size_t function, const Variable& variable)
+{
+	std::vector<Variable>& variables = m_functions.at(function).variables;
+	variables.push_back(variable);
+	return variables.size() - 1;
+}
+
+void SemanticInfo::SetExpressionInfo(const IExpressionAST& node, const boost::optional<ExpressionType>& type, size_t symbol)
+{
+	m_expressions[&node] = { type, symbol };
+}
+
+void SemanticInfo::SetStatementVariable(const IStatementAST& node, size_t variable)
+{
+	m_statementVariables[&node] = variable;
+}
+
+const std::vector<ExpressionType>& SemanticInfo::GetWrittenArrayTypes()const
+{
+	return m_writtenArrayTypes;
+}
+
+void SemanticInfo::SetElementsWritten(const ExpressionType& arrayType)
+{
+	if (!AreElementsWritten(arrayType))
+	{
+		m_writtenArrayTypes.push_back(arrayType);
+	}
+}
+
+void SemanticInfo::SetArrayExtents(const IExpressionAST& node, const std::vector<unsigned>& extents)
+{
+	m_arrayExtents[&node] = extents;
+}
+
+size_t SemanticInfo::GetFunctionsCount()const
+{
+	return m_functions.size();
+}
+
+const SemanticInfo::Function& SemanticInfo::GetFunction(size_t index)const
+{
+	return m_functions.at(index);
+}
+
+ExpressionType SemanticInfo::GetType(const IExpressionAST& node)const
+{
+	const ExpressionInfo& info = GetExpressionInfo(node);
+	assert(info.type);
+	return *info.type;
+}
+
+boost::optional<ExpressionType> SemanticInfo::GetOptionalType(const IExpressionAST& node)const
+{
+	return GetExpressionInfo(node).type;
+}
+
+size_t SemanticInfo::GetSymbol(const IExpressionAST& node)const
+{
+	const ExpressionInfo& info = GetExpressionInfo(node);
+	assert(info.symbol != npos);
+	return info.symbol;
+}
+
+size_t SemanticInfo::GetVariable(const IStatementAST& node)const
+{
+	auto found = m_statementVariables.find(&node);
+	if (found == m_statementVariables.end())
+	{
+		throw std::logic_error("statement doesn't refer to variable or wasn't analyzed");
+	}
+	return found->second;
+}
+
+const std::vector<unsigned>& SemanticInfo::GetArrayExtents(const IExpressionAST& node)const
+{
+	auto found = m_arrayExtents.find(&node);
+	if (found == m_arrayExtents.end())
+	{
+		throw std::logic_error("extents of array literal are unknown");
+	}
+	return found->second;
+}
+
+void SemanticInfo::SetLiteralBufferShared(const IExpressionAST& literal)
+{
+	m_sharedLiteralBuffers.insert(&literal);
+}
+
+bool SemanticInfo::IsLiteralBufferShared(const IExpressionAST& literal)const
+{
+	return m_sharedLiteralBuffers.count(&literal) != 0;
+}
+
+bool SemanticInfo::AreElementsWritten(const ExpressionType& arrayType)const
+{
+	return std::find(m_writtenArrayTypes.begin(), m_writtenArrayTypes.end(), arrayType) != m_writtenArrayTypes.end();
+}
+
+const SemanticInfo::ExpressionInfo& SemanticInfo::GetExpressionInfo(const IExpressionAST& node)const
+{
+	auto found = m_expressions.find(&node);
+	if (found == m_expressions.end())
+	{
+		throw std::logic_error("expression wasn't analyzed");
+	}
+	return found->second;
+}
+
+std::unique_ptr<SemanticInfo> AnalyzeProgram(const ProgramAST& program)
+{
+	auto info = std::make_unique<SemanticInfo>();
+	AnalysisState state = { *info, {}, {}, 0 };
+
+	// All functions are declared before their bodies are checked, so they can be called in any order
+	for (size_t i = 0; i < program.GetFunctionsCount(); ++i)
+	{
+		const FunctionAST& func = program.GetFunction(i);
+		const std::string& name = func.GetIdentifier().GetName();
+		if (state.functions.count(name))
+		{
+			throw std::runtime_error("function '" + name + "' is already defined");
+		}
+
+		SemanticInfo::Function function = { name, func.GetReturnType(), {}, {} };
+		for (const FunctionAST::Param& param : func.GetParams())
+		{
+			function.params.push_back(param.second);
+		}
+		state.functions.emplace(name, info->AddFunction(function));
+	}
+
+	for (size_t i = 0; i < program.GetFunctionsCount(); ++i)
+	{
+		state.function = i;
+		AnalyzeFunction(state, program.GetFunction(i));
+		MarkSharedLiteralBuffers(*info, i, program.GetFunction(i));
+	}
+	return info;
+}
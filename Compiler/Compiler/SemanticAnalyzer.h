@@ -0,0 +1,88 @@
+#pragma once
+#include "../AST/AST.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Result of the semantic analysis: types of expressions and declarations, that names refer to.
+// Variables are numbered inside of their function: parameters go first,
+//  then local variables in order of their declaration.
+// Optimization passes annotate only nodes they create, after them information is only read,
+//  so it can be shared between code generators.
+class SemanticInfo
+{
+public:
+	static constexpr size_t npos = ~size_t(0);
+
+	struct Variable
+	{
+		std::string name;
+		ExpressionType type;
+	};
+
+	struct Function
+	{
+		std::string name;
+		boost::optional<ExpressionType> returnType;
+		std::vector<ExpressionType> params;
+		std::vector<Variable> variables;
+	};
+
+	size_t AddFunction(const Function& function);
+	size_t AddVariable(size_t function, const Variable& variable);
+
+	// Type is empty for call of void function, symbol is described in GetSymbol
+	void SetExpressionInfo(const IExpressionAST& node, const boost::optional<ExpressionType>& type, size_t symbol = npos);
+	void SetStatementVariable(const IStatementAST& node, size_t variable);
+	void SetElementsWritten(const ExpressionType& arrayType);
+	void SetArrayExtents(const IExpressionAST& node, const std::vector<unsigned>& extents);
+	void SetLiteralBufferShared(const IExpressionAST& literal);
+
+	size_t GetFunctionsCount()const;
+	const Function& GetFunction(size_t index)const;
+
+	// Type of value of the expression, must not be requested for call of void function
+	ExpressionType GetType(const IExpressionAST& node)const;
+	boost::optional<ExpressionType> GetOptionalType(const IExpressionAST& node)const;
+
+	// Index of function for FunctionCallExpressionAST,
+	//  index of variable for IdentifierAST and ArrayElementAccessAST
+	size_t GetSymbol(const IExpressionAST& node)const;
+
+	// Index of variable for VariableDeclarationAST, AssignStatementAST and ArrayElementAssignAST
+	size_t GetVariable(const IStatementAST& node)const;
+
+	// Sizes of all dimensions of array literal, multidimensional literals are rectangular
+	const std::vector<unsigned>& GetArrayExtents(const IExpressionAST& node)const;
+
+	// True, if some statement of the program assigns an element of array (or a character of string)
+	//  of the given type. Arrays and strings are never casted, so literals of other types
+	//  are never modified and can be shared
+	bool AreElementsWritten(const ExpressionType& arrayType)const;
+	const std::vector<ExpressionType>& GetWrittenArrayTypes()const;
+
+	// True, if copy of array or string literal isn't used after the next evaluation of the literal,
+	//  so all evaluations in a call can share one buffer; otherwise in loops every iteration needs a new one
+	bool IsLiteralBufferShared(const IExpressionAST& literal)const;
+
+private:
+	struct ExpressionInfo
+	{
+		boost::optional<ExpressionType> type;
+		size_t symbol;
+	};
+
+	const ExpressionInfo& GetExpressionInfo(const IExpressionAST& node)const;
+
+private:
+	std::vector<Function> m_functions;
+	std::unordered_map<const IExpressionAST*, ExpressionInfo> m_expressions;
+	std::unordered_map<const IStatementAST*, size_t> m_statementVariables;
+	std::unordered_map<const IExpressionAST*, std::vector<unsigned>> m_arrayExtents;
+	std::vector<ExpressionType> m_writtenArrayTypes;
+	std::unordered_set<const IExpressionAST*> m_sharedLiteralBuffers;
+};
+
+// Checks types and resolves names of the whole program;
+//  throws std::runtime_error on the first semantic error
+std::unique_ptr<SemanticInfo> AnalyzeProgram(const ProgramAST& program);
@@ -0,0 +1,272 @@
+#include "stdafx.h"
+#include "TieredEngine.h"
+#include <iomanip>
+
+namespace
+{
+double ToMilliseconds(std::chrono::steady_clock::duration duration)
+{
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Register of the interpreter holds one scalar, aggregates occupy consecutive registers,
+//  e.g. pointer to the buffer of multidimensional array and then its extents.
+// Int and Bool are kept as 32-bit integers at the start of the register
+llvm::Value* LoadFromRegisters(llvm::IRBuilder<>& builder, llvm::Value* registers, llvm::Type* type, unsigned& index)
+{
+	if (type->isStructTy() || type->isArrayTy())
+	{
+		llvm::Value* value = llvm::UndefValue::get(type);
+		const unsigned count = type->isStructTy() ? type->getStructNumElements() : unsigned(type->getArrayNumElements());
+		for (unsigned i = 0; i < count; ++i)
+		{
+			llvm::Type* elementType = type->isStructTy() ? type->getStructElementType(i) : type->getArrayElementType();
+			value = builder.CreateInsertValue(value, LoadFromRegisters(builder, registers, elementType, index), { i });
+		}
+		return value;
+	}
+
+	llvm::Value* slot = builder.CreateConstGEP1_32(registers, index++);
+	if (type->isIntegerTy() && type->getIntegerBitWidth() < 32)
+	{
+		llvm::Type* int32Type = builder.getInt32Ty();
+		llvm::Value* value = builder.CreateLoad(builder.CreateBitCast(slot, int32Type->getPointerTo()));
+		return builder.CreateTrunc(value, type);
+	}
+	return builder.CreateLoad(builder.CreateBitCast(slot, type->getPointerTo()));
+}
+
+void StoreToRegisters(llvm::IRBuilder<>& builder, llvm::Value* registers, llvm::Value* value, unsigned& index)
+{
+	llvm::Type* type = value->getType();
+	if (type->isStructTy() || type->isArrayTy())
+	{
+		const unsigned count = type->isStructTy() ? type->getStructNumElements() : unsigned(type->getArrayNumElements());
+		for (unsigned i = 0; i < count; ++i)
+		{
+			StoreToRegisters(builder, registers, builder.CreateExtractValue(value, { i }), index);
+		}
+		return;
+	}
+
+	if (type->isIntegerTy() && type->getIntegerBitWidth() < 32)
+	{
+		value = builder.CreateZExt(value, builder.getInt32Ty());
+	}
+	llvm::Value* slot = builder.CreateConstGEP1_32(registers, index++);
+	builder.CreateStore(value, builder.CreateBitCast(slot, value->getType()->getPointerTo()));
+}
+
+// Entry for the interpreter, that calls the function with arguments from the registers
+//  and stores result over them; the function itself can be inlined into it
+std::string CreateNativeEntry(llvm::Module& module, const std::string& functionName)
+{
+	llvm::Function* function = module.getFunction(functionName);
+	if (!function)
+	{
+		throw std::logic_error("function '" + functionName + "' is not generated");
+	}
+
+	llvm::LLVMContext& context = module.getContext();
+	llvm::Type* registersType = llvm::Type::getInt64PtrTy(context);
+	llvm::FunctionType* entryType = llvm::FunctionType::get(llvm::Type::getVoidTy(context), { registersType }, false);
+
+	const std::string entryName = functionName + ".native";
+	llvm::Function* entry = llvm::Function::Create(entryType, llvm::Function::ExternalLinkage, entryName, &module);
+	for (const char* attribute : { "target-cpu", "target-features" })
+	{
+		if (function->hasFnAttribute(attribute))
+		{
+			entry->addFnAttr(function->getFnAttribute(attribute));
+		}
+	}
+
+	llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context, "entry", entry));
+	llvm::Value* registers = &*entry->arg_begin();
+
+	std::vector<llvm::Value*> arguments;
+	unsigned index = 0;
+	for (llvm::Type* paramType : function->getFunctionType()->params())
+	{
+		arguments.push_back(LoadFromRegisters(builder, registers, paramType, index));
+	}
+
+	llvm::CallInst* call = builder.CreateCall(function, arguments);
+	call->setCallingConv(function->getCallingConv());
+	if (!call->getType()->isVoidTy())
+	{
+		index = 0;
+		StoreToRegisters(builder, registers, call, index);
+	}
+	builder.CreateRetVoid();
+	return entryName;
+}
+}
+
+TieredEngine::TieredEngine(
+	const BytecodeProgram& program,
+	const llvm::TargetMachine& targetMachine,
+	ModuleGenerator generator,
+	JitEngine::ModuleOptimizer optimizer,
+	uint64_t threshold)
+	: m_program(program)
+	, m_jit(targetMachine)
+	, m_generator(std::move(generator))
+	, m_optimizer(std::move(optimizer))
+	, m_profile(program.functions.size(), threshold, [this](size_t function) { OnHotFunction(function); })
+	, m_stopped(false)
+{
+}
+
+TieredEngine::~TieredEngine()
+{
+	StopCompiler();
+}
+
+int TieredEngine::RunMain(const std::vector<std::string>& arguments)
+{
+	m_startTime = Clock::now();
+	m_stopped = false;
+	m_compiler = std::thread([this] { CompileHotFunctions(); });
+
+	int result = 0;
+	try
+	{
+		result = RunBytecode(m_program, arguments, &m_profile);
+	}
+	catch (...)
+	{
+		StopCompiler();
+		throw;
+	}
+	StopCompiler();
+	return result;
+}
+
+void TieredEngine::OnHotFunction(size_t function)
+{
+	Transition transition = { function, TierState::Queued, Clock::now(), {}, {}, {} };
+
+	// main is entered only once, its native code would never be called
+	if (m_program.functions[function].name == "main")
+	{
+		transition.state = TierState::Skipped;
+		transition.error = "running call can't be replaced without on-stack replacement";
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_transitions.push_back(transition);
+	if (transition.state == TierState::Queued)
+	{
+		m_queue.push_back(m_transitions.size() - 1);
+		m_queueChanged.notify_one();
+	}
+}
+
+void TieredEngine::CompileHotFunctions()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_queueChanged.wait(lock, [this] { return m_stopped || !m_queue.empty(); });
+		if (m_stopped)
+		{
+			return;
+		}
+		const size_t index = m_queue.front();
+		const size_t function = m_transitions[index].function;
+		m_queue.pop_front();
+		lock.unlock();
+
+		// Interpreter goes on while the function is compiled
+		const Clock::time_point startTime = Clock::now();
+		TieringProfile::NativeEntry entry = nullptr;
+		std::string error;
+		try
+		{
+			entry = CompileFunction(function);
+			m_profile.InstallNativeEntry(function, entry);
+		}
+		catch (const std::exception& ex)
+		{
+			error = ex.what();
+		}
+		const Clock::time_point installTime = Clock::now();
+
+		lock.lock();
+		Transition& transition = m_transitions[index];
+		transition.state = entry ? TierState::Native : TierState::Failed;
+		transition.installTime = installTime;
+		transition.compileTime = installTime - startTime;
+		transition.error = error;
+	}
+}
+
+TieringProfile::NativeEntry TieredEngine::CompileFunction(size_t function)
+{
+	CodegenContext context;
+	m_generator(function, context);
+
+	llvm::Module& module = context.GetUtils().GetModule();
+	const std::string entryName = CreateNativeEntry(module, m_program.functions[function].name);
+	m_optimizer(module);
+
+	std::unique_ptr<llvm::LLVMContext> llvmContext;
+	std::unique_ptr<llvm::Module> llvmModule;
+	context.GetUtils().ReleaseModule(llvmContext, llvmModule);
+	m_jit.AddModule(std::move(llvmContext), std::move(llvmModule));
+
+	const llvm::JITTargetAddress address = m_jit.GetSymbolAddress(entryName);
+	return reinterpret_cast<TieringProfile::NativeEntry>(static_cast<uintptr_t>(address));
+}
+
+// Function, that is being compiled, is finished, queued functions stay in the interpreter
+void TieredEngine::StopCompiler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopped = true;
+		m_queueChanged.notify_one();
+	}
+	if (m_compiler.joinable())
+	{
+		m_compiler.join();
+	}
+}
+
+void TieredEngine::PrintReport(std::ostream& out)const
+{
+	out << "Tier transitions (threshold " << m_profile.GetThreshold() << " calls and loop back-edges):" << std::endl;
+	if (m_transitions.empty())
+	{
+		out << "  no hot functions" << std::endl;
+	}
+
+	const std::ios_base::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+	for (const Transition& transition : m_transitions)
+	{
+		const size_t function = transition.function;
+		out << "  " << m_program.functions[function].name << ": ";
+		switch (transition.state)
+		{
+		case TierState::Native:
+			out << "interpreter -> native at " << ToMilliseconds(transition.installTime - m_startTime) << " ms"
+				<< " (hot at " << ToMilliseconds(transition.hotTime - m_startTime) << " ms"
+				<< ", compiled in " << ToMilliseconds(transition.compileTime) << " ms)";
+			break;
+		case TierState::Queued:
+			out << "hot at " << ToMilliseconds(transition.hotTime - m_startTime) << " ms"
+				<< ", program finished before compilation";
+			break;
+		default:
+			out << "stays in the interpreter: " << transition.error;
+			break;
+		}
+		out << "; interpreted " << m_profile.GetCallCount(function) << " calls, "
+			<< m_profile.GetBackEdgeCount(function) << " loop back-edges" << std::endl;
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "BytecodeInterpreter.h"
+#include "CodegenContext.h"
+#include "JitEngine.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+// Tiered execution: the program starts in the bytecode interpreter, functions that become hot
+//  are compiled by LLVM in the background thread, then calls of them go to native code.
+// Native code of a function contains its callees too, so it never returns to bytecode.
+// There is no on-stack replacement: a running call stays in the interpreter until it returns
+class TieredEngine
+{
+public:
+	// Generates the function and all of its callees to the context, optimizer is applied after that
+	using ModuleGenerator = std::function<void(size_t function, CodegenContext& context)>;
+
+	TieredEngine(
+		const BytecodeProgram& program,
+		const llvm::TargetMachine& targetMachine,
+		ModuleGenerator generator,
+		JitEngine::ModuleOptimizer optimizer,
+		uint64_t threshold);
+	~TieredEngine();
+
+	// Same contract as RunBytecode
+	int RunMain(const std::vector<std::string>& arguments);
+
+	// Functions, that became hot during the last run, with their counters and compilation times
+	void PrintReport(std::ostream& out)const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	enum class TierState
+	{
+		Queued,
+		Native,
+		Failed,
+		Skipped,
+	};
+
+	struct Transition
+	{
+		size_t function;
+		TierState state;
+		Clock::time_point hotTime;
+		Clock::time_point installTime;
+		Clock::duration compileTime;
+		std::string error;
+	};
+
+	// Called by the interpreter
+	void OnHotFunction(size_t function);
+	// Body of the compiler thread
+	void CompileHotFunctions();
+	TieringProfile::NativeEntry CompileFunction(size_t function);
+	void StopCompiler();
+
+private:
+	const BytecodeProgram& m_program;
+	JitEngine m_jit;
+	ModuleGenerator m_generator;
+	JitEngine::ModuleOptimizer m_optimizer;
+	TieringProfile m_profile;
+	Clock::time_point m_startTime;
+
+	// Guards the fields below, when the compiler thread is running
+	std::mutex m_mutex;
+	std::condition_variable m_queueChanged;
+	std::deque<size_t> m_queue; // indices of transitions
+	std::vector<Transition> m_transitions;
+	bool m_stopped;
+	std::thread m_compiler;
+};
@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+# Benchmarks of the compiler and of the code it generates; nothing is checked, times are printed.
+# Compile benchmarks measure the compiler on a generated program in every configuration:
+#  wall-clock time and, on POSIX, processor time of all its threads; their ratio shows
+#  how many cores are busy, so scaling is seen only on a machine with several cores.
+# Run benchmarks compile programs of benchmarks/ in every configuration to object files, that are linked
+#  by the C compiler (CC environment variable, cc by default), and measure the program; configurations
+#  with --run or --interpret are measured with the compiler. Output must be the same in all configurations.
+# Best of REPEAT runs is reported.
+# Usage: run_benchmarks.py <compiler executable> [benchmark names]
+import glob
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+try:
+    import resource
+except ImportError:
+    resource = None
+
+REPEAT = 3
+TIMEOUT = 600
+
+
+# Functions with loops, branches, array literals and calls of each other, about 15 lines each
+def make_many_functions(count):
+    functions = []
+    for i in range(count):
+        call = " + f%d(1)" % (i - 1) if i > 0 else ""
+        functions.append(
+            "func f%d(n: Int) -> Int:\n"
+            "{\n"
+            "\tvar s: Int = 0;\n"
+            "\tvar k: Int = 0;\n"
+            "\twhile (k < n)\n"
+            "\t{\n"
+            "\t\tif (k %% 3 == 0) { s = s + k * %d; } else { s = s - k; }\n"
+            "\t\tk = k + 1;\n"
+            "\t}\n"
+            "\tvar a: Array<Int> = [s, n, %d, k];\n"
+            "\treturn a[0] + a[2]%s;\n"
+            "}\n" % (i, i, i, call))
+    functions.append("func main() -> Int:\n{\n\tprint(\"%%d\\n\", f%d(3));\n\treturn 0;\n}\n" % (count - 1))
+    return "\n".join(functions)
+
+
+# All functions are exported, otherwise optimizer of the whole module removes the functions, that aren't
+#  called from main, while in parts they are kept for the linker, and the builds do different work
+def get_parallel_configurations(optimization, functionCount):
+    exports = "--export=" + ",".join(["main"] + ["f%d" % i for i in range(functionCount)])
+    configurations = [(optimization, [optimization, exports])]
+    for count in (2, 4, 8):
+        configurations.append(("%s --irgen-threads=%d" % (optimization, count),
+            [optimization, exports, "--irgen-threads=%d" % count]))
+        configurations.append(("%s --codegen-partitions=%d" % (optimization, count),
+            [optimization, exports, "--codegen-partitions=%d" % count]))
+    return configurations
+
+
+# Exported functions keep external linkage and the C calling convention, others are internal
+#  and use fastcc, so the optimizer may inline them and change their signatures
+def get_call_configurations(functions):
+    exports = "--export=" + ",".join(["main"] + functions)
+    configurations = []
+    for level in ("-O0", "-O2"):
+        configurations.append((level, [level]))
+        configurations.append(("%s all exported" % level, [level, exports]))
+    return configurations
+
+
+# Generic processor of the target by default, the host processor with all its features with -mcpu=native
+def get_cpu_configurations():
+    configurations = []
+    for level in ("-O2", "-O3"):
+        configurations.append((level, [level]))
+        configurations.append(("%s -mcpu=native" % level, [level, "-mcpu=native"]))
+    return configurations
+
+
+# Relaxations of floating point arithmetic, alone and with vectors of the host processor
+FAST_MATH_CONFIGURATIONS = [("-O2", ["-O2"])] + [
+    ("-O2 " + flag, ["-O2", flag]) for flag in ("--fp-contract", "--fp-reassoc", "--fast-math")] + [
+    ("-O2 -mcpu=native", ["-O2", "-mcpu=native"]),
+    ("-O2 -mcpu=native --fast-math", ["-O2", "-mcpu=native", "--fast-math"]),
+]
+
+
+OPTIMIZATION_LEVELS = [(level, [level]) for level in ("-O0", "-O1", "-O2", "-O3", "-Os")] + [
+    ("--interpret", ["--interpret"]),
+]
+
+
+BENCHMARKS = [
+    {
+        "name": "parallel_codegen_O0",
+        "description": "3000 functions compiled to objects by several threads at -O0",
+        "kind": "compile",
+        "generator": lambda: make_many_functions(3000),
+        "configurations": get_parallel_configurations("-O0", 3000),
+    },
+    {
+        "name": "parallel_codegen_O2",
+        "description": "300 functions compiled to objects by several threads at -O2",
+        "kind": "compile",
+        "generator": lambda: make_many_functions(300),
+        "configurations": get_parallel_configurations("-O2", 300),
+    },
+    {
+        "name": "matrix",
+        "description": "scaled-up matrix.txt, 64x64 matrices multiplied 200 times",
+        "kind": "run",
+        "source": "matrix.txt",
+        "configurations": OPTIMIZATION_LEVELS,
+    },
+    {
+        "name": "quicksort",
+        "description": "scaled-up quicksort.txt, 5000 numbers sorted 200 times",
+        "kind": "run",
+        "source": "quicksort.txt",
+        "configurations": OPTIMIZATION_LEVELS,
+    },
+    {
+        "name": "quicksort_calls",
+        "description": "quicksort.txt with internal fastcc functions and with all functions exported",
+        "kind": "run",
+        "source": "quicksort.txt",
+        "configurations": get_call_configurations(["quick_sort", "fill_random", "count_unsorted"]),
+    },
+    {
+        "name": "matrix_native",
+        "description": "matrix.txt for the generic and for the host processor",
+        "kind": "run",
+        "source": "matrix.txt",
+        "configurations": get_cpu_configurations(),
+    },
+    {
+        "name": "float_reduction",
+        "description": "dot product of 1000 floats 200000 times, sums are exact, so any order gives the same",
+        "kind": "run",
+        "source": "float_reduction.txt",
+        "configurations": FAST_MATH_CONFIGURATIONS,
+    },
+    {
+        "name": "guarded_access",
+        "description": "array reads guarded by && and || in loops over 2000 numbers, 10000 times",
+        "kind": "run",
+        "source": "guarded_access.txt",
+        "configurations": OPTIMIZATION_LEVELS,
+    },
+]
+
+
+def get_children_time():
+    if not resource:
+        return None
+    usage = resource.getrusage(resource.RUSAGE_CHILDREN)
+    return usage.ru_utime + usage.ru_stime
+
+
+def run(arguments, directory):
+    result = subprocess.run(arguments, cwd=directory, stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT, universal_newlines=True, timeout=TIMEOUT)
+    if result.returncode != 0:
+        raise RuntimeError("%s failed with exit code %d:\n%s" % (" ".join(arguments), result.returncode, result.stdout))
+    return result.stdout
+
+
+# Returns the best wall-clock and processor time of REPEAT runs of the command and its output
+def measure(arguments, directory):
+    times = []
+    for _ in range(REPEAT):
+        startCpu = get_children_time()
+        start = time.perf_counter()
+        output = run(arguments, directory)
+        wall = time.perf_counter() - start
+        times.append((wall, get_children_time() - startCpu if startCpu is not None else None))
+    return min(times), output
+
+
+def run_compile_benchmark(compiler, benchmark, directory):
+    source = os.path.join(directory, benchmark["name"] + ".txt")
+    with open(source, "w") as file:
+        file.write(benchmark["generator"]())
+    results = []
+    for label, flags in benchmark["configurations"]:
+        results.append((label, measure([compiler, source] + flags, directory)[0]))
+    return results
+
+
+# Returns the command, that runs the program compiled in the configuration
+def build_program(compiler, source, flags, directory):
+    if "--run" in flags or "--interpret" in flags:
+        return [compiler, source] + flags
+
+    linker = shutil.which(os.environ.get("CC", "cc"))
+    if not linker:
+        raise RuntimeError("no C compiler to link the program")
+    for path in glob.glob(os.path.join(directory, "output*.o")):
+        os.remove(path)
+    run([compiler, source] + flags, directory)
+    program = os.path.join(directory, "program")
+    run([linker] + sorted(glob.glob(os.path.join(directory, "output*.o"))) + ["-o", program, "-no-pie", "-lm"], directory)
+    return [program]
+
+
+def run_program_benchmark(compiler, benchmark, directory):
+    source = os.path.join(os.path.dirname(os.path.abspath(__file__)), "benchmarks", benchmark["source"])
+    results = []
+    outputs = {}
+    for label, flags in benchmark["configurations"]:
+        times, outputs[label] = measure(build_program(compiler, source, flags, directory), directory)
+        results.append((label, times))
+    if len(set(outputs.values())) != 1:
+        raise RuntimeError("outputs of configurations differ: %s" % outputs)
+    return results
+
+
+def print_results(benchmark, results):
+    print("%s: %s" % (benchmark["name"], benchmark["description"]))
+    for label, (wall, cpu) in results:
+        cpuText = "  cpu %7.3fs" % cpu if cpu is not None else ""
+        print("  %-32s %7.3fs%s" % (label, wall, cpuText))
+    sys.stdout.flush()
+
+
+RUNNERS = {
+    "compile": run_compile_benchmark,
+    "run": run_program_benchmark,
+}
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: run_benchmarks.py <compiler executable> [benchmark names]")
+        return 2
+    compiler = os.path.abspath(sys.argv[1])
+    names = sys.argv[2:]
+    unknown = set(names) - set(benchmark["name"] for benchmark in BENCHMARKS)
+    if unknown:
+        print("unknown benchmarks: " + ", ".join(sorted(unknown)))
+        return 2
+
+    for benchmark in BENCHMARKS:
+        if names and benchmark["name"] not in names:
+            continue
+        with tempfile.TemporaryDirectory() as directory:
+            print_results(benchmark, RUNNERS[benchmark["kind"]](compiler, benchmark, directory))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
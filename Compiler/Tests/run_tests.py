@@ -0,0 +1,344 @@
+#!/usr/bin/env python3
+# Regression tests of the compiler.
+# Every programs/<name>.txt is executed by the JIT and by the bytecode interpreter with standard input
+#  from programs/<name>.input, if it exists; output of each run must be equal to programs/<name>.expected.
+# Every programs/<name>.txt is also executed twice in each of MODES through the parse cache,
+#  the second run takes serialized AST from the cache; parse cache, that can't be written, is ignored.
+# Every failures/<name>.txt must fail in each mode, its output must contain failures/<name>.expected,
+#  if it exists; errors detected at run time are reported by the JIT with a trap, without a message.
+# Every programs/<name>.txt is also compiled to object files in each of LINK_MODES, that are linked
+#  by the C compiler (CC environment variable, cc by default) and run; skipped if there is no C compiler.
+# Every programs/<name>.txt is compiled twice in each of CACHE_MODES: the second compilation must take
+#  all objects from the cache and give the same objects and, if there is a C compiler, the same output.
+# Every ir/while_*.txt is compiled at -O0, each while loop of its IR must be in rotated form.
+# Every ir/<name>.txt with ir/<name>.checks is compiled at -O0; instructions of function <function>
+#  must match regular expression of each "CHECK <function>: <regex>" line of the checks
+#  and mustn't match regular expression of each "CHECK-NOT <function>: <regex>" line.
+# Usage: run_tests.py <compiler executable>
+import glob
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+MODES = [["--run"], ["--run", "-O2"], ["--interpret"]]
+# Parts and partitions of the program are separate objects, they must give the same program as one object
+LINK_MODES = [[], ["--irgen-threads=3"], ["-O2", "--irgen-threads=3"], ["--codegen-partitions=3"],
+    ["-O2", "--codegen-partitions=3"]]
+# Each program is compiled twice through the compile cache
+CACHE_MODES = [["--cache-functions"], ["-O2", "--cache-functions"]]
+TIMEOUT = 60
+
+
+def run_command(arguments, directory=None, input=""):
+    result = subprocess.run(arguments, cwd=directory, input=input, stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT, universal_newlines=True, timeout=TIMEOUT)
+    return result.returncode, result.stdout
+
+
+def run_compiler(compiler, arguments, directory=None, input=""):
+    return run_command([compiler] + arguments, directory, input)
+
+
+def read_expected(source):
+    with open(os.path.splitext(source)[0] + ".expected") as file:
+        return file.read()
+
+
+# Standard input of the program, empty if there is no <name>.input
+def read_input(source):
+    path = os.path.splitext(source)[0] + ".input"
+    if not os.path.exists(path):
+        return ""
+    with open(path) as file:
+        return file.read()
+
+
+def run_program_tests(compiler, root):
+    failures = []
+    for source in sorted(glob.glob(os.path.join(root, "programs", "*.txt"))):
+        name = os.path.splitext(os.path.basename(source))[0]
+        expected = read_expected(source)
+        input = read_input(source)
+        for mode in MODES:
+            code, output = run_compiler(compiler, [source] + mode, input=input)
+            if code != 0 or output != expected:
+                failures.append("%s %s: exit code %d, output:\n%s" % (name, " ".join(mode), code, output))
+    return failures
+
+
+# First run stores the AST to the parse cache, second one must load it rather than store again;
+#  a cache, that can't be written, must not break compilation
+def check_parse_cache(compiler, source, mode, directory, input, expected):
+    cache = os.path.join(directory, "cache")
+    arguments = [source, "--parse-cache=" + cache] + mode
+    code, output = run_compiler(compiler, arguments, directory, input)
+    if code != 0 or output != expected:
+        return code, output
+    files = get_cache_files(cache)
+    code, output = run_compiler(compiler, arguments, directory, input)
+    if code != 0 or output != expected:
+        return code, output
+    if get_cache_files(cache) != files:
+        return code, "second run stored the AST to the cache"
+
+    # Directory of the cache can't be created in a regular file
+    with open(os.path.join(directory, "file"), "w"):
+        pass
+    arguments = [source, "--parse-cache=" + os.path.join(directory, "file", "cache")] + mode
+    code, output = run_compiler(compiler, arguments, directory, input)
+    if code != 0 or output != expected:
+        return code, output
+    return 0, None
+
+
+def run_parse_cache_tests(compiler, root):
+    failures = []
+    for source in sorted(glob.glob(os.path.join(root, "programs", "*.txt"))):
+        name = os.path.splitext(os.path.basename(source))[0]
+        expected = read_expected(source)
+        input = read_input(source)
+        for mode in MODES:
+            with tempfile.TemporaryDirectory() as directory:
+                code, output = check_parse_cache(compiler, source, mode, directory, input, expected)
+            if output is not None:
+                failures.append("%s parse cache %s: exit code %d, output:\n%s" % (name, " ".join(mode), code, output))
+    return failures
+
+
+# Links object files of the compiler in the directory and runs the program
+def link_and_run(linker, directory, input):
+    objects = sorted(glob.glob(os.path.join(directory, "output*.o")))
+    program = os.path.join(directory, "program")
+    code, output = run_command([linker] + objects + ["-o", program, "-no-pie", "-lm"])
+    if code != 0:
+        return code, output
+    return run_command([program], input=input)
+
+
+def run_linked_program_tests(compiler, root, linker):
+    if not linker:
+        print("no C compiler, linked programs are not tested")
+        return []
+
+    failures = []
+    for source in sorted(glob.glob(os.path.join(root, "programs", "*.txt"))):
+        name = os.path.splitext(os.path.basename(source))[0]
+        expected = read_expected(source)
+        input = read_input(source)
+        for mode in LINK_MODES:
+            with tempfile.TemporaryDirectory() as directory:
+                code, output = run_compiler(compiler, [source] + mode, directory)
+                if code == 0:
+                    code, output = link_and_run(linker, directory, input)
+            if code != 0 or output != expected:
+                failures.append("%s linked %s: exit code %d, output:\n%s" % (name, " ".join(mode), code, output))
+    return failures
+
+
+# Objects are removed, so the next compilation can't leave objects of the previous one
+def take_objects(directory):
+    objects = {}
+    for path in glob.glob(os.path.join(directory, "output*.o")):
+        with open(path, "rb") as file:
+            objects[os.path.basename(path)] = file.read()
+        os.remove(path)
+    return objects
+
+
+# Entries are written to new files, that replace the old ones, so inodes of the cache files
+#  are kept only if nothing is stored
+def get_cache_files(directory):
+    return dict((name, os.stat(os.path.join(directory, name)).st_ino) for name in os.listdir(directory))
+
+
+# Second compilation must load all objects from the cache and give the same objects as the first one
+def check_cache_hit(compiler, arguments, directory, cache, linker, input, expected):
+    code, output = run_compiler(compiler, arguments, directory)
+    if code != 0:
+        return code, output
+    objects = take_objects(directory)
+    files = get_cache_files(cache)
+    code, output = run_compiler(compiler, arguments, directory)
+    if code != 0:
+        return code, output
+    if get_cache_files(cache) != files:
+        return code, "second compilation stored objects to the cache"
+    if linker:
+        code, output = link_and_run(linker, directory, input)
+        if code != 0 or output != expected:
+            return code, output
+    if take_objects(directory) != objects:
+        return code, "objects of the second compilation differ from the first one"
+    return 0, None
+
+
+def run_function_cache_tests(compiler, root, linker):
+    failures = []
+    for source in sorted(glob.glob(os.path.join(root, "programs", "*.txt"))):
+        name = os.path.splitext(os.path.basename(source))[0]
+        expected = read_expected(source)
+        input = read_input(source)
+        for mode in CACHE_MODES:
+            with tempfile.TemporaryDirectory() as directory:
+                cache = os.path.join(directory, "cache")
+                arguments = [source, "--compile-cache=" + cache] + mode
+                code, output = check_cache_hit(compiler, arguments, directory, cache, linker, input, expected)
+            if output is not None:
+                failures.append("%s %s: exit code %d, output:\n%s" % (name, " ".join(mode), code, output))
+    return failures
+
+
+def run_failure_tests(compiler, root):
+    failures = []
+    for source in sorted(glob.glob(os.path.join(root, "failures", "*.txt"))):
+        name = os.path.splitext(os.path.basename(source))[0]
+        expectedPath = os.path.splitext(source)[0] + ".expected"
+        expected = None
+        if os.path.exists(expectedPath):
+            with open(expectedPath) as file:
+                expected = file.read().strip()
+        for mode in MODES:
+            code, output = run_compiler(compiler, [source] + mode)
+            if code == 0 or (expected is not None and expected not in output):
+                failures.append("%s %s: exit code %d, output:\n%s" % (name, " ".join(mode), code, output))
+    return failures
+
+
+# Basic blocks of every function of the IR file: {function: [(label, [instructions])]}
+def parse_functions(ir):
+    functions = {}
+    blocks = None
+    for line in ir.splitlines():
+        define = re.match(r"define .*@([\w.]+)\(", line)
+        if define:
+            blocks = functions.setdefault(define.group(1), [])
+            continue
+        if blocks is None:
+            continue
+        if line == "}":
+            blocks = None
+            continue
+        label = re.match(r"([\w.]+):", line)
+        if label:
+            blocks.append((label.group(1), []))
+        elif line.strip():
+            blocks[-1][1].append(line.strip())
+    return functions
+
+
+def get_successors(terminator):
+    return re.findall(r"label %([\w.]+)", terminator)
+
+
+# Loop is recognized by the latch, that carries loop metadata; it must be the only back-edge,
+#  header must be entered only from the preheader, that is reached from the guard checking
+#  condition before the first iteration, and the exit block must be reached only from the latch
+def check_loop_form(name, blocks):
+    errors = []
+    terminators = dict((label, instructions[-1]) for label, instructions in blocks)
+    predecessors = dict((label, []) for label, _ in blocks)
+    for label, terminator in terminators.items():
+        for successor in get_successors(terminator):
+            predecessors[successor].append(label)
+
+    latches = [label for label, terminator in terminators.items() if "!llvm.loop" in terminator]
+    for latch in latches:
+        successors = get_successors(terminators[latch])
+        if len(successors) != 2:
+            errors.append("%s: latch %s is not a conditional branch" % (name, latch))
+            continue
+        header, exit = successors
+        outside = [block for block in predecessors[header] if block != latch]
+        if len(predecessors[header]) != 2 or len(outside) != 1:
+            errors.append("%s: header %s has predecessors %s" % (name, header, predecessors[header]))
+            continue
+        preheader = outside[0]
+        if dict(blocks)[preheader] != ["br label %" + header]:
+            errors.append("%s: %s is not a preheader of %s" % (name, preheader, header))
+            continue
+        guards = predecessors[preheader]
+        guardSuccessors = get_successors(terminators[guards[0]]) if len(guards) == 1 else []
+        if len(guardSuccessors) != 2 or guardSuccessors[0] != preheader:
+            errors.append("%s: preheader %s is not reached from a guard" % (name, preheader))
+            continue
+        if predecessors[exit] != [latch] or get_successors(terminators[exit]) != [guardSuccessors[1]]:
+            errors.append("%s: exit %s of %s is not dedicated" % (name, exit, header))
+    return latches, errors
+
+
+def run_loop_form_tests(compiler, root):
+    failures = []
+    for source in sorted(glob.glob(os.path.join(root, "ir", "while_*.txt"))):
+        name = os.path.splitext(os.path.basename(source))[0]
+        with open(source) as file:
+            loopCount = len(re.findall(r"\bwhile\b", file.read()))
+        with tempfile.TemporaryDirectory() as directory:
+            code, output = run_compiler(compiler, [source, "-O0"], directory)
+            if code != 0:
+                failures.append("%s: exit code %d, output:\n%s" % (name, code, output))
+                continue
+            with open(os.path.join(directory, "output.ll")) as file:
+                functions = parse_functions(file.read())
+
+        latchCount = 0
+        for function, blocks in sorted(functions.items()):
+            latches, errors = check_loop_form(name + " " + function, blocks)
+            latchCount += len(latches)
+            failures.extend(errors)
+        if latchCount != loopCount:
+            failures.append("%s: %d loops found in IR, %d in the program" % (name, latchCount, loopCount))
+    return failures
+
+
+def run_ir_check_tests(compiler, root):
+    failures = []
+    for checks in sorted(glob.glob(os.path.join(root, "ir", "*.checks"))):
+        source = os.path.splitext(checks)[0] + ".txt"
+        name = os.path.splitext(os.path.basename(source))[0]
+        with tempfile.TemporaryDirectory() as directory:
+            code, output = run_compiler(compiler, [source, "-O0"], directory)
+            if code != 0:
+                failures.append("%s: exit code %d, output:\n%s" % (name, code, output))
+                continue
+            with open(os.path.join(directory, "output.ll")) as file:
+                functions = parse_functions(file.read())
+
+        with open(checks) as file:
+            lines = [line.strip() for line in file if line.strip()]
+        for line in lines:
+            check = re.match(r"(CHECK|CHECK-NOT) ([\w.]+): (.*)$", line)
+            if not check:
+                failures.append("%s: malformed check '%s'" % (name, line))
+                continue
+            kind, function, pattern = check.groups()
+            instructions = [instruction for _, block in functions.get(function, []) for instruction in block]
+            found = any(re.search(pattern, instruction) for instruction in instructions)
+            if function not in functions or found != (kind == "CHECK"):
+                failures.append("%s: '%s' failed, %s:\n%s" % (name, line, function, "\n".join(instructions)))
+    return failures
+
+
+def main():
+    if len(sys.argv) != 2:
+        print("usage: run_tests.py <compiler executable>")
+        return 2
+    compiler = os.path.abspath(sys.argv[1])
+    root = os.path.dirname(os.path.abspath(__file__))
+
+    linker = shutil.which(os.environ.get("CC", "cc"))
+
+    failures = (run_program_tests(compiler, root) + run_parse_cache_tests(compiler, root) +
+        run_linked_program_tests(compiler, root, linker) +
+        run_function_cache_tests(compiler, root, linker) + run_failure_tests(compiler, root) +
+        run_loop_form_tests(compiler, root) + run_ir_check_tests(compiler, root))
+    for failure in failures:
+        print("FAIL " + failure)
+    print("%d failed" % len(failures) if failures else "all tests passed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
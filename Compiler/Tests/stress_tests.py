@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+# Stress tests of the compiler on deep and wide programs of about <size> AST nodes (a million by default).
+# Parsing, semantic analysis, codegen, bytecode compilation, serialization to the parse cache
+#  and destruction of the AST must not depend on the call stack, so every program is compiled
+#  with the stack limited to STACK_LIMIT bytes (on POSIX), and must print the expected value.
+# Wide programs are spread over many basic blocks and functions: LLVM backend
+#  at -O0 is quadratic on a single basic block with a million instructions.
+# Usage: stress_tests.py <compiler executable> [size]
+import os
+import subprocess
+import sys
+import tempfile
+
+try:
+    import resource
+except ImportError:
+    resource = None
+
+MODES = [["--run"], ["--run", "-O2"], ["--interpret"]]
+STACK_LIMIT = 1024 * 1024
+TIMEOUT = 600
+
+
+def make_main(body, result):
+    return "func main() -> Int:\n{\n%s\tprint(\"%%d\\n\", %s);\n\treturn 0;\n}\n" % (body, result)
+
+
+# 0 + 1 + 1 + ... is a left-leaning chain of binary expressions
+def make_deep_sum(size):
+    count = size // 2
+    return make_main("\tvar x: Int = 0" + " + 1" * count + ";\n", "x"), "%d\n" % count
+
+
+def make_deep_negation(size):
+    return make_main("\tvar x: Int = " + "-" * size + "1;\n", "x"), "%d\n" % (-1 if size % 2 else 1)
+
+
+def make_deep_parentheses(size):
+    return make_main("\tvar x: Int = " + "(" * size + "1" + ")" * size + ";\n", "x"), "1\n"
+
+
+# Conditions don't refer to variables: name lookup walks all enclosing scopes
+def make_deep_if(size):
+    count = size // 4
+    body = "\tvar x: Int = 0;\n\t" + "if (1 < 2) {" * count + " x = 1; " + "}" * count + "\n"
+    return make_main(body, "x"), "1\n"
+
+
+def make_wide_array(size):
+    body = ("\tvar a: Array<Int> = [" + ", ".join(["1"] * size) + "];\n"
+        "\tvar s: Int = 0;\n"
+        "\tvar i: Int = 0;\n"
+        "\twhile (i < %d)\n"
+        "\t{\n"
+        "\t\ts = s + a[i];\n"
+        "\t\ti = i + 1;\n"
+        "\t}\n") % size
+    return make_main(body, "s"), "%d\n" % size
+
+
+def make_wide_block(size):
+    count = size // 8
+    body = "\tvar x: Int = 0;\n" + "\tif (x >= 0) { x = x + 1; }\n" * count
+    return make_main(body, "x"), "%d\n" % count
+
+
+def make_wide_program(size):
+    count = size // 8
+    functions = "".join("func f%d(x: Int) -> Int:\n{\n\treturn x + %d;\n}\n\n" % (i, i) for i in range(count))
+    return functions + make_main("", "f%d(1)" % (count - 1)), "%d\n" % count
+
+
+GENERATORS = [
+    ("deep_sum", make_deep_sum),
+    ("deep_negation", make_deep_negation),
+    ("deep_parentheses", make_deep_parentheses),
+    ("deep_if", make_deep_if),
+    ("wide_array", make_wide_array),
+    ("wide_block", make_wide_block),
+    ("wide_program", make_wide_program),
+]
+
+
+def limit_stack():
+    resource.setrlimit(resource.RLIMIT_STACK, (STACK_LIMIT, STACK_LIMIT))
+
+
+def run_compiler(compiler, arguments, directory):
+    result = subprocess.run([compiler] + arguments, cwd=directory, stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT, universal_newlines=True, timeout=TIMEOUT,
+        preexec_fn=limit_stack if resource else None)
+    return result.returncode, result.stdout
+
+
+def check_run(name, compiler, arguments, directory, expected):
+    code, output = run_compiler(compiler, arguments, directory)
+    if code != 0 or output != expected:
+        return ["%s %s: exit code %d, output:\n%s" % (name, " ".join(arguments[1:]), code, output[-1000:])]
+    return []
+
+
+def run_stress_tests(compiler, size):
+    failures = []
+    for name, generator in GENERATORS:
+        failureCount = len(failures)
+        program, expected = generator(size)
+        with tempfile.TemporaryDirectory() as directory:
+            source = os.path.join(directory, name + ".txt")
+            with open(source, "w") as file:
+                file.write(program)
+            for mode in MODES:
+                failures.extend(check_run(name, compiler, [source] + mode, directory, expected))
+            # First run stores the AST to the cache, second one loads it
+            cache = ["--interpret", "--parse-cache=" + os.path.join(directory, "cache")]
+            for _ in range(2):
+                failures.extend(check_run(name, compiler, [source] + cache, directory, expected))
+        print("%s: %s" % (name, "FAIL" if len(failures) > failureCount else "ok"))
+        sys.stdout.flush()
+    return failures
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        print("usage: stress_tests.py <compiler executable> [size]")
+        return 2
+    compiler = os.path.abspath(sys.argv[1])
+    size = int(sys.argv[2]) if len(sys.argv) == 3 else 1000000
+
+    failures = run_stress_tests(compiler, size)
+    for failure in failures:
+        print("FAIL " + failure)
+    print("%d failed" % len(failures) if failures else "all tests passed")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())